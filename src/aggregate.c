@@ -0,0 +1,365 @@
+#include <immintrin.h>
+#include "aggregate.h"
+#include "db_scan.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+/// ***************************************************************************
+/// Kernel Templates
+/// ***************************************************************************
+
+// Every data type gets the same kernels from these templates. A template is
+// given the vector type and the operations of an instruction set, the rest
+// (the tail, reducing the lanes) is shared.
+
+/**
+ * @brief Makes a sum kernel. LOAD reads LANES values as accumulator lanes
+ *  (widening them if needed), so the sum can't overflow the value type.
+ */
+#define DEFINE_SUM_KERNEL(FUNC, TYPE, ACC, ISA, VEC, LANES, ZERO, LOAD, ADD, STORE) \
+    __attribute__((target(ISA)))                                                \
+    static ACC FUNC(const TYPE* data, size_t num_items) {                       \
+        VEC sums = ZERO();                                                      \
+        size_t i = 0;                                                           \
+        for (; i + LANES <= num_items; i += LANES) {                            \
+            sums = ADD(sums, LOAD(&data[i]));                                   \
+        }                                                                       \
+        ACC lanes[LANES];                                                       \
+        STORE(lanes, sums);                                                     \
+        ACC sum = 0;                                                            \
+        for (size_t lane = 0; lane < LANES; lane++) {                           \
+            sum += lanes[lane];                                                 \
+        }                                                                       \
+        for (; i < num_items; i++) {                                            \
+            sum += data[i];                                                     \
+        }                                                                       \
+        return sum;                                                             \
+    }
+
+/**
+ * @brief Makes a fused min and max kernel (one pass for both bounds)
+ */
+#define DEFINE_MIN_MAX_KERNEL(FUNC, TYPE, ISA, VEC, LANES, SET1, LOAD, VMIN, VMAX, STORE) \
+    __attribute__((target(ISA)))                                                \
+    static void FUNC(const TYPE* data, size_t num_items, TYPE* min_out, TYPE* max_out) { \
+        VEC mins = SET1(data[0]);                                               \
+        VEC maxs = mins;                                                        \
+        size_t i = 0;                                                           \
+        for (; i + LANES <= num_items; i += LANES) {                            \
+            VEC values = LOAD(&data[i]);                                        \
+            mins = VMIN(mins, values);                                          \
+            maxs = VMAX(maxs, values);                                          \
+        }                                                                       \
+        TYPE lanes[LANES];                                                      \
+        TYPE min = data[0];                                                     \
+        TYPE max = data[0];                                                     \
+        STORE(lanes, mins);                                                     \
+        for (size_t lane = 0; lane < LANES; lane++) {                           \
+            min = MIN(min, lanes[lane]);                                        \
+        }                                                                       \
+        STORE(lanes, maxs);                                                     \
+        for (size_t lane = 0; lane < LANES; lane++) {                           \
+            max = MAX(max, lanes[lane]);                                        \
+        }                                                                       \
+        for (; i < num_items; i++) {                                            \
+            min = MIN(min, data[i]);                                            \
+            max = MAX(max, data[i]);                                            \
+        }                                                                       \
+        *min_out = min;                                                         \
+        *max_out = max;                                                         \
+    }
+
+/**
+ * @brief Makes the portable kernels of a type
+ */
+#define DEFINE_SCALAR_KERNELS(NAME, TYPE, ACC)                                  \
+    static ACC sum_##NAME##_scalar(const TYPE* data, size_t num_items) {        \
+        ACC sum = 0;                                                            \
+        for (size_t i = 0; i < num_items; i++) {                                \
+            sum += data[i];                                                     \
+        }                                                                       \
+        return sum;                                                             \
+    }                                                                           \
+    static void min_max_##NAME##_scalar(const TYPE* data, size_t num_items,     \
+                                        TYPE* min_out, TYPE* max_out) {         \
+        TYPE min = data[0];                                                     \
+        TYPE max = data[0];                                                     \
+        for (size_t i = 1; i < num_items; i++) {                                \
+            min = MIN(min, data[i]);                                            \
+            max = MAX(max, data[i]);                                            \
+        }                                                                       \
+        *min_out = min;                                                         \
+        *max_out = max;                                                         \
+    }
+
+/// ***************************************************************************
+/// Vector Operations
+/// ***************************************************************************
+
+#define LOAD_SI128(p) _mm_loadu_si128((const __m128i*) (p))
+#define LOAD_SI256(p) _mm256_loadu_si256((const __m256i*) (p))
+#define LOAD_SI512(p) _mm512_loadu_si512((const void*) (p))
+#define STORE_SI256(p, v) _mm256_storeu_si256((__m256i*) (p), v)
+#define STORE_SI512(p, v) _mm512_storeu_si512((void*) (p), v)
+
+// avx2: 32 bit values are widened to 64 bit lanes for the sums
+#define WIDEN_EPI32_AVX2(p) _mm256_cvtepi32_epi64(LOAD_SI128(p))
+#define WIDEN_EPU32_AVX2(p) _mm256_cvtepu32_epi64(LOAD_SI128(p))
+#define SET1_EPI32_AVX2(x) _mm256_set1_epi32((int) (x))
+#define SET1_EPI64_AVX2(x) _mm256_set1_epi64x((long long) (x))
+
+// avx2 has no 64 bit min and max, so they compare and blend
+__attribute__((target("avx2")))
+static inline __m256i min_epi64_avx2(__m256i a, __m256i b) {
+    return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i max_epi64_avx2(__m256i a, __m256i b) {
+    return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b));
+}
+
+// avx512: the same with twice the lanes
+#define WIDEN_EPI32_AVX512(p) _mm512_cvtepi32_epi64(LOAD_SI256(p))
+#define WIDEN_EPU32_AVX512(p) _mm512_cvtepu32_epi64(LOAD_SI256(p))
+#define SET1_EPI32_AVX512(x) _mm512_set1_epi32((int) (x))
+#define SET1_EPI64_AVX512(x) _mm512_set1_epi64((long long) (x))
+
+/// ***************************************************************************
+/// Kernels
+/// ***************************************************************************
+
+// INT
+DEFINE_SCALAR_KERNELS(int, int, long)
+DEFINE_SUM_KERNEL(sum_int_avx2, int, long, "avx2", __m256i, 4,
+                  _mm256_setzero_si256, WIDEN_EPI32_AVX2, _mm256_add_epi64, STORE_SI256)
+DEFINE_SUM_KERNEL(sum_int_avx512, int, long, "avx512f", __m512i, 8,
+                  _mm512_setzero_si512, WIDEN_EPI32_AVX512, _mm512_add_epi64, STORE_SI512)
+DEFINE_MIN_MAX_KERNEL(min_max_int_avx2, int, "avx2", __m256i, 8, SET1_EPI32_AVX2,
+                      LOAD_SI256, _mm256_min_epi32, _mm256_max_epi32, STORE_SI256)
+DEFINE_MIN_MAX_KERNEL(min_max_int_avx512, int, "avx512f", __m512i, 16, SET1_EPI32_AVX512,
+                      LOAD_SI512, _mm512_min_epi32, _mm512_max_epi32, STORE_SI512)
+
+// LONG
+DEFINE_SCALAR_KERNELS(long, long, long)
+DEFINE_SUM_KERNEL(sum_long_avx2, long, long, "avx2", __m256i, 4,
+                  _mm256_setzero_si256, LOAD_SI256, _mm256_add_epi64, STORE_SI256)
+DEFINE_SUM_KERNEL(sum_long_avx512, long, long, "avx512f", __m512i, 8,
+                  _mm512_setzero_si512, LOAD_SI512, _mm512_add_epi64, STORE_SI512)
+DEFINE_MIN_MAX_KERNEL(min_max_long_avx2, long, "avx2", __m256i, 4, SET1_EPI64_AVX2,
+                      LOAD_SI256, min_epi64_avx2, max_epi64_avx2, STORE_SI256)
+DEFINE_MIN_MAX_KERNEL(min_max_long_avx512, long, "avx512f", __m512i, 8, SET1_EPI64_AVX512,
+                      LOAD_SI512, _mm512_min_epi64, _mm512_max_epi64, STORE_SI512)
+
+// DOUBLE
+DEFINE_SCALAR_KERNELS(double, double, double)
+DEFINE_SUM_KERNEL(sum_double_avx2, double, double, "avx2", __m256d, 4,
+                  _mm256_setzero_pd, _mm256_loadu_pd, _mm256_add_pd, _mm256_storeu_pd)
+DEFINE_SUM_KERNEL(sum_double_avx512, double, double, "avx512f", __m512d, 8,
+                  _mm512_setzero_pd, _mm512_loadu_pd, _mm512_add_pd, _mm512_storeu_pd)
+DEFINE_MIN_MAX_KERNEL(min_max_double_avx2, double, "avx2", __m256d, 4, _mm256_set1_pd,
+                      _mm256_loadu_pd, _mm256_min_pd, _mm256_max_pd, _mm256_storeu_pd)
+DEFINE_MIN_MAX_KERNEL(min_max_double_avx512, double, "avx512f", __m512d, 8, _mm512_set1_pd,
+                      _mm512_loadu_pd, _mm512_min_pd, _mm512_max_pd, _mm512_storeu_pd)
+
+// INDEX
+DEFINE_SCALAR_KERNELS(index, pos_t, long)
+#if COMPACT_POSITIONS
+DEFINE_SUM_KERNEL(sum_index_avx2, pos_t, long, "avx2", __m256i, 4,
+                  _mm256_setzero_si256, WIDEN_EPU32_AVX2, _mm256_add_epi64, STORE_SI256)
+DEFINE_SUM_KERNEL(sum_index_avx512, pos_t, long, "avx512f", __m512i, 8,
+                  _mm512_setzero_si512, WIDEN_EPU32_AVX512, _mm512_add_epi64, STORE_SI512)
+DEFINE_MIN_MAX_KERNEL(min_max_index_avx2, pos_t, "avx2", __m256i, 8, SET1_EPI32_AVX2,
+                      LOAD_SI256, _mm256_min_epu32, _mm256_max_epu32, STORE_SI256)
+DEFINE_MIN_MAX_KERNEL(min_max_index_avx512, pos_t, "avx512f", __m512i, 16, SET1_EPI32_AVX512,
+                      LOAD_SI512, _mm512_min_epu32, _mm512_max_epu32, STORE_SI512)
+#else
+// 64 bit positions never get near the sign bit, so the signed kernels work
+DEFINE_SUM_KERNEL(sum_index_avx2, pos_t, long, "avx2", __m256i, 4,
+                  _mm256_setzero_si256, LOAD_SI256, _mm256_add_epi64, STORE_SI256)
+DEFINE_SUM_KERNEL(sum_index_avx512, pos_t, long, "avx512f", __m512i, 8,
+                  _mm512_setzero_si512, LOAD_SI512, _mm512_add_epi64, STORE_SI512)
+DEFINE_MIN_MAX_KERNEL(min_max_index_avx2, pos_t, "avx2", __m256i, 4, SET1_EPI64_AVX2,
+                      LOAD_SI256, min_epi64_avx2, max_epi64_avx2, STORE_SI256)
+DEFINE_MIN_MAX_KERNEL(min_max_index_avx512, pos_t, "avx512f", __m512i, 8, SET1_EPI64_AVX512,
+                      LOAD_SI512, _mm512_min_epi64, _mm512_max_epi64, STORE_SI512)
+#endif
+
+/// ***************************************************************************
+/// Parallel Reduction
+/// ***************************************************************************
+
+/**
+ * @brief This function returns how many tasks reduce an input
+ *
+ * @param num_items
+ *
+ * @return the number of tasks (1 means the calling thread does it alone)
+ */
+static size_t aggregate_parallelism(size_t num_items) {
+    if (num_items < PARALLEL_AGGREGATE_MIN_ROWS) {
+        return 1;
+    }
+    size_t num_tasks = MIN(thread_pool_parallelism(), num_items / AGGREGATE_CHUNK_SZ);
+    return MAX(MIN(num_tasks, MAX_POOL_THREADS), 1);
+}
+
+/**
+ * @brief Makes the driver of a type: it picks the kernel of the cpu and
+ *  splits large inputs into one task per worker. Each task reduces its
+ *  slice and the partial sums, mins and maxes are combined at the end.
+ */
+#define DEFINE_AGGREGATES(NAME, TYPE, ACC)                                      \
+    static ACC sum_##NAME(const TYPE* data, size_t num_items) {                 \
+        switch (get_select_kernel()->isa) {                                     \
+            case ISA_AVX512:                                                    \
+                return sum_##NAME##_avx512(data, num_items);                    \
+            case ISA_AVX2:                                                      \
+                return sum_##NAME##_avx2(data, num_items);                      \
+            default:                                                            \
+                return sum_##NAME##_scalar(data, num_items);                    \
+        }                                                                       \
+    }                                                                           \
+    static void min_max_##NAME(const TYPE* data, size_t num_items,              \
+                               TYPE* min_out, TYPE* max_out) {                  \
+        switch (get_select_kernel()->isa) {                                     \
+            case ISA_AVX512:                                                    \
+                min_max_##NAME##_avx512(data, num_items, min_out, max_out);     \
+                break;                                                          \
+            case ISA_AVX2:                                                      \
+                min_max_##NAME##_avx2(data, num_items, min_out, max_out);       \
+                break;                                                          \
+            default:                                                            \
+                min_max_##NAME##_scalar(data, num_items, min_out, max_out);     \
+                break;                                                          \
+        }                                                                       \
+    }                                                                           \
+    typedef struct NAME##_aggregate_task {                                      \
+        const TYPE* data;                                                       \
+        size_t num_items;                                                       \
+        bool want_sum;                                                          \
+        ACC sum;                                                                \
+        TYPE min;                                                               \
+        TYPE max;                                                               \
+    } NAME##_aggregate_task;                                                    \
+    static void* NAME##_aggregate_worker(void* task_arg) {                      \
+        NAME##_aggregate_task* task = (NAME##_aggregate_task*) task_arg;        \
+        if (task->want_sum) {                                                   \
+            task->sum = sum_##NAME(task->data, task->num_items);                \
+        } else {                                                                \
+            min_max_##NAME(task->data, task->num_items, &task->min, &task->max); \
+        }                                                                       \
+        return NULL;                                                            \
+    }                                                                           \
+    static void reduce_##NAME(const TYPE* data, size_t num_items, bool want_sum, \
+                              ACC* sum, TYPE* min, TYPE* max) {                 \
+        size_t num_tasks = aggregate_parallelism(num_items);                    \
+        NAME##_aggregate_task tasks[MAX_POOL_THREADS];                          \
+        size_t slice = (num_items + num_tasks - 1) / num_tasks;                 \
+        TaskGroup group;                                                        \
+        task_group_init(&group);                                                \
+        for (size_t t = 0; t < num_tasks; t++) {                                \
+            tasks[t].data = &data[t * slice];                                   \
+            tasks[t].num_items = MIN(slice, num_items - t * slice);             \
+            tasks[t].want_sum = want_sum;                                       \
+            if (num_tasks > 1) {                                                \
+                thread_pool_submit(&group, NAME##_aggregate_worker, &tasks[t]); \
+            } else {                                                            \
+                NAME##_aggregate_worker(&tasks[t]);                             \
+            }                                                                   \
+        }                                                                       \
+        if (num_tasks > 1) {                                                    \
+            task_group_wait(&group);                                            \
+        }                                                                       \
+        if (want_sum) {                                                         \
+            *sum = 0;                                                           \
+            for (size_t t = 0; t < num_tasks; t++) {                            \
+                *sum += tasks[t].sum;                                           \
+            }                                                                   \
+            return;                                                             \
+        }                                                                       \
+        *min = tasks[0].min;                                                    \
+        *max = tasks[0].max;                                                    \
+        for (size_t t = 1; t < num_tasks; t++) {                                \
+            *min = MIN(*min, tasks[t].min);                                     \
+            *max = MAX(*max, tasks[t].max);                                     \
+        }                                                                       \
+    }
+
+DEFINE_AGGREGATES(int, int, long)
+DEFINE_AGGREGATES(long, long, long)
+DEFINE_AGGREGATES(double, double, double)
+DEFINE_AGGREGATES(index, pos_t, long)
+
+/// ***************************************************************************
+/// Aggregate Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function sums an array of values
+ *
+ * @param data_type - INT, LONG, DOUBLE or INDEX
+ * @param data
+ * @param num_items
+ *
+ * @return the sum (0 for other types)
+ */
+long aggregate_sum(DataType data_type, const void* data, size_t num_items) {
+    long sum = 0;
+    double double_sum = 0;
+    if (num_items == 0) {
+        return 0;
+    }
+    switch (data_type) {
+        case INT:
+            reduce_int(data, num_items, true, &sum, NULL, NULL);
+            break;
+        case LONG:
+            reduce_long(data, num_items, true, &sum, NULL, NULL);
+            break;
+        case DOUBLE:
+            reduce_double(data, num_items, true, &double_sum, NULL, NULL);
+            sum = (long) double_sum;
+            break;
+        case INDEX:
+            reduce_index(data, num_items, true, &sum, NULL, NULL);
+            break;
+        default:
+            break;
+    }
+    return sum;
+}
+
+/**
+ * @brief This function finds the min and the max of an array of values
+ *
+ * @param data_type - INT, LONG, DOUBLE or INDEX
+ * @param data
+ * @param num_items - at least 1
+ * @param min_out - room for one value of the data type
+ * @param max_out - room for one value of the data type
+ */
+void aggregate_min_max(
+    DataType data_type,
+    const void* data,
+    size_t num_items,
+    void* min_out,
+    void* max_out
+) {
+    switch (data_type) {
+        case INT:
+            reduce_int(data, num_items, false, NULL, min_out, max_out);
+            break;
+        case LONG:
+            reduce_long(data, num_items, false, NULL, min_out, max_out);
+            break;
+        case DOUBLE:
+            reduce_double(data, num_items, false, NULL, min_out, max_out);
+            break;
+        case INDEX:
+            reduce_index(data, num_items, false, NULL, min_out, max_out);
+            break;
+        default:
+            break;
+    }
+}
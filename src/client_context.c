@@ -1,6 +1,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include "client_context.h"
+#include "zone_map.h"
+#include "prefix_sum.h"
+#include "db_operations.h"
 #define HANDLE_INIT_SIZE 8
 
 
@@ -45,7 +48,8 @@ GeneralizedColumnHandle* add_result_column(ClientContext* context, const char* h
     // TODO: switch this to a hash table
     for (int i = 0; i < context->chandles_in_use; i++) {
         if(strcmp(context->chandle_table[i].name, handle) == 0) {
-            // free the column
+            // free the column (a view has to stop being tracked first)
+            release_view(context->chandle_table[i].generalized_column.column_pointer.result);
             free(context->chandle_table[i].generalized_column.column_pointer.result);
             context->chandle_table[i].generalized_column.column_pointer.result = NULL;
             return &context->chandle_table[i];
@@ -76,20 +80,33 @@ GeneralizedColumnHandle* add_result_column(ClientContext* context, const char* h
  * @return size_t - where to add the column
  */
 size_t next_table_idx(Table* table, Status* ret_status) {
+    // every row has to be addressable by a pos_t
+    if (table->table_size >= MAX_TABLE_ROWS) {
+        ret_status->code = ERROR;
+        ret_status->msg_type = QUERY_UNSUPPORTED;
+        ret_status->msg = "Table has reached the maximum number of rows";
+        return table->table_size;
+    }
     // get the index of the column - realloc if needed
     if (table->table_size == table->table_length) {
-        // double size of table
-        table->table_length *= 2;
+        // double size of table (positions can't go past MAX_TABLE_ROWS)
+        table->table_length = table->table_length > MAX_TABLE_ROWS / 2 ?
+            MAX_TABLE_ROWS : table->table_length * 2;
         // reallocate each column
         size_t idx = 0;
         while (idx < table->col_count && ret_status->code != ERROR) {
-            // realloc the table
-            int* tmp = realloc(
-                table->columns[idx].data,
-                table->table_length * sizeof(int)
-            );
+            // realloc the table (compressed columns get room when they are
+            // decompressed)
+            bool compressed = table->columns[idx].compressed != NULL;
+            int* tmp = table->columns[idx].data;
+            if (!compressed) {
+                tmp = realloc(tmp, table->table_length * sizeof(int));
+            }
             // check for error in realloc
-            if (!tmp) {
+            if ((!tmp && !compressed) || !zone_map_reserve(table->columns[idx].zone_map,
+                                          table->table_length) ||
+                    !prefix_sums_reserve(table->columns[idx].prefix_sums,
+                                         table->table_length)) {
                 ret_status->code = ERROR;
                 ret_status->msg_type = MEM_ALLOC_FAILED;
                 ret_status->msg = "Could not reallocate new data";
@@ -0,0 +1,710 @@
+#include <stdio.h>
+#include <string.h>
+#include "compression.h"
+#include "zone_map.h"
+#include "utils.h"
+
+// words needed for num_rows codes, the padding lets us always read the word
+// after the one a code starts in
+#define PACKED_WORDS(num_rows, bit_width) \
+    ((((num_rows) * (bit_width)) + 63) / 64 + 2)
+
+/// ***************************************************************************
+/// Bit Packing Helpers
+/// ***************************************************************************
+
+/**
+ * @brief This function returns the number of bits needed for a value
+ */
+static unsigned bits_needed(uint64_t value) {
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+/**
+ * @brief This function writes a code into a (zeroed) packed array
+ *
+ * @param packed - the packed words
+ * @param bit_width - bits per code
+ * @param idx - the code's row
+ * @param code
+ */
+static void pack_code(uint64_t* packed, unsigned bit_width, size_t idx, uint32_t code) {
+    if (bit_width == 0) {
+        return;
+    }
+    size_t bit = idx * bit_width;
+    unsigned offset = bit & 63;
+    packed[bit >> 6] |= (uint64_t) code << offset;
+    if (offset + bit_width > 64) {
+        packed[(bit >> 6) + 1] |= (uint64_t) code >> (64 - offset);
+    }
+}
+
+/**
+ * @brief This function reads a code out of a packed array. The word after
+ *  the code's first word is always read (and shifted away if the code
+ *  doesn't straddle the two) so there is no branch.
+ *
+ * @param packed - the packed words
+ * @param bit_width - bits per code
+ * @param idx - the code's row
+ *
+ * @return the code
+ */
+static inline uint32_t unpack_code(const uint64_t* packed, unsigned bit_width, size_t idx) {
+    size_t bit = idx * bit_width;
+    const uint64_t* word = &packed[bit >> 6];
+    unsigned offset = bit & 63;
+    uint64_t bits = (word[0] >> offset) | ((word[1] << 1) << (63 - offset));
+    return (uint32_t) (bits & ((1ULL << bit_width) - 1));
+}
+
+/**
+ * @brief This function unpacks a block of codes
+ *
+ * @param compressed
+ * @param start - first row
+ * @param count - number of codes
+ * @param codes - output
+ */
+static void unpack_block(
+    const CompressedColumn* compressed,
+    size_t start,
+    size_t count,
+    uint32_t* codes
+) {
+    for (size_t i = 0; i < count; i++) {
+        codes[i] = unpack_code(compressed->packed, compressed->bit_width, start + i);
+    }
+}
+
+/**
+ * @brief This function finds the first dictionary entry >= value
+ */
+static size_t dict_lower_bound(const int* dictionary, size_t dict_size, long value) {
+    size_t low = 0;
+    size_t high = dict_size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (dictionary[mid] < value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief This function finds the run that holds a row. Fetches mostly come
+ *  in row order so the current and the next run are tried before searching.
+ *
+ * @param compressed
+ * @param row_idx
+ * @param run_idx - the run of the previous row
+ *
+ * @return the run
+ */
+static inline size_t find_run(const CompressedColumn* compressed, size_t row_idx, size_t run_idx) {
+    const size_t* run_ends = compressed->run_ends;
+    if (run_idx < compressed->num_runs &&
+        (run_idx == 0 || row_idx >= run_ends[run_idx - 1])) {
+        if (row_idx < run_ends[run_idx]) {
+            return run_idx;
+        }
+        if (run_idx + 1 < compressed->num_runs && row_idx < run_ends[run_idx + 1]) {
+            return run_idx + 1;
+        }
+    }
+    size_t low = 0;
+    size_t high = compressed->num_runs;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (run_ends[mid] <= row_idx) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief This function decodes the value of a single row
+ *
+ * @param compressed
+ * @param row_idx
+ * @param run_idx - RLE only: the run of the previous row (updated)
+ *
+ * @return the value
+ */
+static inline int value_at(const CompressedColumn* compressed, size_t row_idx, size_t* run_idx) {
+    switch (compressed->encoding) {
+        case ENCODING_FOR:
+            return compressed->base +
+                (int) unpack_code(compressed->packed, compressed->bit_width, row_idx);
+        case ENCODING_DICT:
+            return compressed->dictionary[
+                unpack_code(compressed->packed, compressed->bit_width, row_idx)
+            ];
+        case ENCODING_RLE:
+        default:
+            *run_idx = find_run(compressed, row_idx, *run_idx);
+            return compressed->run_values[*run_idx];
+    }
+}
+
+/// ***************************************************************************
+/// Compression Functions
+/// ***************************************************************************
+
+/**
+ * @brief Comparison function for sorting ints
+ */
+static int compare_ints(const void* a, const void* b) {
+    int int_a = *(const int*) a;
+    int int_b = *(const int*) b;
+    return (int_a > int_b) - (int_a < int_b);
+}
+
+/**
+ * @brief This function creates an empty compressed column
+ */
+static CompressedColumn* create_compressed_column(
+    ColumnEncoding encoding,
+    size_t num_rows,
+    int min_value,
+    int max_value
+) {
+    CompressedColumn* compressed = calloc(1, sizeof(CompressedColumn));
+    compressed->encoding = encoding;
+    compressed->num_rows = num_rows;
+    compressed->min_value = min_value;
+    compressed->max_value = max_value;
+    return compressed;
+}
+
+/**
+ * @brief This function collects the distinct values of a column into an
+ *  open addressing hash set. It gives up as soon as there are more than
+ *  limit of them, so high cardinality columns cost a single pass and a
+ *  small table rather than a sort of the whole column.
+ *
+ * @param data
+ * @param num_rows
+ * @param limit - the most distinct values we care about
+ * @param distinct - output (room for limit values, unsorted)
+ *
+ * @return the number of distinct values (limit + 1 if there are more)
+ */
+static size_t count_distinct(const int* data, size_t num_rows, size_t limit, int* distinct) {
+    if (limit == 0) {
+        return MIN(num_rows, 1);
+    }
+    // at most half full
+    unsigned log_slots = bits_needed(limit * 2 - 1);
+    size_t mask = ((size_t) 1 << log_slots) - 1;
+    int* slots = malloc(sizeof(int) * (mask + 1));
+    bool* used = calloc(mask + 1, sizeof(bool));
+    size_t num_distinct = 0;
+    for (size_t i = 0; i < num_rows && num_distinct <= limit; i++) {
+        size_t slot = (((uint32_t) data[i] * 2654435761U) >> (32 - log_slots)) & mask;
+        while (used[slot] && slots[slot] != data[i]) {
+            slot = (slot + 1) & mask;
+        }
+        if (!used[slot]) {
+            if (num_distinct == limit) {
+                num_distinct++;
+                break;
+            }
+            used[slot] = true;
+            slots[slot] = data[i];
+            distinct[num_distinct++] = data[i];
+        }
+    }
+    free(slots);
+    free(used);
+    return num_distinct;
+}
+
+/**
+ * @brief This function picks an encoding for a column and, if it saves
+ *  enough space, replaces the raw data with the encoded form. Only read
+ *  only columns are compressed - indexes keep pointers into the raw data
+ *  (or are built from it) so indexed columns are left alone.
+ *
+ * @param col
+ *
+ * @return true if the column was compressed
+ */
+bool compress_column(Column* col) {
+    size_t num_rows = *col->size_ptr;
+    if (col->compressed != NULL || col->index_type != NONE ||
+        num_rows < COMPRESSION_MIN_ROWS) {
+        return false;
+    }
+    const int* data = col->data;
+
+    // column statistics
+    int min_value = data[0];
+    int max_value = data[0];
+    size_t num_runs = 1;
+    for (size_t i = 1; i < num_rows; i++) {
+        min_value = MIN(min_value, data[i]);
+        max_value = MAX(max_value, data[i]);
+        num_runs += data[i] != data[i - 1];
+    }
+    // a dictionary only pays off if its codes are narrower than the FOR
+    // codes, so the distinct values are counted up to that point
+    unsigned for_bits = bits_needed((uint64_t) ((long) max_value - (long) min_value));
+    size_t dict_limit = for_bits == 0 ? 0 : MIN((size_t) MAX_DICT_SIZE, 1UL << (for_bits - 1));
+    int* dictionary = malloc(sizeof(int) * MAX(dict_limit, 1));
+    size_t dict_size = count_distinct(data, num_rows, dict_limit, dictionary);
+
+    // the size of every encoding
+    size_t raw_size = num_rows * sizeof(int);
+    size_t for_size = PACKED_WORDS(num_rows, for_bits) * sizeof(uint64_t);
+    unsigned dict_bits = bits_needed(dict_size - 1);
+    size_t dict_bytes = dict_size <= dict_limit ?
+        PACKED_WORDS(num_rows, dict_bits) * sizeof(uint64_t) + dict_size * sizeof(int) :
+        SIZE_MAX;
+    size_t rle_size = num_runs * (sizeof(int) + sizeof(size_t));
+
+    size_t best_size = MIN(for_size, MIN(dict_bytes, rle_size));
+    if (best_size > raw_size * COMPRESSION_MAX_RATIO) {
+        free(dictionary);
+        return false;
+    }
+
+    CompressedColumn* compressed = NULL;
+    if (best_size == rle_size) {
+        compressed = create_compressed_column(ENCODING_RLE, num_rows,
+                                              min_value, max_value);
+        compressed->num_runs = num_runs;
+        compressed->capacity = num_runs;
+        compressed->run_values = malloc(sizeof(int) * num_runs);
+        compressed->run_ends = malloc(sizeof(size_t) * num_runs);
+        size_t run_idx = 0;
+        for (size_t i = 1; i <= num_rows; i++) {
+            if (i == num_rows || data[i] != data[i - 1]) {
+                compressed->run_values[run_idx] = data[i - 1];
+                compressed->run_ends[run_idx++] = i;
+            }
+        }
+        free(dictionary);
+    } else if (best_size == for_size) {
+        compressed = create_compressed_column(ENCODING_FOR, num_rows,
+                                              min_value, max_value);
+        compressed->bit_width = for_bits;
+        compressed->capacity = num_rows;
+        compressed->base = min_value;
+        compressed->packed = calloc(PACKED_WORDS(num_rows, for_bits), sizeof(uint64_t));
+        for (size_t i = 0; i < num_rows; i++) {
+            pack_code(compressed->packed, for_bits, i,
+                      (uint32_t) ((long) data[i] - (long) min_value));
+        }
+        free(dictionary);
+    } else {
+        compressed = create_compressed_column(ENCODING_DICT, num_rows,
+                                              min_value, max_value);
+        compressed->bit_width = dict_bits;
+        compressed->capacity = num_rows;
+        qsort(dictionary, dict_size, sizeof(int), compare_ints);
+        compressed->dictionary = realloc(dictionary, sizeof(int) * dict_size);
+        compressed->dict_size = dict_size;
+        compressed->packed = calloc(PACKED_WORDS(num_rows, dict_bits), sizeof(uint64_t));
+        for (size_t i = 0; i < num_rows; i++) {
+            pack_code(compressed->packed, dict_bits, i, (uint32_t) dict_lower_bound(
+                compressed->dictionary,
+                dict_size,
+                data[i]
+            ));
+        }
+    }
+    log_info("-- Compressed %s: %zu -> %zu bytes (%s)\n", col->name, raw_size,
+             compressed_size(compressed),
+             compressed->encoding == ENCODING_RLE ? "rle" :
+             compressed->encoding == ENCODING_FOR ? "for" : "dict");
+
+    // appends keep the zone map up to date from here on (see
+    // compressed_append) so it only has to be refreshed once
+    zone_map_refresh(col->zone_map, col->data, num_rows);
+    free(col->data);
+    col->data = NULL;
+    col->compressed = compressed;
+    return true;
+}
+
+/**
+ * @brief This function compresses a column the first time it is scanned
+ *  after a load. Loads tend to come in runs, so they only mark the column
+ *  rather than pick an encoding the next load might not fit.
+ *
+ * @param col
+ */
+void compress_loaded_column(Column* col) {
+    if (col->compress_pending) {
+        col->compress_pending = false;
+        compress_column(col);
+    }
+}
+
+/**
+ * @brief This function appends a value to a compressed column without
+ *  decoding it. FOR and dictionary codes are fixed, so the value has to be
+ *  in the frame or the dictionary, and a new run is only added while RLE
+ *  is still smaller than the raw column.
+ *
+ * @param compressed - may be NULL
+ * @param value
+ *
+ * @return true if the value was appended (false leaves the column as is)
+ */
+bool compressed_append(CompressedColumn* compressed, int value) {
+    if (compressed == NULL) {
+        return false;
+    }
+    size_t row_idx = compressed->num_rows;
+    if (compressed->encoding == ENCODING_RLE) {
+        size_t num_runs = compressed->num_runs;
+        if (compressed->run_values[num_runs - 1] == value) {
+            compressed->run_ends[num_runs - 1]++;
+        } else {
+            if ((num_runs + 1) * (sizeof(int) + sizeof(size_t)) >
+                    (row_idx + 1) * sizeof(int)) {
+                return false;
+            }
+            if (num_runs == compressed->capacity) {
+                size_t capacity = compressed->capacity * 2;
+                int* run_values = realloc(compressed->run_values, sizeof(int) * capacity);
+                if (run_values == NULL) {
+                    return false;
+                }
+                compressed->run_values = run_values;
+                size_t* run_ends = realloc(compressed->run_ends, sizeof(size_t) * capacity);
+                if (run_ends == NULL) {
+                    return false;
+                }
+                compressed->run_ends = run_ends;
+                compressed->capacity = capacity;
+            }
+            compressed->run_values[num_runs] = value;
+            compressed->run_ends[num_runs] = row_idx + 1;
+            compressed->num_runs++;
+        }
+    } else {
+        uint32_t code;
+        if (compressed->encoding == ENCODING_FOR) {
+            long offset = (long) value - (long) compressed->base;
+            if (offset < 0 || offset >= (1L << compressed->bit_width)) {
+                return false;
+            }
+            code = (uint32_t) offset;
+        } else {
+            size_t dict_idx = dict_lower_bound(compressed->dictionary,
+                                               compressed->dict_size, value);
+            if (dict_idx == compressed->dict_size ||
+                    compressed->dictionary[dict_idx] != value) {
+                return false;
+            }
+            code = (uint32_t) dict_idx;
+        }
+        if (row_idx == compressed->capacity) {
+            size_t num_words = PACKED_WORDS(compressed->capacity, compressed->bit_width);
+            size_t capacity = compressed->capacity * 2;
+            size_t new_words = PACKED_WORDS(capacity, compressed->bit_width);
+            uint64_t* packed = realloc(compressed->packed, sizeof(uint64_t) * new_words);
+            if (packed == NULL) {
+                return false;
+            }
+            memset(&packed[num_words], 0, sizeof(uint64_t) * (new_words - num_words));
+            compressed->packed = packed;
+            compressed->capacity = capacity;
+        }
+        pack_code(compressed->packed, compressed->bit_width, row_idx, code);
+    }
+    compressed->num_rows++;
+    compressed->min_value = MIN(compressed->min_value, value);
+    compressed->max_value = MAX(compressed->max_value, value);
+    return true;
+}
+
+/**
+ * @brief This function returns the raw data of a column, decompressing it
+ *  first if it is compressed. Everything that writes to a column (other
+ *  than an append that fits the encoding) or needs the raw array goes
+ *  through this.
+ *
+ * @param col
+ *
+ * @return the data array (room for table_length values)
+ */
+int* column_data(Column* col) {
+    CompressedColumn* compressed = col->compressed;
+    if (compressed == NULL) {
+        return col->data;
+    }
+    int* data = malloc(sizeof(int) * MAX(col->table->table_length, compressed->num_rows));
+    if (data == NULL) {
+        return NULL;
+    }
+    decompress_range(compressed, 0, compressed->num_rows, data);
+    free_compressed_column(compressed);
+    col->compressed = NULL;
+    col->data = data;
+    return data;
+}
+
+/**
+ * @brief This function frees a compressed column
+ *
+ * @param compressed
+ */
+void free_compressed_column(CompressedColumn* compressed) {
+    if (compressed == NULL) {
+        return;
+    }
+    free(compressed->packed);
+    free(compressed->dictionary);
+    free(compressed->run_values);
+    free(compressed->run_ends);
+    free(compressed);
+}
+
+/**
+ * @brief This function returns the bytes used by the encoded values
+ *
+ * @param compressed
+ *
+ * @return size in bytes
+ */
+size_t compressed_size(const CompressedColumn* compressed) {
+    switch (compressed->encoding) {
+        case ENCODING_FOR:
+            return PACKED_WORDS(compressed->num_rows, compressed->bit_width) *
+                sizeof(uint64_t);
+        case ENCODING_DICT:
+            return PACKED_WORDS(compressed->num_rows, compressed->bit_width) *
+                sizeof(uint64_t) + compressed->dict_size * sizeof(int);
+        case ENCODING_RLE:
+        default:
+            return compressed->num_runs * (sizeof(int) + sizeof(size_t));
+    }
+}
+
+/**
+ * @brief This function decodes a range of rows
+ *
+ * @param compressed
+ * @param start - first row
+ * @param count - number of rows
+ * @param values - output
+ */
+void decompress_range(
+    const CompressedColumn* compressed,
+    size_t start,
+    size_t count,
+    int* values
+) {
+    if (compressed->encoding == ENCODING_RLE) {
+        size_t run_idx = find_run(compressed, start, 0);
+        size_t row_idx = start;
+        while (row_idx < start + count) {
+            size_t run_end = MIN(compressed->run_ends[run_idx], start + count);
+            int value = compressed->run_values[run_idx++];
+            while (row_idx < run_end) {
+                values[row_idx++ - start] = value;
+            }
+        }
+        return;
+    }
+    uint32_t codes[UNPACK_BLOCK_SZ];
+    for (size_t done = 0; done < count; done += UNPACK_BLOCK_SZ) {
+        size_t block_sz = MIN(UNPACK_BLOCK_SZ, count - done);
+        unpack_block(compressed, start + done, block_sz, codes);
+        if (compressed->encoding == ENCODING_FOR) {
+            for (size_t i = 0; i < block_sz; i++) {
+                values[done + i] = compressed->base + (int) codes[i];
+            }
+        } else {
+            for (size_t i = 0; i < block_sz; i++) {
+                values[done + i] = compressed->dictionary[codes[i]];
+            }
+        }
+    }
+}
+
+/// ***************************************************************************
+/// Operations on Compressed Columns
+/// ***************************************************************************
+
+/**
+ * @brief This function selects a range out of a compressed column. For FOR
+ *  and dictionary columns the bounds become a code range (both encodings
+ *  keep the order of the values), so the codes are compared directly one
+ *  cache sized block at a time. Zones that the zone map rules out (or in)
+ *  are never unpacked.
+ *
+ * @param compressed
+ * @param zone_map - the column's zone map (can be NULL)
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param positions - output (room for every row)
+ *
+ * @return number of matches
+ */
+size_t compressed_select(
+    const CompressedColumn* compressed,
+    const ZoneMap* zone_map,
+    int low,
+    int high,
+    pos_t* positions
+) {
+    size_t num_rows = compressed->num_rows;
+    size_t num_found = 0;
+    if (low >= high || high <= compressed->min_value || low > compressed->max_value) {
+        return 0;
+    }
+
+    if (compressed->encoding == ENCODING_RLE) {
+        size_t run_start = 0;
+        for (size_t run_idx = 0; run_idx < compressed->num_runs; run_idx++) {
+            int value = compressed->run_values[run_idx];
+            size_t run_end = compressed->run_ends[run_idx];
+            if (value >= low && value < high) {
+                while (run_start < run_end) {
+                    positions[num_found++] = run_start++;
+                }
+            }
+            run_start = run_end;
+        }
+        return num_found;
+    }
+
+    // translate the bounds into codes
+    uint64_t low_code, high_code;
+    if (compressed->encoding == ENCODING_FOR) {
+        long max_code = 1L << compressed->bit_width;
+        low_code = MIN(MAX((long) low - compressed->base, 0L), max_code);
+        high_code = MIN(MAX((long) high - compressed->base, 0L), max_code);
+    } else {
+        low_code = dict_lower_bound(compressed->dictionary, compressed->dict_size, low);
+        high_code = dict_lower_bound(compressed->dictionary, compressed->dict_size, high);
+    }
+    if (high_code <= low_code) {
+        return 0;
+    }
+    uint64_t code_span = high_code - low_code;
+
+    uint32_t codes[UNPACK_BLOCK_SZ];
+    for (size_t zone_idx = 0; zone_idx < NUM_ZONES(num_rows); zone_idx++) {
+        size_t zone_start = zone_idx * ZONE_SZ;
+        size_t zone_end = MIN(zone_start + ZONE_SZ, num_rows);
+        ZoneCheck check = ZONE_SOME;
+        if (zone_map != NULL && zone_idx < zone_map->num_clean) {
+            check = zone_map_check(zone_map, zone_idx, low, high);
+        }
+        if (check == ZONE_NONE) {
+            continue;
+        } else if (check == ZONE_ALL) {
+            for (size_t row_idx = zone_start; row_idx < zone_end; row_idx++) {
+                positions[num_found++] = row_idx;
+            }
+            continue;
+        }
+        for (size_t start = zone_start; start < zone_end; start += UNPACK_BLOCK_SZ) {
+            size_t block_sz = MIN(UNPACK_BLOCK_SZ, zone_end - start);
+            unpack_block(compressed, start, block_sz, codes);
+            for (size_t i = 0; i < block_sz; i++) {
+                positions[num_found] = start + i;
+                num_found += ((uint64_t) codes[i] - low_code) < code_span;
+            }
+        }
+    }
+    return num_found;
+}
+
+/**
+ * @brief This function decodes the values at a list of positions
+ *
+ * @param compressed
+ * @param positions
+ * @param num_positions
+ * @param values - output
+ */
+void compressed_fetch(
+    const CompressedColumn* compressed,
+    const pos_t* positions,
+    size_t num_positions,
+    int* values
+) {
+    size_t run_idx = 0;
+    for (size_t i = 0; i < num_positions; i++) {
+        values[i] = value_at(compressed, positions[i], &run_idx);
+    }
+}
+
+/**
+ * @brief This function decodes the values of the set bits of a bitmap
+ *
+ * @param compressed
+ * @param bitmap
+ * @param num_bits - the number of rows the bitmap covers
+ * @param values - output
+ */
+void compressed_fetch_bitmap(
+    const CompressedColumn* compressed,
+    const uint32_t* bitmap,
+    size_t num_bits,
+    int* values
+) {
+    size_t run_idx = 0;
+    size_t i = 0;
+    for (size_t word_idx = 0; word_idx < (num_bits + BIT_SZ - 1) / BIT_SZ; word_idx++) {
+        uint32_t word = bitmap[word_idx];
+        while (word) {
+            size_t row_idx = word_idx * BIT_SZ + __builtin_ctz(word);
+            values[i++] = value_at(compressed, row_idx, &run_idx);
+            word &= word - 1;
+        }
+    }
+}
+
+/**
+ * @brief This function sums a compressed column. FOR columns only add up
+ *  the codes and RLE columns multiply every run out.
+ *
+ * @param compressed
+ *
+ * @return the sum
+ */
+long compressed_sum(const CompressedColumn* compressed) {
+    long sum = 0;
+    if (compressed->encoding == ENCODING_RLE) {
+        size_t run_start = 0;
+        for (size_t run_idx = 0; run_idx < compressed->num_runs; run_idx++) {
+            size_t run_end = compressed->run_ends[run_idx];
+            sum += (long) compressed->run_values[run_idx] * (long) (run_end - run_start);
+            run_start = run_end;
+        }
+        return sum;
+    }
+    uint32_t codes[UNPACK_BLOCK_SZ];
+    for (size_t start = 0; start < compressed->num_rows; start += UNPACK_BLOCK_SZ) {
+        size_t block_sz = MIN(UNPACK_BLOCK_SZ, compressed->num_rows - start);
+        unpack_block(compressed, start, block_sz, codes);
+        if (compressed->encoding == ENCODING_FOR) {
+            for (size_t i = 0; i < block_sz; i++) {
+                sum += codes[i];
+            }
+        } else {
+            for (size_t i = 0; i < block_sz; i++) {
+                sum += compressed->dictionary[codes[i]];
+            }
+        }
+    }
+    if (compressed->encoding == ENCODING_FOR) {
+        sum += (long) compressed->base * (long) compressed->num_rows;
+    }
+    return sum;
+}
@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "db_crack.h"
+#include "utils.h"
+
+/// ***************************************************************************
+/// Helper Functions
+/// ***************************************************************************
+
+/**
+ * @brief Comparison function for sorting positions
+ */
+static int compare_positions(const void* a, const void* b) {
+    pos_t pos_a = *(const pos_t*) a;
+    pos_t pos_b = *(const pos_t*) b;
+    return (pos_a > pos_b) - (pos_a < pos_b);
+}
+
+/**
+ * @brief This function finds the number of pivots that are less than a value
+ *  (or less or equal if inclusive is set)
+ *
+ * @param index
+ * @param value
+ * @param inclusive
+ *
+ * @return index of the first pivot that is greater (or equal) to the value
+ */
+static size_t find_pivot(CrackerIndex* index, int value, bool inclusive) {
+    size_t low = 0;
+    size_t high = index->num_pivots;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (index->pivots[mid] < value ||
+            (inclusive && index->pivots[mid] == value)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief This function swaps two entries of the cracker column
+ */
+static inline void swap_entries(CrackerIndex* index, size_t a, size_t b) {
+    int tmp_value = index->values[a];
+    index->values[a] = index->values[b];
+    index->values[b] = tmp_value;
+
+    pos_t tmp_pos = index->positions[a];
+    index->positions[a] = index->positions[b];
+    index->positions[b] = tmp_pos;
+}
+
+/**
+ * @brief This function cracks the piece that holds a value in two: all the
+ *  values less than the value end up before the returned offset. Entries
+ *  before from_offset are already known to be less than the value and are
+ *  left alone.
+ *
+ * @param index
+ * @param value - the crack value
+ * @param from_offset - where the partitioning can start
+ *
+ * @return the offset of the first value >= the crack value
+ */
+static size_t crack_in_two(CrackerIndex* index, int value, size_t from_offset) {
+    size_t pivot_idx = find_pivot(index, value, false);
+    if (pivot_idx < index->num_pivots && index->pivots[pivot_idx] == value) {
+        return index->pivot_offsets[pivot_idx];
+    }
+    size_t piece_start = pivot_idx > 0 ? index->pivot_offsets[pivot_idx - 1] : 0;
+    size_t piece_end = pivot_idx < index->num_pivots ?
+        index->pivot_offsets[pivot_idx] : index->num_items;
+
+    // partition the piece around the value
+    size_t lo = MAX(piece_start, from_offset);
+    size_t hi = piece_end;
+    while (lo < hi) {
+        if (index->values[lo] < value) {
+            lo++;
+        } else {
+            swap_entries(index, lo, --hi);
+        }
+    }
+
+    // tiny pieces are not worth a pivot, we just partition them again
+    if (piece_end - piece_start < CRACK_MIN_PIECE) {
+        return lo;
+    }
+    if (index->num_pivots == index->pivot_space) {
+        index->pivot_space = MAX(index->pivot_space * 2, 16);
+        index->pivots = realloc(index->pivots, sizeof(int) * index->pivot_space);
+        index->pivot_offsets = realloc(
+            index->pivot_offsets,
+            sizeof(size_t) * index->pivot_space
+        );
+    }
+    memmove(&index->pivots[pivot_idx + 1], &index->pivots[pivot_idx],
+            sizeof(int) * (index->num_pivots - pivot_idx));
+    memmove(&index->pivot_offsets[pivot_idx + 1], &index->pivot_offsets[pivot_idx],
+            sizeof(size_t) * (index->num_pivots - pivot_idx));
+    index->pivots[pivot_idx] = value;
+    index->pivot_offsets[pivot_idx] = lo;
+    index->num_pivots++;
+    return lo;
+}
+
+/**
+ * @brief This function moves a value into its piece. The first entry of
+ *  every later piece moves to the end of that piece so only one entry per
+ *  piece is touched (ripple insert).
+ *
+ * @param index
+ * @param value
+ * @param position - the base position of the value
+ */
+static void ripple_insert(CrackerIndex* index, int value, size_t position) {
+    if (index->num_items == index->allocated_space) {
+        index->allocated_space = MAX(index->allocated_space * 2, DEFAULT_COLUMN_SIZE);
+        index->values = realloc(index->values, sizeof(int) * index->allocated_space);
+        index->positions = realloc(
+            index->positions,
+            sizeof(pos_t) * index->allocated_space
+        );
+    }
+
+    // the value belongs at the end of the piece after the last pivot <= value
+    size_t pivot_idx = find_pivot(index, value, true);
+    size_t hole = index->num_items;
+    for (size_t k = index->num_pivots; k > pivot_idx; k--) {
+        size_t piece_start = index->pivot_offsets[k - 1];
+        index->values[hole] = index->values[piece_start];
+        index->positions[hole] = index->positions[piece_start];
+        hole = piece_start;
+        index->pivot_offsets[k - 1]++;
+    }
+    index->values[hole] = value;
+    index->positions[hole] = position;
+    index->num_items++;
+}
+
+/**
+ * @brief This function merges the pending inserts that fall in a range
+ *  into the cracker column
+ *
+ * @param index
+ * @param low - inclusive
+ * @param high - exclusive
+ */
+static void merge_pending(CrackerIndex* index, int low, int high) {
+    size_t i = 0;
+    while (i < index->num_pending) {
+        int value = index->pending_values[i];
+        if (value >= low && value < high) {
+            ripple_insert(index, value, index->pending_positions[i]);
+            // the order of the pending values doesn't matter
+            index->num_pending--;
+            index->pending_values[i] = index->pending_values[index->num_pending];
+            index->pending_positions[i] = index->pending_positions[index->num_pending];
+        } else {
+            i++;
+        }
+    }
+}
+
+/// ***************************************************************************
+/// Cracker Index Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function creates the cracker index of a column - the cracker
+ *  column starts out as a copy of the data with no pivots
+ *
+ * @param data - the column data
+ * @param num_rows - number of values in the column
+ *
+ * @return the cracker index
+ */
+CrackerIndex* create_cracker_index(int* data, size_t num_rows) {
+    CrackerIndex* index = malloc(sizeof(CrackerIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->num_items = num_rows;
+    index->allocated_space = MAX(num_rows, DEFAULT_COLUMN_SIZE);
+    index->values = malloc(sizeof(int) * index->allocated_space);
+    index->positions = malloc(sizeof(pos_t) * index->allocated_space);
+    if (index->values == NULL || index->positions == NULL) {
+        free(index->values);
+        free(index->positions);
+        free(index);
+        return NULL;
+    }
+    if (num_rows > 0) {
+        memcpy(index->values, data, sizeof(int) * num_rows);
+    }
+    for (size_t i = 0; i < num_rows; i++) {
+        index->positions[i] = i;
+    }
+
+    index->pivots = NULL;
+    index->pivot_offsets = NULL;
+    index->num_pivots = 0;
+    index->pivot_space = 0;
+
+    index->pending_values = NULL;
+    index->pending_positions = NULL;
+    index->num_pending = 0;
+    index->pending_space = 0;
+    return index;
+}
+
+/**
+ * @brief This function frees a cracker index
+ *
+ * @param index
+ */
+void free_cracker_index(CrackerIndex* index) {
+    if (index == NULL) {
+        return;
+    }
+    free(index->values);
+    free(index->positions);
+    free(index->pivots);
+    free(index->pivot_offsets);
+    free(index->pending_values);
+    free(index->pending_positions);
+    free(index);
+}
+
+/**
+ * @brief This function selects a range from a cracked column. The pieces
+ *  that hold the bounds are cracked so that the qualifying values end up
+ *  next to each other, which makes later queries on nearby ranges cheaper.
+ *  The positions are returned in column order (like a scan).
+ *
+ * @param index
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param result - the result (positions)
+ */
+void crack_select(CrackerIndex* index, int low, int high, Result* result) {
+    result->data_type = INDEX;
+    result->num_tuples = 0;
+    result->capacity = 0;
+    result->payload = NULL;
+    if (low >= high) {
+        return;
+    }
+
+    // only the pending inserts that this query can see get merged
+    merge_pending(index, low, high);
+
+    size_t low_offset = crack_in_two(index, low, 0);
+    size_t high_offset = crack_in_two(index, high, low_offset);
+    if (high_offset <= low_offset) {
+        return;
+    }
+
+    size_t num_found = high_offset - low_offset;
+    pos_t* positions = malloc(sizeof(pos_t) * num_found);
+    memcpy(positions, &index->positions[low_offset], sizeof(pos_t) * num_found);
+    qsort(positions, num_found, sizeof(pos_t), compare_positions);
+    result->num_tuples = result->capacity = num_found;
+    result->payload = positions;
+}
+
+/**
+ * @brief This function adds a value to the cracked column. It is only
+ *  moved into the pieces once a select needs it.
+ *
+ * @param index
+ * @param value
+ * @param row_idx - the base position of the value
+ */
+void cracker_insert(CrackerIndex* index, int value, size_t row_idx) {
+    if (index->num_pending == index->pending_space) {
+        index->pending_space = MAX(index->pending_space * 2, 16);
+        index->pending_values = realloc(
+            index->pending_values,
+            sizeof(int) * index->pending_space
+        );
+        index->pending_positions = realloc(
+            index->pending_positions,
+            sizeof(pos_t) * index->pending_space
+        );
+    }
+    index->pending_values[index->num_pending] = value;
+    index->pending_positions[index->num_pending] = row_idx;
+    index->num_pending++;
+}
+
+/**
+ * @brief This function moves every base position at or after row_idx up by
+ *  one (used when an insert into a clustered table shifts the rows)
+ *
+ * @param index
+ * @param row_idx - the row that was opened up
+ */
+void cracker_shift_positions(CrackerIndex* index, size_t row_idx) {
+    for (size_t i = 0; i < index->num_items; i++) {
+        index->positions[i] += index->positions[i] >= row_idx;
+    }
+    for (size_t i = 0; i < index->num_pending; i++) {
+        index->pending_positions[i] += index->pending_positions[i] >= row_idx;
+    }
+}
+
+/// ***************************************************************************
+/// Cracker Persistence Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function writes a cracker index to a file - the cracker
+ *  column, then the pivots and then the pending inserts
+ *
+ * @param index
+ * @param index_file
+ */
+void dump_cracker_index(CrackerIndex* index, FILE* index_file) {
+    fwrite(&index->num_items, sizeof(size_t), 1, index_file);
+    fwrite(index->values, sizeof(int), index->num_items, index_file);
+    fwrite(index->positions, sizeof(pos_t), index->num_items, index_file);
+
+    fwrite(&index->num_pivots, sizeof(size_t), 1, index_file);
+    fwrite(index->pivots, sizeof(int), index->num_pivots, index_file);
+    fwrite(index->pivot_offsets, sizeof(size_t), index->num_pivots, index_file);
+
+    fwrite(&index->num_pending, sizeof(size_t), 1, index_file);
+    fwrite(index->pending_values, sizeof(int), index->num_pending, index_file);
+    fwrite(index->pending_positions, sizeof(pos_t), index->num_pending, index_file);
+}
+
+/**
+ * @brief This function reads a cracker index written by dump_cracker_index
+ *
+ * @param index_file
+ *
+ * @return the index (NULL if the file is incomplete)
+ */
+CrackerIndex* load_cracker_index(FILE* index_file) {
+    size_t num_items = 0;
+    if (fread(&num_items, sizeof(size_t), 1, index_file) != 1) {
+        return NULL;
+    }
+    CrackerIndex* index = create_cracker_index(NULL, 0);
+    if (index == NULL) {
+        return NULL;
+    }
+    bool ok = true;
+    if (num_items > index->allocated_space) {
+        index->allocated_space = num_items;
+        index->values = realloc(index->values, sizeof(int) * num_items);
+        index->positions = realloc(index->positions, sizeof(pos_t) * num_items);
+    }
+    index->num_items = num_items;
+    ok = ok && fread(index->values, sizeof(int), num_items, index_file) == num_items;
+    ok = ok && fread(index->positions, sizeof(pos_t), num_items, index_file) == num_items;
+
+    ok = ok && fread(&index->num_pivots, sizeof(size_t), 1, index_file) == 1;
+    if (ok && index->num_pivots > 0) {
+        index->pivot_space = index->num_pivots;
+        index->pivots = malloc(sizeof(int) * index->pivot_space);
+        index->pivot_offsets = malloc(sizeof(size_t) * index->pivot_space);
+        ok = fread(index->pivots, sizeof(int), index->num_pivots, index_file)
+                == index->num_pivots &&
+             fread(index->pivot_offsets, sizeof(size_t), index->num_pivots, index_file)
+                == index->num_pivots;
+    }
+
+    ok = ok && fread(&index->num_pending, sizeof(size_t), 1, index_file) == 1;
+    if (ok && index->num_pending > 0) {
+        index->pending_space = index->num_pending;
+        index->pending_values = malloc(sizeof(int) * index->pending_space);
+        index->pending_positions = malloc(sizeof(pos_t) * index->pending_space);
+        ok = fread(index->pending_values, sizeof(int), index->num_pending, index_file)
+                == index->num_pending &&
+             fread(index->pending_positions, sizeof(pos_t), index->num_pending, index_file)
+                == index->num_pending;
+    }
+
+    if (!ok) {
+        free_cracker_index(index);
+        return NULL;
+    }
+    return index;
+}
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <assert.h>
 #include "db_index.h"
+#include "utils.h"
 
 /// ***************************************************************************
 /// Sorted Index Functions
@@ -37,7 +38,7 @@ SortedIndex* create_unclustered_sorted_index(size_t alloc_space) {
     sorted_index->allocated_space = alloc_space;
     sorted_index->keys = malloc(sizeof(int) * sorted_index->allocated_space);
     sorted_index->col_positions = malloc(
-            sizeof(size_t) * sorted_index->allocated_space
+            sizeof(pos_t) * sorted_index->allocated_space
     );
     return sorted_index;
 }
@@ -65,7 +66,7 @@ void increase_sorted_index(SortedIndex* sorted_index) {
         if (sorted_index->has_positions) {
             sorted_index->col_positions = realloc(
                 sorted_index->col_positions,
-                sizeof(size_t) * sorted_index->allocated_space
+                sizeof(pos_t) * sorted_index->allocated_space
             );
         }
     }
@@ -131,10 +132,6 @@ size_t sorted_node_binary_search(
    return 0;
 }
 
-// helper min and max functions
-#define MIN(a,b) (((a)<(b))?(a):(b))
-#define MAX(a,b) (((a)>(b))?(a):(b))
-
 /**
  * @brief Cache concious binary search - it looks only at the values that would
  *  fit within a page
@@ -239,19 +236,22 @@ void get_range_sorted(SortedIndex* sorted_index, int low, int high, Result* resu
         return;
     }
 
+    // a clustered column is in key order so the positions are just the
+    // range - nothing has to be written out
+    if (!sorted_index->has_positions) {
+        result->payload = NULL;
+        result->capacity = 0;
+        result->is_contiguous = true;
+        result->first_row = low_bound;
+        return;
+    }
+
     // allocate space for the result
     // then we can just memcopy into the array!
-    result->payload = malloc(sizeof(size_t) * result->capacity);
-    if (sorted_index->has_positions) {
-        memcpy(result->payload,
-               (void*) &sorted_index->col_positions[low_bound],
-               (high_bound - low_bound) * sizeof(size_t));
-    } else {
-        size_t i = 0;
-        while (low_bound < high_bound) {
-            ((size_t*) result->payload)[i++] = low_bound++;
-        }
-    }
+    result->payload = malloc(sizeof(pos_t) * result->capacity);
+    memcpy(result->payload,
+           (void*) &sorted_index->col_positions[low_bound],
+           (high_bound - low_bound) * sizeof(pos_t));
     return;
 }
 
@@ -291,7 +291,7 @@ void insert_into_sorted(SortedIndex* sorted_index, int value, size_t position) {
                 (sorted_index->num_items - idx - 1) * sizeof(int));
         memmove((void*) &sorted_index->col_positions[idx + 1],
                 (void*) &sorted_index->col_positions[idx],
-                (sorted_index->num_items - idx - 1) * sizeof(size_t));
+                (sorted_index->num_items - idx - 1) * sizeof(pos_t));
     }
     sorted_index->col_positions[idx] = position;
     sorted_index->keys[idx] = value;
@@ -309,7 +309,7 @@ void print_sorted_index(SortedIndex* sorted_index) {
             printf(
                 "%d, %zu\n",
                 sorted_index->keys[i],
-                sorted_index->col_positions[i]
+                (size_t) sorted_index->col_positions[i]
             );
         } else {
             printf("%d\n", sorted_index->keys[i]);
@@ -387,26 +387,24 @@ void free_stack(BPTNodeStack* stack) {
  * @return allocated node
  */
 BPTNode* allocate_node(bool leaf) {
-    BPTNode* new_node = calloc(1, sizeof(BPTNode));
+    // each kind of node has its own layout (both are calloced so a leaf's
+    // sibling pointers start out NULL)
+    BPTNode* new_node = calloc(1, leaf ? sizeof(BPTLeaf) : sizeof(BPTInner));
     new_node->num_elements = 0;
     new_node->is_leaf = leaf;
-    if (new_node->is_leaf) {
-        new_node->bpt_meta.bpt_leaf.next_leaf = NULL;
-        new_node->bpt_meta.bpt_leaf.prev_leaf = NULL;
-    }
     return new_node;
 }
 
 // Make a node
-BPTNode* create_node() {
-    BPTNode* node = allocate_node(false);
-    node->bpt_meta.bpt_ptrs.level = (unsigned) -1;
+BPTInner* create_node() {
+    BPTInner* node = BPT_INNER(allocate_node(false));
+    node->level = (unsigned) -1;
     return node;
 }
 
 // Make a leaf
-BPTNode* create_leaf() {
-    return allocate_node(true);
+BPTLeaf* create_leaf() {
+    return BPT_LEAF(allocate_node(true));
 }
 
 
@@ -422,9 +420,9 @@ BPTNode* create_leaf() {
  *
  * @return bool whether they are ancestors
  */
-bool is_child(BPTNode* parent, BPTNode* child) {
-    for (size_t i = 0; i < parent->num_elements; i++) {
-        if (parent->bpt_meta.bpt_ptrs.children[i] == child) {
+bool is_child(BPTInner* parent, BPTNode* child) {
+    for (size_t i = 0; i < parent->node.num_elements; i++) {
+        if (parent->children[i] == child) {
             return true;
         }
     }
@@ -444,7 +442,7 @@ unsigned current_level = 0;
 void print_node(BPTNode* node) {
     printf("[ ");
     if (node->is_leaf == false){
-        printf("(LEVEL %u) ", node->bpt_meta.bpt_ptrs.level);
+        printf("(LEVEL %u) ", BPT_INNER(node)->level);
     } else {
         printf("\n(LEAF %zu) ", leafcount++);
     }
@@ -453,11 +451,11 @@ void print_node(BPTNode* node) {
         if (node->is_leaf) {
             printf(
                 "\n\t{%d, %zu}",
-                node->node_vals[i],
-                node->bpt_meta.bpt_leaf.col_pos[i]
+                BPT_LEAF(node)->node_vals[i],
+                (size_t) BPT_LEAF(node)->col_pos[i]
             );
         } else {
-            printf("%d ", node->node_vals[i]);
+            printf("%d ", BPT_INNER(node)->node_vals[i]);
         }
     }
     printf("]");
@@ -470,15 +468,15 @@ void print_node(BPTNode* node) {
  * @brief Function that prints out a leaf node.
  *  prints [ (key, data), (key, data) ]
  *
- * @param node - node to print
+ * @param leaf - leaf to print
  */
-void print_leaf(BPTNode* node) {
+void print_leaf(BPTLeaf* leaf) {
     printf("[ ");
-    for (size_t i = 0; i < node->num_elements; i++) {
+    for (size_t i = 0; i < leaf->node.num_elements; i++) {
         printf(
             "(%d, %zu) ",
-            node->node_vals[i],
-            node->bpt_meta.bpt_leaf.col_pos[i]
+            leaf->node_vals[i],
+            (size_t) leaf->col_pos[i]
         );
     }
     printf("]\n");
@@ -524,7 +522,7 @@ void bfs_traverse_tree(BPTNode* node, BTreeTraversalOp tree_op, FILE* dumpfile)
             // copy to the end of the array
             memcpy(
                 (void*) &all_nodes[num_nodes],
-                (void*) current_node->bpt_meta.bpt_ptrs.children,
+                (void*) BPT_INNER(current_node)->children,
                 sizeof(BPTNode*) * to_add
             );
             // increase number of nodes
@@ -538,7 +536,9 @@ void bfs_traverse_tree(BPTNode* node, BTreeTraversalOp tree_op, FILE* dumpfile)
                 free(current_node);
                 break;
             case DUMP_NODE:
-                fwrite(current_node, sizeof(BPTNode), 1, dumpfile);
+                fwrite(current_node,
+                       current_node->is_leaf ? sizeof(BPTLeaf) : sizeof(BPTInner),
+                       1, dumpfile);
                 break;
         }
         node_idx++;
@@ -572,16 +572,16 @@ void dump_tree(BPTNode* node, char* fname) {
  * @param data - the data
  * @param num_items - number of items
  */
-void insert_into_results(Result* result, size_t* data, size_t num_items) {
+void insert_into_results(Result* result, pos_t* data, size_t num_items) {
     // we want to copy into the result column
     if (result->num_tuples + num_items > result->capacity) {
         result->capacity = result->num_tuples + num_items;
         result->capacity *= 2;
-        result->payload = realloc(result->payload, sizeof(size_t) * result->capacity);
+        result->payload = realloc(result->payload, sizeof(pos_t) * result->capacity);
     }
     // where to start the copying
-    void* start = (size_t*) result->payload + result->num_tuples;
-    memcpy(start, data, num_items * sizeof(size_t));
+    void* start = (pos_t*) result->payload + result->num_tuples;
+    memcpy(start, data, num_items * sizeof(pos_t));
     result->num_tuples += num_items;
 }
 
@@ -593,11 +593,12 @@ void insert_into_results(Result* result, size_t* data, size_t num_items) {
  *
  * @return the right most node that contains the value
  */
-BPTNode* search_for_leaf(BPTNode* bt_node, int value) {
+BPTLeaf* search_for_leaf(BPTNode* bt_node, int value) {
     while (bt_node->is_leaf == false) {
+        BPTInner* inner = BPT_INNER(bt_node);
         size_t i = 0;
         while (i < bt_node->num_elements) {
-            if (value < bt_node->node_vals[i]) {
+            if (value < inner->node_vals[i]) {
                 break;
             } else {
                 i++;
@@ -605,14 +606,44 @@ BPTNode* search_for_leaf(BPTNode* bt_node, int value) {
         }
         // once we have found a child, push to the access stack
         // and move to checkout the child
-        bt_node = bt_node->bpt_meta.bpt_ptrs.children[i];
+        bt_node = inner->children[i];
     }
     // the last item in the stack will be the leaf
     assert(bt_node->is_leaf == true);
-    return bt_node;
+    return BPT_LEAF(bt_node);
 }
 
 
+/**
+ * @brief This function finds the first entry of the tree that is >= value
+ *
+ * @param root - the bplus tree root to search from
+ * @param value - the value to search for
+ * @param leaf_idx - the index of the entry in its leaf (output)
+ *
+ * @return the leaf of the entry (NULL if every entry is < value)
+ */
+BPTLeaf* search_lower_bound(BPTNode* root, int value, size_t* leaf_idx) {
+    BPTLeaf* leaf = search_for_leaf(root, value);
+    // equal keys can spill into the leaves before the one the search ends
+    // in (ie: [0, 3, 3] <--> [3, 4, 5])
+    while (leaf->prev_leaf != NULL &&
+           leaf->prev_leaf->node_vals[leaf->prev_leaf->node.num_elements - 1] >= value) {
+        leaf = leaf->prev_leaf;
+    }
+    size_t idx = 0;
+    while (idx < leaf->node.num_elements && leaf->node_vals[idx] < value) {
+        idx++;
+    }
+    // everything in the leaf is smaller so it is the first entry of the next
+    if (idx == leaf->node.num_elements) {
+        leaf = leaf->next_leaf;
+        idx = 0;
+    }
+    *leaf_idx = idx;
+    return leaf;
+}
+
 /**
  * @brief This function finds the clustered column value's insertion point
  *
@@ -622,27 +653,12 @@ BPTNode* search_for_leaf(BPTNode* bt_node, int value) {
  * @return - this is the place where we will insert
  */
 size_t btree_find_insert_position(BPTNode* root, int value) {
-    BPTNode* containing_leaf = search_for_leaf(root, value);
-    // we get a leaf
-    //  3 cases - the leaf is too big - this
-    // check backwards to see if that leaf could contain this value
-    while (containing_leaf->node_vals[0] > value) {
-        BPTNode* prev = containing_leaf->bpt_meta.bpt_leaf.prev_leaf;
-        assert(prev != NULL);  // we should never go to far back
-        if (prev->node_vals[prev->num_elements - 1] >= value) {
-            // the previous node is gte the current, so we need to shift back
-            containing_leaf = prev;
-        } else {
-            break;
-        }
-    }
+    // the value goes in front of the first larger key (values that are >=
+    // the last key are appended by the caller so value + 1 can't overflow)
     size_t insert_idx = 0;
-    // while the value at this index
-    while (containing_leaf->node_vals[insert_idx] > value) {
-        insert_idx++;
-    }
-    assert(insert_idx < containing_leaf->num_elements);
-    return containing_leaf->bpt_meta.bpt_leaf.col_pos[insert_idx];
+    BPTLeaf* containing_leaf = search_lower_bound(root, value + 1, &insert_idx);
+    assert(containing_leaf != NULL);
+    return containing_leaf->col_pos[insert_idx];
 }
 
 /**
@@ -658,97 +674,32 @@ size_t btree_find_insert_position(BPTNode* root, int value) {
  */
 void find_values_unclustered(BPTNode* root, int gte_val, int lt_val, Result* result) {
     result->data_type = INDEX;
-    result->capacity = MAX_KEYS;
+    result->capacity = MAX_LEAF_KEYS;
     result->num_tuples = 0;
-    result->payload = malloc(sizeof(size_t) * result->capacity);
-
-    // if the high bound is the rightmost leaf and nothing satisfies it
-    // then we know that there is no match
-    BPTNode* high_bound = search_for_leaf(root, lt_val);
-    if (high_bound->node_vals[0] < gte_val &&
-            high_bound->bpt_meta.bpt_leaf.prev_leaf == NULL) {
-        return;
-    }
+    result->payload = malloc(sizeof(pos_t) * result->capacity);
 
-    // if the low bound is the rightmost leaf and it doesn't fit
-    // in the range then we know that we have no data the satisfies
-    BPTNode* low_bound = search_for_leaf(root, gte_val);
-    if (low_bound->node_vals[low_bound->num_elements - 1] < lt_val &&
-            low_bound->bpt_meta.bpt_leaf.next_leaf == NULL) {
-        return;
-    }
-
-    // Next we need to adjust the low bound. We want the low bound to be
-    // the lowest leaf that does contain a value that satisfies the
-    // predicate - we know know to look backwards if the current "low_bound"
-    // has a value that meets this condition (if the low_bound has
-    // a leaf that is greater than or equal)
-    while (low_bound->node_vals[0] >= gte_val) {
-        // get the previous leaf
-        BPTNode* prev = low_bound->bpt_meta.bpt_leaf.prev_leaf;
-        // check backwards to see if that leaf could contain this value
-        // (by checking the max ie: [0, 3, 3] <--> [3, 4, 5]
-        if (prev && prev->node_vals[prev->num_elements - 1] >= gte_val) {
-            // the previous node is gte the current, so we need to shift back
-            low_bound = prev;
-        } else {
-            break;
+    // start at the first value that meets the condition and copy each
+    // leaf's swath of matching positions until a value is past the range
+    size_t low_idx = 0;
+    BPTLeaf* leaf = search_lower_bound(root, gte_val, &low_idx);
+    while (leaf != NULL) {
+        size_t high_idx = low_idx;
+        while (high_idx < leaf->node.num_elements &&
+                leaf->node_vals[high_idx] < lt_val) {
+            high_idx++;
         }
-    }
-
-    // we should never need to push this forward
-    // if the high bound starts will a value that should not be included we
-    // need to shift back a node!
-    while (high_bound->node_vals[0] >= lt_val) {
-        BPTNode* prev = high_bound->bpt_meta.bpt_leaf.prev_leaf;
-        if (prev) {
-            high_bound = prev;
-        } else {
-            break;
+        if (high_idx > low_idx) {
+            insert_into_results(result, &leaf->col_pos[low_idx], high_idx - low_idx);
         }
-    }
-
-    // find the first value that meets the condition
-    // if nothing fits, then we will have an index that equals the
-    // numbe of elements in the list
-    size_t low_idx = 0;
-    while (low_idx < low_bound->num_elements &&
-            low_bound->node_vals[low_idx] < gte_val) {
-        low_idx++;
-    }
-
-    // if the low bound doesn't equal the high bound then we will just
-    // jump to t
-    while (low_bound != high_bound) {
-        // if we have a situation where multiple leaves fit the bill
-        // copy from the matching value over
-        if (low_idx != low_bound->num_elements) {
-            insert_into_results(result,
-                                &low_bound->bpt_meta.bpt_leaf.col_pos[low_idx],
-                                low_bound->num_elements - low_idx);
+        if (high_idx < leaf->node.num_elements) {
+            break;
         }
-        // the next will have to be contained if it doesn't equal
-        // the high bound
-        low_bound = low_bound->bpt_meta.bpt_leaf.next_leaf;
+        leaf = leaf->next_leaf;
         low_idx = 0;
     }
-
-    // once they are equal we need to copy the correct swath -
-    // we only want up to the top bound (exclusive)
-    size_t high_idx = 0;
-    while (high_idx < high_bound->num_elements &&
-            high_bound->node_vals[high_idx] < lt_val) {
-        high_idx++;
-    }
-    // now insert!
-    if (high_idx - low_idx > 0) {
-        insert_into_results(result,
-                            &high_bound->bpt_meta.bpt_leaf.col_pos[low_idx],
-                            high_idx - low_idx);
-        if (result->capacity != result->num_tuples) {
-            result->payload = realloc(result->payload,
-                                      sizeof(size_t) * result->num_tuples);
-        }
+    if (result->num_tuples > 0 && result->capacity != result->num_tuples) {
+        result->payload = realloc(result->payload,
+                                  sizeof(pos_t) * result->num_tuples);
     }
     return;
 }
@@ -768,92 +719,37 @@ void find_values_clustered(BPTNode* root, int gte_val, int lt_val, Result* resul
     result->num_tuples = 0;
     result->payload = NULL;
 
-    // get right bound and check that it works
-    BPTNode* high_bound = search_for_leaf(root, lt_val);
-    if (high_bound->node_vals[0] < gte_val &&
-            high_bound->bpt_meta.bpt_leaf.prev_leaf == NULL) {
-        return;
-    }
-
-    // get left bound and check that it also works
-    BPTNode* low_bound = search_for_leaf(root, gte_val);
-    if (low_bound->node_vals[low_bound->num_elements - 1] < lt_val &&
-            low_bound->bpt_meta.bpt_leaf.next_leaf == NULL) {
-        return;
-    }
-
-    // next find the lowest low bound that satisfies the predicate
-    // (we need to do this check to make sure we don't miss out on the
-    //  far left values)
-    while (low_bound->node_vals[0] >= gte_val) {
-        // get the previous leaf
-        BPTNode* prev = low_bound->bpt_meta.bpt_leaf.prev_leaf;
-        // check backwards to see if that leaf could contain this value
-        // (by checking the max ie: [0, 3, 3] <--> [3, 4, 5]
-        if (prev && prev->node_vals[prev->num_elements - 1] >= gte_val) {
-            // the previous node is gte the current, so we need to shift back
-            low_bound = prev;
-        } else {
-            break;
-        }
-    }
-
-    // reign in the upper bound so we only go as far as the right most
-    while (high_bound->node_vals[0] >= lt_val) {
-        BPTNode* prev = high_bound->bpt_meta.bpt_leaf.prev_leaf;
-        if (prev) {
-            high_bound = prev;
-        } else {
-            break;
-        }
-    }
-
-    // find the first value that meets the condition -
-    // we then want to store this index as the start of the
-    // range of indices that we will be getting
+    // the first value that meets the condition starts the range
     size_t low_idx = 0;
-    while (low_idx < low_bound->num_elements &&
-            low_bound->node_vals[low_idx] < gte_val) {
-        low_idx++;
-        if (low_idx == low_bound->num_elements) {
-            // TODO: Warning there could be problems from doing this
-            low_bound = low_bound->bpt_meta.bpt_leaf.next_leaf;
-            low_idx = 0;
-
-        }
+    BPTLeaf* low_bound = search_lower_bound(root, gte_val, &low_idx);
+    if (low_bound == NULL) {
+        return;
     }
-    // if the left bound doesn't have anything that matches then
-    // means that the low bound should equal the high bound
-    // we shouldn't have this case
-    assert(low_idx != low_bound->num_elements);
-
-    low_idx = low_bound->bpt_meta.bpt_leaf.col_pos[low_idx];
+    size_t first_row = low_bound->col_pos[low_idx];
 
-    // This is the high index. This is the last value that satisfies
-    // this condition
+    // and the first value past it ends it (or the end of the column if
+    // there is none - the last entry of the right most leaf)
     size_t high_idx = 0;
-    size_t plus_one = 0; // whether we need to include the upper bound
-    while (high_idx + 1 < high_bound->num_elements &&
-            high_bound->node_vals[high_idx] < lt_val) {
-        high_idx++;
-    }
-
-    // this is the high bound - we will add one more if the top of the bound
-    // should include this extra value
-    if (high_idx + 1 == high_bound->num_elements &&
-            high_bound->node_vals[high_idx] < lt_val) {
-        plus_one = 1;
+    BPTLeaf* high_bound = search_lower_bound(root, lt_val, &high_idx);
+    size_t end_row;
+    if (high_bound != NULL) {
+        end_row = high_bound->col_pos[high_idx];
+    } else {
+        BPTNode* bt_node = root;
+        while (bt_node->is_leaf == false) {
+            bt_node = BPT_INNER(bt_node)->children[bt_node->num_elements];
+        }
+        end_row = BPT_LEAF(bt_node)->col_pos[bt_node->num_elements - 1] + 1;
     }
-
-    // the new upper index
-    high_idx = high_bound->bpt_meta.bpt_leaf.col_pos[high_idx] + plus_one;
-    result->capacity = high_idx - low_idx;
-    result->num_tuples = result->capacity;
-    result->payload = malloc(sizeof(size_t) * result->capacity);
-    int i = 0;
-    while (low_idx < high_idx) {
-        ((size_t*)result->payload)[i++] = low_idx++;
+    if (end_row <= first_row) {
+        return;
     }
+    // the column is in key order so the result is just the range
+    result->num_tuples = end_row - first_row;
+    result->capacity = 0;
+    result->payload = NULL;
+    result->is_contiguous = true;
+    result->first_row = first_row;
     return;
 }
 
@@ -866,35 +762,35 @@ void find_values_clustered(BPTNode* root, int gte_val, int lt_val, Result* resul
  * @brief Function for adding (key,value) to a position (once we know that
  *      the leaf has space
  *
- * @param bt_node - node to add to - cannot be full
+ * @param leaf - leaf to add to - cannot be full
  * @param value - value to add
  * @param position - position to add
  */
-void insert_into_leaf(BPTNode* bt_node, int value, size_t position) {
+void insert_into_leaf(BPTLeaf* leaf, int value, size_t position) {
     // start at the first value
-    assert(bt_node->num_elements < MAX_KEYS);
+    assert(leaf->node.num_elements < MAX_LEAF_KEYS);
     size_t i = 0;
-    while (i < bt_node->num_elements) {
+    while (i < leaf->node.num_elements) {
         // if the key is larger or if they are equal and the position is
         // larger, shift right
-        if (bt_node->node_vals[i] > value || (
-                bt_node->node_vals[i] == value
-                && bt_node->bpt_meta.bpt_leaf.col_pos[i] > position)
+        if (leaf->node_vals[i] > value || (
+                leaf->node_vals[i] == value
+                && leaf->col_pos[i] > position)
         ) {
             // shift positions right
-            memmove((void*) &bt_node->node_vals[i + 1],
-                    (void*) &bt_node->node_vals[i],
-                    (bt_node->num_elements - i) * sizeof(int));
-            memmove((void*) &bt_node->bpt_meta.bpt_leaf.col_pos[i + 1],
-                    (void*) &bt_node->bpt_meta.bpt_leaf.col_pos[i],
-                    (bt_node->num_elements - i) * sizeof(size_t));
+            memmove((void*) &leaf->node_vals[i + 1],
+                    (void*) &leaf->node_vals[i],
+                    (leaf->node.num_elements - i) * sizeof(int));
+            memmove((void*) &leaf->col_pos[i + 1],
+                    (void*) &leaf->col_pos[i],
+                    (leaf->node.num_elements - i) * sizeof(pos_t));
             break;
         }
         i++;
     }
-    bt_node->node_vals[i] = value;
-    bt_node->bpt_meta.bpt_leaf.col_pos[i] = position;
-    bt_node->num_elements++;
+    leaf->node_vals[i] = value;
+    leaf->col_pos[i] = position;
+    leaf->node.num_elements++;
 }
 
 
@@ -903,40 +799,40 @@ void insert_into_leaf(BPTNode* bt_node, int value, size_t position) {
  *  returns a struct that contains the new left and right pointers
  *  as well as the median values that should be kicked up the tree
  *
- * @param bt_node - node to split
+ * @param leaf - leaf to split
  * @param value - new value being added
  * @param pos - the new position of the new value
  * @param result_node - the output node
  */
-void split_leaf(BPTNode* bt_node, int value, size_t pos, SplitNode* split_leaf) {
+void split_leaf(BPTLeaf* leaf, int value, size_t pos, SplitNode* split_leaf) {
     // simple checks
-    assert(bt_node->is_leaf == true);
-    assert(bt_node->num_elements == MAX_KEYS);
+    assert(leaf->node.is_leaf == true);
+    assert(leaf->node.num_elements == MAX_LEAF_KEYS);
 
     // this is the temp array
-    size_t temp_buf_len = MAX_KEYS + 1;
+    size_t temp_buf_len = MAX_LEAF_KEYS + 1;
     int values[temp_buf_len];
-    size_t positions[temp_buf_len];
+    pos_t positions[temp_buf_len];
 
     // set these to be equal
     memcpy((void*) values,
-            (void*)bt_node->node_vals,
-            MAX_KEYS * sizeof(int));
+            (void*) leaf->node_vals,
+            MAX_LEAF_KEYS * sizeof(int));
     memcpy((void*) positions,
-            (void*)bt_node->bpt_meta.bpt_leaf.col_pos,
-            MAX_KEYS * sizeof(size_t));
+            (void*) leaf->col_pos,
+            MAX_LEAF_KEYS * sizeof(pos_t));
 
     // this is the loop that handles the insertion
     size_t i = 0;
-    while (i < MAX_KEYS) {
+    while (i < MAX_LEAF_KEYS) {
         if (value < values[i] || (value == values[i] && pos < positions[i])) {
             // shift positions right
             memmove((void*) &values[i + 1],
                     (void*) &values[i],
-                    (MAX_KEYS - i) * sizeof(int));
+                    (MAX_LEAF_KEYS - i) * sizeof(int));
             memmove((void*) &positions[i + 1],
                     (void*) &positions[i],
-                    (MAX_KEYS - i) * sizeof(size_t));
+                    (MAX_LEAF_KEYS - i) * sizeof(pos_t));
             break;
         }
         i++;
@@ -950,64 +846,64 @@ void split_leaf(BPTNode* bt_node, int value, size_t pos, SplitNode* split_leaf)
     size_t num_right = temp_buf_len - middle;
 
     // set the left node (it will have fewer values
-    split_leaf->left_leaf = bt_node;
-    split_leaf->left_leaf->num_elements = middle;
-    memcpy((void*) split_leaf->left_leaf->node_vals,
+    BPTLeaf* left_leaf = leaf;
+    left_leaf->node.num_elements = middle;
+    memcpy((void*) left_leaf->node_vals,
             (void*) values,
             middle * sizeof(int));
-    memcpy((void*) split_leaf->left_leaf->bpt_meta.bpt_leaf.col_pos,
+    memcpy((void*) left_leaf->col_pos,
             (void*) positions,
-            middle * sizeof(size_t));
+            middle * sizeof(pos_t));
 
     // set the right leaf to be all the current values at the n/2 + 1 location
-    split_leaf->right_leaf = create_leaf();
-    split_leaf->right_leaf->num_elements = num_right;
-    memcpy((void*) split_leaf->right_leaf->node_vals,
+    BPTLeaf* right_leaf = create_leaf();
+    right_leaf->node.num_elements = num_right;
+    memcpy((void*) right_leaf->node_vals,
             (void*) &values[middle],
             num_right * sizeof(int));
-    memcpy((void*) split_leaf->right_leaf->bpt_meta.bpt_leaf.col_pos,
+    memcpy((void*) right_leaf->col_pos,
             (void*) &positions[middle],
-            num_right * sizeof(size_t));
+            num_right * sizeof(pos_t));
 
     // set the median value
+    split_leaf->left_leaf = &left_leaf->node;
+    split_leaf->right_leaf = &right_leaf->node;
     split_leaf->middle_val = values[middle];
 
     // set interleaf pointers
     // the right leaf should point back to the left leaf
-    split_leaf->right_leaf->bpt_meta.bpt_leaf.prev_leaf =
-            split_leaf->left_leaf;
+    right_leaf->prev_leaf = left_leaf;
 
     // the right leaf should now point to where the left leaf pointed
-    BPTNode* old_next = split_leaf->left_leaf->bpt_meta.bpt_leaf.next_leaf;
-    split_leaf->right_leaf->bpt_meta.bpt_leaf.next_leaf = old_next;
+    BPTLeaf* old_next = left_leaf->next_leaf;
+    right_leaf->next_leaf = old_next;
     // if it pointed to anything, we need to update that as well so
     // it will now point to the new right leaf
     if (old_next) {
-        old_next->bpt_meta.bpt_leaf.prev_leaf = split_leaf->right_leaf;
+        old_next->prev_leaf = right_leaf;
     }
     // last the left leaf's next should be the right leaf
-    split_leaf->left_leaf->bpt_meta.bpt_leaf.next_leaf =
-            split_leaf->right_leaf;
+    left_leaf->next_leaf = right_leaf;
 
 }
 
 /**
  * @brief Function for adding a key, value pair to a leaf
  *
- * @param bt_node - node to add to
+ * @param leaf - leaf to add to
  * @param value - value to add to the node
  * @param position - position
  */
-SplitNode* add_to_leaf(BPTNode* bt_node, int value, size_t position) {
-    assert(bt_node->is_leaf == true);
+SplitNode* add_to_leaf(BPTLeaf* leaf, int value, size_t position) {
+    assert(leaf->node.is_leaf == true);
     // we can either do a naive insert or we
     // need to insert into a full node
-    if (bt_node->num_elements < MAX_KEYS) {
-        insert_into_leaf(bt_node, value, position);
+    if (leaf->node.num_elements < MAX_LEAF_KEYS) {
+        insert_into_leaf(leaf, value, position);
         return NULL;
     } else {
         SplitNode* split_node = malloc(sizeof(SplitNode));
-        split_leaf(bt_node, value, position, split_node);
+        split_leaf(leaf, value, position, split_node);
         // TODO: set the pointers so the go to eachother
         return split_node;
     }
@@ -1026,9 +922,10 @@ SplitNode* add_to_leaf(BPTNode* bt_node, int value, size_t position) {
 BPTNodeStack* find_leaf(BPTNode* bt_node, int value) {
     BPTNodeStack* access_stack = create_stack(32);
     while (bt_node->is_leaf == false) {
+        BPTInner* inner = BPT_INNER(bt_node);
         size_t i = 0;
         while (i < bt_node->num_elements) {
-            if (value < bt_node->node_vals[i]) {
+            if (value < inner->node_vals[i]) {
                 break;
             } else {
                 i++;
@@ -1037,7 +934,7 @@ BPTNodeStack* find_leaf(BPTNode* bt_node, int value) {
         // once we have found a child, push to the access stack
         // and move to checkout the child
         stack_push(access_stack, bt_node);
-        bt_node = bt_node->bpt_meta.bpt_ptrs.children[i];
+        bt_node = inner->children[i];
     }
     // the last item in the stack will be the leaf
     stack_push(access_stack, bt_node);
@@ -1056,31 +953,31 @@ BPTNodeStack* find_leaf(BPTNode* bt_node, int value) {
  * @param bt_node - this is the node that we will be inserting into
  * @param split_node - this is the node that we will be add
  */
-void insert_into_tree_body(BPTNode* bt_node, SplitNode* split_node) {
+void insert_into_tree_body(BPTInner* bt_node, SplitNode* split_node) {
     assert(bt_node != NULL);
     assert(split_node != NULL);
-    assert(bt_node->num_elements < MAX_KEYS);
+    assert(bt_node->node.num_elements < MAX_KEYS);
+    size_t num_elements = bt_node->node.num_elements;
 
     // when we have a brand new node we need to also set the left fence value
     // In all other cases we will just set the right fence
-    if (bt_node->num_elements == 0) {
+    if (num_elements == 0) {
         // set left fence
-        bt_node->bpt_meta.bpt_ptrs.children[bt_node->num_elements] =
-                split_node->left_leaf;
+        bt_node->children[num_elements] = split_node->left_leaf;
     }
 
     // inserting in all other cases - get the
     size_t i = 0;
-    while (i < bt_node->num_elements) {
+    while (i < num_elements) {
         if (split_node->middle_val < bt_node->node_vals[i]) {
             // shift positions right
             memmove((void*) &bt_node->node_vals[i + 1],
                     (void*) &bt_node->node_vals[i],
-                    (bt_node->num_elements - i) * sizeof(int));
+                    (num_elements - i) * sizeof(int));
             // shift pointers right
-            memmove((void*) &bt_node->bpt_meta.bpt_ptrs.children[i + 2],
-                    (void*) &bt_node->bpt_meta.bpt_ptrs.children[i + 1],
-                    (bt_node->num_elements - i) * sizeof(BPTNode*));
+            memmove((void*) &bt_node->children[i + 2],
+                    (void*) &bt_node->children[i + 1],
+                    (num_elements - i) * sizeof(BPTNode*));
             break;
         }
         i++;
@@ -1088,10 +985,10 @@ void insert_into_tree_body(BPTNode* bt_node, SplitNode* split_node) {
 
     // place the node in the correct spot
     bt_node->node_vals[i] = split_node->middle_val;
-    bt_node->bpt_meta.bpt_ptrs.children[i + 1] = split_node->right_leaf;
+    bt_node->children[i + 1] = split_node->right_leaf;
 
     // increase the number of elements
-    bt_node->num_elements++;
+    bt_node->node.num_elements++;
 }
 
 
@@ -1104,9 +1001,9 @@ void insert_into_tree_body(BPTNode* bt_node, SplitNode* split_node) {
  * @param insert_node - split node to add
  * @param result_node - the node we want to attach the result to
  */
-void split_body_node(BPTNode* bt_node, SplitNode* insert_node, SplitNode* result_node) {
-    assert(bt_node->is_leaf == false);
-    assert(bt_node->num_elements == MAX_KEYS);
+void split_body_node(BPTInner* bt_node, SplitNode* insert_node, SplitNode* result_node) {
+    assert(bt_node->node.is_leaf == false);
+    assert(bt_node->node.num_elements == MAX_KEYS);
 
     // this is the temp array
     size_t temp_buf_len = MAX_KEYS + 1;
@@ -1119,7 +1016,7 @@ void split_body_node(BPTNode* bt_node, SplitNode* insert_node, SplitNode* result
             (void*)bt_node->node_vals,
             MAX_KEYS * sizeof(int));
     memcpy((void*) pointers,
-            (void*)bt_node->bpt_meta.bpt_ptrs.children,
+            (void*)bt_node->children,
             MAX_DEGREE * sizeof(BPTNode*));
 
     // this is the loop that handles the insertion
@@ -1146,32 +1043,33 @@ void split_body_node(BPTNode* bt_node, SplitNode* insert_node, SplitNode* result
     size_t middle = temp_buf_len / 2;
 
     // set the left node (it will have equal or more)
-    result_node->left_leaf = bt_node;
-    result_node->left_leaf->num_elements = middle;
-    memcpy((void*) result_node->left_leaf->node_vals,
+    BPTInner* left_node = bt_node;
+    left_node->node.num_elements = middle;
+    memcpy((void*) left_node->node_vals,
             (void*) values,
             middle * sizeof(int));
-    memcpy((void*) result_node->left_leaf->bpt_meta.bpt_leaf.col_pos,
+    memcpy((void*) left_node->children,
             (void*) pointers,
-            (middle + 1) * sizeof(size_t));
+            (middle + 1) * sizeof(BPTNode*));
 
     // set the right leaf to be all the current values at the n/2 + 1 location
     // we will take everything not including the middle
     size_t num_right = temp_buf_len - middle - 1;
     // we need to create a new node now
-    result_node->right_leaf = create_node();
-    result_node->right_leaf->bpt_meta.bpt_ptrs.level =
-            result_node->left_leaf->bpt_meta.bpt_ptrs.level;
+    BPTInner* right_node = create_node();
+    right_node->level = left_node->level;
 
-    result_node->right_leaf->num_elements = num_right;
-    memcpy((void*) result_node->right_leaf->node_vals,
+    right_node->node.num_elements = num_right;
+    memcpy((void*) right_node->node_vals,
             (void*) &values[middle + 1],
             num_right * sizeof(int));
-    memcpy((void*) result_node->right_leaf->bpt_meta.bpt_leaf.col_pos,
+    memcpy((void*) right_node->children,
             (void*) &pointers[middle + 1],
-            (num_right + 1) * sizeof(size_t));
+            (num_right + 1) * sizeof(BPTNode*));
 
     // set the median value
+    result_node->left_leaf = &left_node->node;
+    result_node->right_leaf = &right_node->node;
     result_node->middle_val = values[middle];
 
     return;
@@ -1199,21 +1097,21 @@ BPTNode* rebalanced_insert(
     BPTNodeStack* access_stack
 ) {
     if (bt_node == NULL) {
-        bt_node = create_node();
-        bt_node->bpt_meta.bpt_ptrs.level = 0;
+        BPTInner* root = create_node();
+        root->level = 0;
         // nodee to update
-        insert_into_tree_body(bt_node, split_node);
-        return bt_node;
+        insert_into_tree_body(root, split_node);
+        return &root->node;
     } else if (bt_node->num_elements < MAX_KEYS) {
-        insert_into_tree_body(bt_node, split_node);
+        insert_into_tree_body(BPT_INNER(bt_node), split_node);
         if (stack_is_empty(access_stack)) {
             return bt_node;
         }
         return access_stack->array[0];
     } else {
         SplitNode new_split;
-        bt_node->bpt_meta.bpt_ptrs.level++;
-        split_body_node(bt_node, split_node, &new_split);
+        BPT_INNER(bt_node)->level++;
+        split_body_node(BPT_INNER(bt_node), split_node, &new_split);
         return rebalanced_insert(stack_pop(access_stack),
                           &new_split,
                           access_stack);
@@ -1241,39 +1139,39 @@ BPTNode* btree_insert_value(
 ) {
     // if we don't have a first value, make a first value
     if (bt_node == NULL) {
-        bt_node = create_leaf();
-        add_to_leaf(bt_node, value, position);
-        return bt_node;
+        BPTLeaf* leaf = create_leaf();
+        add_to_leaf(leaf, value, position);
+        return &leaf->node;
     }
 
     // OTHERWISE - we need to handle normal insertion
     // find the leaf that we will add to
     BPTNodeStack* access_stack = find_leaf(bt_node, value);
-    BPTNode* leaf = stack_pop(access_stack);
+    BPTLeaf* leaf = BPT_LEAF(stack_pop(access_stack));
     SplitNode* split_node = add_to_leaf(leaf, value, position);
 
     // this means that we want to update the positions
     // TODO: make it smarter for primary (only shift right)
     if (update_positions == true) {
         // go left and update all those positions
-        BPTNode* left_update = leaf->bpt_meta.bpt_leaf.prev_leaf;
+        BPTLeaf* left_update = leaf->prev_leaf;
         while (left_update != NULL) {
-            size_t* pos_array = left_update->bpt_meta.bpt_leaf.col_pos;
-            for (size_t i = 0; i < left_update->num_elements; i++) {
+            pos_t* pos_array = left_update->col_pos;
+            for (size_t i = 0; i < left_update->node.num_elements; i++) {
                 // we need to shift all the values to the right in each leaf
                 if (pos_array[i] >= position) {
                     pos_array[i]++;
                 }
             }
-            left_update = left_update->bpt_meta.bpt_leaf.prev_leaf;
+            left_update = left_update->prev_leaf;
         }
 
         // go right and update all of those positions
-        BPTNode* right_update = leaf;
+        BPTLeaf* right_update = leaf;
         bool set_one = false; // if we alreay have a value that fites the case
         while (right_update != NULL) {
-            size_t* pos_array = right_update->bpt_meta.bpt_leaf.col_pos;
-            for (size_t i = 0; i < right_update->num_elements; i++) {
+            pos_t* pos_array = right_update->col_pos;
+            for (size_t i = 0; i < right_update->node.num_elements; i++) {
                 // we need to shift all the values to the right in each leaf
                 if (pos_array[i] > position) {
                     pos_array[i]++;
@@ -1285,7 +1183,7 @@ BPTNode* btree_insert_value(
                     }
                 }
             }
-            right_update = right_update->bpt_meta.bpt_leaf.next_leaf;
+            right_update = right_update->next_leaf;
         }
     }
 
@@ -1,4 +1,5 @@
 #include "cs165_api.h"
+#include "zone_map.h"
 #include <string.h>
 #include <stdlib.h>
 #define DEFAULT_TABLE_SIZE 8
@@ -42,6 +43,10 @@ Column* create_column(
             strcpy(new_col->name, name);
             new_col->index = NULL;
             new_col->index_type = index_type;
+            new_col->compressed = NULL;
+            new_col->compress_pending = false;
+            new_col->histogram = NULL;
+            new_col->prefix_sums = NULL;
             // if we have a clustered column we need that column to be
             // specified as the primary index
             // TODO: indexing things
@@ -54,7 +59,8 @@ Column* create_column(
             // TODO: size?
             new_col->size_ptr = &table->table_size;
             new_col->data = malloc(table->table_length * sizeof(int));
-            if (!new_col->data) {
+            new_col->zone_map = create_zone_map(table->table_length);
+            if (!new_col->data || !new_col->zone_map) {
                 ret_status->code = ERROR;
                 ret_status->msg_type = MEM_ALLOC_FAILED;
                 ret_status->msg = "Couldn't allocate new data";
@@ -93,6 +99,13 @@ Table* create_table(Db* db, const char* name, size_t num_columns, Status *ret_st
             return NULL;
         }
         db->tables = tmp;
+        // the tables moved so their columns have to point to them again
+        for (size_t i = 0; i < db->tables_size; i++) {
+            for (size_t j = 0; j < db->tables[i].col_count; j++) {
+                db->tables[i].columns[j].table = &db->tables[i];
+                db->tables[i].columns[j].size_ptr = &db->tables[i].table_size;
+            }
+        }
     }
 
     // set the table at the newest space
@@ -103,6 +116,7 @@ Table* create_table(Db* db, const char* name, size_t num_columns, Status *ret_st
     new_table->col_count = num_columns;
     new_table->primary_index = NULL;
     new_table->primary_col_pos = 0;
+    new_table->version = 0;
 
     // allocate new columns
     new_table->columns = calloc(new_table->col_count, sizeof(Column));
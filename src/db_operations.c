@@ -5,15 +5,22 @@
 #include "db_operations.h"
 #include "client_context.h"
 #include "db_index.h"
+#include "db_crack.h"
 #include "cs165_api.h"
-#include "extensible_hash_table.h"
+#include "join_hash_table.h"
+#include "db_scan.h"
+#include "zone_map.h"
+#include "compression.h"
+#include "utils.h"
+#include "thread_pool.h"
+#include "recycler.h"
+#include "histogram.h"
+#include "prefix_sum.h"
+#include "group_by.h"
+#include "aggregate.h"
 #include <time.h>
 #include <stdio.h>
 
-// Min and Max helper functions
-#define MIN(a,b) (((a)<(b))?(a):(b))
-#define MAX(a,b) (((a)>(b))?(a):(b))
-
 /// ***************************************************************************
 /// Helper Functions
 /// ***************************************************************************
@@ -35,12 +42,161 @@ size_t type_to_size(DataType data_type) {
         case LONG:
             return sizeof(long int);
         case INDEX:
-            return sizeof(double);
+            return sizeof(pos_t);
+        case BITMAP:
+            return sizeof(uint32_t);
         default:
             return 0;
     }
 }
 
+/**
+ * @brief This function turns a bitmap or range result into a position list
+ *  in place (for operators that need explicit positions, e.g. joins)
+ *
+ * @param result
+ */
+void materialize_positions(Result* result) {
+    if (result == NULL) {
+        return;
+    }
+    if (result->data_type == INDEX && result->is_contiguous) {
+        pos_t* positions = NULL;
+        if (result->num_tuples > 0) {
+            positions = malloc(sizeof(pos_t) * result->num_tuples);
+            for (size_t i = 0; i < result->num_tuples; i++) {
+                positions[i] = result->first_row + i;
+            }
+        }
+        result->payload = positions;
+        result->capacity = result->num_tuples;
+        result->is_contiguous = false;
+        return;
+    }
+    if (result->data_type != BITMAP) {
+        return;
+    }
+    pos_t* positions = NULL;
+    if (result->num_tuples > 0) {
+        positions = malloc(sizeof(pos_t) * result->num_tuples);
+        bitmap_to_positions(result->payload, result->capacity, positions);
+    }
+    free(result->payload);
+    result->payload = positions;
+    result->capacity = result->num_tuples;
+    result->data_type = INDEX;
+}
+
+/// ***************************************************************************
+/// Result Views
+/// ***************************************************************************
+
+// Fetches over a range of a raw column point into the column instead of
+// copying it. The views are kept here so that a write to their table can
+// copy them out first (queries run one at a time so there is no lock).
+typedef struct ViewRegistry {
+    Result** views;
+    size_t num_views;
+    size_t allocated_views;
+} ViewRegistry;
+
+static ViewRegistry view_registry = {
+    .views = NULL,
+    .num_views = 0,
+    .allocated_views = 0
+};
+
+/**
+ * @brief This function makes a result a view of rows of a column
+ *
+ * @param result - the result (its payload is replaced)
+ * @param col - a column that isn't compressed
+ * @param first_row
+ * @param num_rows
+ */
+void make_view(Result* result, Column* col, size_t first_row, size_t num_rows) {
+    if (view_registry.num_views == view_registry.allocated_views) {
+        view_registry.allocated_views = view_registry.allocated_views
+            ? view_registry.allocated_views * 2 : 16;
+        view_registry.views = realloc(
+            view_registry.views,
+            sizeof(Result*) * view_registry.allocated_views
+        );
+    }
+    view_registry.views[view_registry.num_views++] = result;
+    result->data_type = INT;
+    result->num_tuples = num_rows;
+    result->capacity = num_rows;
+    result->payload = (void*) &col->data[first_row];
+    result->is_contiguous = true;
+    result->first_row = first_row;
+    result->view_column = col;
+}
+
+/**
+ * @brief This function stops tracking a view (when its result goes away).
+ *  Nothing happens if the result isn't a view.
+ *
+ * @param result
+ */
+void release_view(Result* result) {
+    if (result == NULL || result->view_column == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < view_registry.num_views; i++) {
+        if (view_registry.views[i] == result) {
+            view_registry.views[i] = view_registry.views[--view_registry.num_views];
+            break;
+        }
+    }
+    result->view_column = NULL;
+    result->payload = NULL;
+}
+
+/**
+ * @brief This function gives every view into a table its own copy of the
+ *  values. It is called before anything moves or changes the table's data.
+ *
+ * @param table
+ */
+void materialize_views(Table* table) {
+    for (size_t i = 0; i < view_registry.num_views;) {
+        Result* view = view_registry.views[i];
+        if (view->view_column->table != table) {
+            i++;
+            continue;
+        }
+        int* values = malloc(sizeof(int) * MAX(view->num_tuples, 1));
+        memcpy(values, view->payload, sizeof(int) * view->num_tuples);
+        view->payload = values;
+        view->view_column = NULL;
+        view_registry.views[i] = view_registry.views[--view_registry.num_views];
+    }
+    if (view_registry.num_views == 0) {
+        free(view_registry.views);
+        view_registry.views = NULL;
+        view_registry.allocated_views = 0;
+    }
+}
+
+/**
+ * @brief This function frees a result and what it owns (a view only points
+ *  into its column so that is left alone)
+ *
+ * @param result
+ */
+void free_result(Result* result) {
+    if (result == NULL) {
+        return;
+    }
+    if (result->view_column) {
+        release_view(result);
+    } else {
+        free(result->payload);
+    }
+    free(result);
+}
+
 /**
  * @brief This function will return a col val at an index
  * and returns it as a double
@@ -90,8 +246,12 @@ long col_val_as_long(void* data_ptr, DataType data_type, size_t idx) {
 /// ***************************************************************************
 
 void delete_from_table(Table* table, size_t row_idx) {
+    recycler_invalidate_table(table);
+    materialize_views(table);
     for (size_t idx = 0; idx < table->col_count; idx++) {
         Column* col = &table->columns[idx];
+        column_data(col);
+        histogram_remove(col->histogram, col->data[row_idx]);
         if (col->index_type == BTREE) {
             // if we have a btree we need to scan the leaves
             // and find the index, then we need to shift all down
@@ -110,6 +270,8 @@ void delete_from_table(Table* table, size_t row_idx) {
         }
         // if we are deleting the last value then we don't need to do this
         if (row_idx + 1 < table->table_size) {
+            zone_map_invalidate(col->zone_map, row_idx);
+            prefix_sums_invalidate(col->prefix_sums, row_idx);
             memmove(
                 (void*) &table->columns[idx].data[row_idx + 1],
                 (void*) &table->columns[idx].data[row_idx],
@@ -133,6 +295,8 @@ void delete_from_table(Table* table, size_t row_idx) {
  * @param status
  */
 void insert_into_table(Table* table, int* values, Status* status) {
+    recycler_invalidate_table(table);
+    materialize_views(table);
     // so we now need to have several cases
     // a) if the table has no primary index
     // b) the table has a primary index
@@ -166,9 +330,18 @@ void insert_into_table(Table* table, int* values, Status* status) {
                 insert_into_sorted((SortedIndex*) col->index,
                                    values[idx],
                                    row_idx);
+            } else if (col->index_type == CRACKED && col->index != NULL) {
+                // the cracker column picks it up on the next select
+                cracker_insert((CrackerIndex*) col->index, values[idx], row_idx);
+            }
+            // insert into the base data (appends that fit stay encoded)
+            if (!compressed_append(col->compressed, values[idx])) {
+                column_data(col)[row_idx] = values[idx];
             }
-            // insert into the base data
-            table->columns[idx].data[row_idx] = values[idx];
+            zone_map_insert(col->zone_map, row_idx, values[idx], table->table_size);
+            prefix_sums_insert(col->prefix_sums, col->data, row_idx,
+                               values[idx], table->table_size);
+            histogram_insert(col->histogram, values[idx]);
         }
     } else {
         // let's imagine that this works - it finds the index where the value
@@ -233,11 +406,19 @@ void insert_into_table(Table* table, int* values, Status* status) {
                 insert_into_sorted((SortedIndex*) col->index,
                                     values[idx],
                                     row_idx);
+            } else if (col->index_type == CRACKED && col->index != NULL) {
+                // the rows after the insert move down one position
+                if (shift_values) {
+                    cracker_shift_positions((CrackerIndex*) col->index, row_idx);
+                }
+                cracker_insert((CrackerIndex*) col->index, values[idx], row_idx);
             }
             // if we are inserting make sure the memory move is necessary
             // if it is we want to shift the base values down one position
             // starting with the current location
             if (row_idx + 1 < table->table_size) {
+                column_data(col);
+                zone_map_invalidate(col->zone_map, row_idx);
                 memmove(
                     (void*) &table->columns[idx].data[row_idx + 1],
                     (void*) &table->columns[idx].data[row_idx],
@@ -245,7 +426,13 @@ void insert_into_table(Table* table, int* values, Status* status) {
                 );
             }
             // this is the operation to set the value
-            table->columns[idx].data[row_idx] = values[idx];
+            if (!compressed_append(col->compressed, values[idx])) {
+                column_data(col)[row_idx] = values[idx];
+            }
+            zone_map_insert(col->zone_map, row_idx, values[idx], table->table_size);
+            prefix_sums_insert(col->prefix_sums, col->data, row_idx,
+                               values[idx], table->table_size);
+            histogram_insert(col->histogram, values[idx]);
         }
     }
 }
@@ -292,6 +479,337 @@ char* process_open(OpenOperator open_op, Status* status) {
 /// Selection Functions
 /// ***************************************************************************
 
+/**
+ * @brief This function selects the positions of a range of zones of a
+ *  column. Zones that can't match are skipped and zones that fully match
+ *  are emitted without looking at the data.
+ *
+ * @param col - the column (its zone map must be refreshed)
+ * @param first_zone - the first zone to scan
+ * @param last_zone - one past the last zone to scan
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param kernel - the kernel used on the zones that have to be scanned
+ * @param positions - output (room for every row of the zones)
+ *
+ * @return the number of positions written
+ */
+size_t select_zones_positions(
+    Column* col,
+    size_t first_zone,
+    size_t last_zone,
+    int low,
+    int high,
+    SelectKernelFunc kernel,
+    pos_t* positions
+) {
+    size_t num_rows = *col->size_ptr;
+    size_t num_found = 0;
+    for (size_t zone_idx = first_zone; zone_idx < last_zone; zone_idx++) {
+        size_t start = zone_idx * ZONE_SZ;
+        size_t zone_rows = MIN(ZONE_SZ, num_rows - start);
+        switch (zone_map_check(col->zone_map, zone_idx, low, high)) {
+            case ZONE_NONE:
+                break;
+            case ZONE_ALL:
+                for (size_t idx = 0; idx < zone_rows; idx++) {
+                    positions[num_found++] = start + idx;
+                }
+                break;
+            default:
+                num_found += kernel(
+                    &col->data[start],
+                    zone_rows,
+                    start,
+                    low,
+                    high,
+                    &positions[num_found]
+                );
+                break;
+        }
+    }
+    return num_found;
+}
+
+/**
+ * @brief This function fills the bitmap words of a range of zones of a
+ *  column (zones line up with bitmap words)
+ *
+ * @param col - the column (its zone map must be refreshed)
+ * @param first_zone - the first zone to scan
+ * @param last_zone - one past the last zone to scan
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param bitmap - the bitmap for the whole column
+ *
+ * @return the number of bits set
+ */
+size_t select_zones_bitmap(
+    Column* col,
+    size_t first_zone,
+    size_t last_zone,
+    int low,
+    int high,
+    uint32_t* bitmap
+) {
+    const SelectKernel* kernel = get_select_kernel();
+    size_t num_rows = *col->size_ptr;
+    size_t num_found = 0;
+    for (size_t zone_idx = first_zone; zone_idx < last_zone; zone_idx++) {
+        size_t start = zone_idx * ZONE_SZ;
+        size_t zone_rows = MIN(ZONE_SZ, num_rows - start);
+        size_t zone_words = BITMAP_WORDS(zone_rows);
+        uint32_t* zone_bits = &bitmap[start / BIT_SZ];
+        switch (zone_map_check(col->zone_map, zone_idx, low, high)) {
+            case ZONE_NONE:
+                memset(zone_bits, 0, zone_words * sizeof(uint32_t));
+                break;
+            case ZONE_ALL:
+                memset(zone_bits, 0xff, zone_words * sizeof(uint32_t));
+                // the bits past the end of the column must stay clear
+                if (zone_rows % BIT_SZ != 0) {
+                    zone_bits[zone_words - 1] = ~0U >> (BIT_SZ - zone_rows % BIT_SZ);
+                }
+                num_found += zone_rows;
+                break;
+            default:
+                num_found += kernel->bitmap_func(
+                    &col->data[start],
+                    zone_rows,
+                    low,
+                    high,
+                    zone_bits
+                );
+                break;
+        }
+    }
+    return num_found;
+}
+
+/// ***************************************************************************
+/// Morsel Driven Selection
+/// ***************************************************************************
+
+// rows handed to a worker at a time - a whole number of zones so that
+// workers never share a zone or a bitmap word
+#define MORSEL_ZONES 16
+#define MORSEL_SZ (MORSEL_ZONES * ZONE_SZ)
+// don't bother with threads unless every worker gets a few morsels
+#define PARALLEL_SCAN_MIN_ROWS (4 * MORSEL_SZ)
+
+typedef struct MorselScanArg {
+    Column* col;
+    int low;
+    int high;
+    SelectKernelFunc kernel;
+    pos_t* positions;           // output for position scans (NULL otherwise)
+    uint32_t* bitmap;           // output for bitmap scans (NULL otherwise)
+    size_t num_morsels;
+    size_t* morsel_counts;      // the number of matches of each morsel
+    size_t next_morsel;         // the next morsel to be claimed
+} MorselScanArg;
+
+/**
+ * @brief Worker for a morsel driven scan - it claims morsels until there
+ *  are none left. Every morsel writes its positions at its own first row
+ *  (so workers never overlap) and they get compacted later.
+ *
+ * @param morsel_arg - MorselScanArg*
+ */
+void* morsel_scan_worker(void* morsel_arg) {
+    MorselScanArg* arg = (MorselScanArg*) morsel_arg;
+    size_t num_zones = NUM_ZONES(*arg->col->size_ptr);
+    size_t morsel;
+    while ((morsel = __sync_fetch_and_add(&arg->next_morsel, 1)) < arg->num_morsels) {
+        size_t first_zone = morsel * MORSEL_ZONES;
+        size_t last_zone = MIN(first_zone + MORSEL_ZONES, num_zones);
+        if (arg->bitmap) {
+            arg->morsel_counts[morsel] = select_zones_bitmap(
+                arg->col,
+                first_zone,
+                last_zone,
+                arg->low,
+                arg->high,
+                arg->bitmap
+            );
+        } else {
+            arg->morsel_counts[morsel] = select_zones_positions(
+                arg->col,
+                first_zone,
+                last_zone,
+                arg->low,
+                arg->high,
+                arg->kernel,
+                &arg->positions[morsel * MORSEL_SZ]
+            );
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief This function returns the number of threads a single scan of
+ *  num_rows rows should use
+ *
+ * @param num_rows
+ *
+ * @return the number of workers (1 means scan in the calling thread)
+ */
+size_t num_scan_workers(size_t num_rows) {
+    if (num_rows < PARALLEL_SCAN_MIN_ROWS) {
+        return 1;
+    }
+    size_t num_morsels = (num_rows + MORSEL_SZ - 1) / MORSEL_SZ;
+    return MIN(thread_pool_parallelism(), num_morsels);
+}
+
+/**
+ * @brief This function concatenates the positions of a morsel driven scan
+ *  in order (each morsel wrote at its own first row and only moves down)
+ *
+ * @param positions - the positions (NULL for bitmap scans)
+ * @param morsel_counts - the number of matches of each morsel
+ * @param num_morsels
+ *
+ * @return the total number of matches
+ */
+size_t compact_morsels(pos_t* positions, size_t* morsel_counts, size_t num_morsels) {
+    size_t num_found = 0;
+    for (size_t morsel = 0; morsel < num_morsels; morsel++) {
+        if (positions && num_found != morsel * MORSEL_SZ) {
+            memmove(&positions[num_found],
+                    &positions[morsel * MORSEL_SZ],
+                    sizeof(pos_t) * morsel_counts[morsel]);
+        }
+        num_found += morsel_counts[morsel];
+    }
+    return num_found;
+}
+
+/**
+ * @brief This function scans a whole column in parallel morsels. Either
+ *  positions or bitmap is given (the other is NULL) and both must have
+ *  room for the whole column. Positions come out sorted.
+ *
+ * @param col - the column (its zone map must be refreshed)
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param kernel - the kernel for position scans
+ * @param positions - position output
+ * @param bitmap - bitmap output
+ *
+ * @return the number of matches
+ */
+size_t select_morsels(
+    Column* col,
+    int low,
+    int high,
+    SelectKernelFunc kernel,
+    pos_t* positions,
+    uint32_t* bitmap
+) {
+    size_t num_rows = *col->size_ptr;
+    size_t num_workers = num_scan_workers(num_rows);
+    // a single worker scans in one go (no compaction needed)
+    if (num_workers == 1) {
+        return bitmap
+            ? select_zones_bitmap(col, 0, NUM_ZONES(num_rows), low, high, bitmap)
+            : select_zones_positions(col, 0, NUM_ZONES(num_rows), low, high,
+                                     kernel, positions);
+    }
+
+    MorselScanArg arg = {
+        .col = col,
+        .low = low,
+        .high = high,
+        .kernel = kernel,
+        .positions = positions,
+        .bitmap = bitmap,
+        .num_morsels = (num_rows + MORSEL_SZ - 1) / MORSEL_SZ,
+        .next_morsel = 0
+    };
+    arg.morsel_counts = malloc(sizeof(size_t) * arg.num_morsels);
+
+    // the calling thread is one of the workers
+    TaskGroup task_group;
+    task_group_init(&task_group);
+    for (size_t i = 1; i < num_workers; i++) {
+        thread_pool_submit(&task_group, &morsel_scan_worker, (void*) &arg);
+    }
+    morsel_scan_worker(&arg);
+    task_group_wait(&task_group);
+
+    size_t num_found = compact_morsels(positions, arg.morsel_counts, arg.num_morsels);
+    free(arg.morsel_counts);
+    return num_found;
+}
+
+/// ***************************************************************************
+/// Access Path Selection
+/// ***************************************************************************
+
+// the cost model counts in sequentially read values: a scan reads every
+// row (with simd) while an index reads its matches, but the positions an
+// unclustered index returns are in value order so every match costs a
+// random access when its row is fetched later on
+#define COST_SCAN_VALUE 0.25
+#define COST_INDEX_VALUE 1.0
+#define COST_RANDOM_ACCESS 8.0
+
+// the ways a range select on a column can be answered
+typedef enum AccessPath {
+    ACCESS_SCAN,
+    ACCESS_SORTED,              // get_range_sorted
+    ACCESS_BTREE_CLUSTERED,     // find_values_clustered
+    ACCESS_BTREE_UNCLUSTERED,   // find_values_unclustered
+    ACCESS_CRACKED              // crack_select
+} AccessPath;
+
+static const char* access_path_names[] = {
+    "scan", "sorted index", "clustered btree", "unclustered btree", "cracking"
+};
+
+/**
+ * @brief This function picks how to answer low <= col < high. The
+ *  selectivity comes from the column's histogram and the cheaper of a scan
+ *  and the column's index (if it has one) is used. Cracking is adaptive, so
+ *  a cracked column always cracks.
+ *
+ * @param col - the column (with its raw data)
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ *
+ * @return the access path
+ */
+AccessPath choose_access_path(Column* col, int low, int high) {
+    if (col->index_type == CRACKED) {
+        return ACCESS_CRACKED;
+    }
+    if (col->index_type == NONE || col->index == NULL) {
+        return ACCESS_SCAN;
+    }
+    AccessPath index_path = ACCESS_SORTED;
+    if (col->index_type == BTREE) {
+        index_path = col->clustered ? ACCESS_BTREE_CLUSTERED : ACCESS_BTREE_UNCLUSTERED;
+    }
+
+    double num_rows = (double) *col->size_ptr;
+    double selectivity = histogram_selectivity(column_histogram(col), low, high);
+    double num_matches = selectivity * num_rows;
+    double scan_cost = num_rows * COST_SCAN_VALUE;
+    // the search is logarithmic (the bit length of the row count)
+    double search_cost = (double) (sizeof(long) * 8 - __builtin_clzl(*col->size_ptr | 1));
+    double index_cost = search_cost + num_matches * COST_INDEX_VALUE;
+    if (!col->clustered) {
+        index_cost += num_matches * COST_RANDOM_ACCESS;
+    }
+    AccessPath path = index_cost < scan_cost ? index_path : ACCESS_SCAN;
+    cs165_log(stdout, "-- select [%d, %d) on %s: selectivity %.4f, scan %.0f, "
+              "%s %.0f -> %s\n", low, high, col->name, selectivity, scan_cost,
+              access_path_names[index_path], index_cost, access_path_names[path]);
+    return path;
+}
+
 /**
  * @brief Function that returns a result column given an array
  * of selections. The column contains an array of indices
@@ -304,41 +822,118 @@ void select_from_col(Comparator* comp, Result* result_col) {
     // TODO: Make it so this only does 1 comparison at a time
     Column* col = comp->gen_col->column_pointer.column;
 
-    if (col->index_type == NONE || col->index == NULL) {
-        size_t* positions = malloc(sizeof(size_t) * (*col->size_ptr));
-        result_col->num_tuples = 0;
-
-        for (size_t idx = 0; idx < *col->size_ptr; idx++) {
-            // Nonbranching selction - better for middle selectivity
-            positions[result_col->num_tuples] = idx;
-            result_col->num_tuples += (col->data[idx] >= comp->p_low &
-                                       col->data[idx] < comp->p_high);
-
-            // Branching scan - better for higher selectivity
-            /* if (col->data[idx] >= comp->p_low && col->data[idx] < comp->p_high) { */
-            /*     positions[result_col->num_tuples++] = idx; */
-            /* } */
-        }
-
-        // if no matches return
+    // compressed columns are scanned without decoding them
+    if (col->compressed != NULL && !CRACK_UNINDEXED_COLUMNS) {
+        int low, high;
+        comparator_int_bounds(comp, &low, &high);
+        pos_t* positions = malloc(sizeof(pos_t) * col->compressed->num_rows);
+        result_col->data_type = INDEX;
+        result_col->is_sorted = true;
+        result_col->num_tuples = compressed_select(
+            col->compressed,
+            col->zone_map,
+            low,
+            high,
+            positions
+        );
         if (result_col->num_tuples == 0) {
             free(positions);
             result_col->payload = NULL;
             return;
         }
-        // reallocate to the exact size of the column
         result_col->payload = (void*) realloc(
             positions,
-            sizeof(size_t) * result_col->num_tuples
+            sizeof(pos_t) * result_col->num_tuples
         );
-    } else if (col->index_type == SORTED) {
-        get_range_sorted(col->index, comp->p_low, comp->p_high, result_col);
-    } else if (col->index_type == BTREE && col->clustered == true) {
-        find_values_clustered(col->index, comp->p_low, comp->p_high, result_col);
-    } else {
-        find_values_unclustered(col->index, comp->p_low, comp->p_high, result_col);
+        return;
     }
-    return;
+
+#if CRACK_UNINDEXED_COLUMNS
+    if (col->index_type == NONE) {
+        col->index_type = CRACKED;
+    }
+#endif
+    // the cracker column is only copied once it is first queried
+    if (col->index_type == CRACKED && col->index == NULL) {
+        col->index = create_cracker_index(column_data(col), *col->size_ptr);
+    }
+
+    int low, high;
+    comparator_int_bounds(comp, &low, &high);
+    // only an unclustered index returns its positions in value order
+    result_col->is_sorted = true;
+    switch (choose_access_path(col, low, high)) {
+        case ACCESS_CRACKED:
+            crack_select(col->index, low, high, result_col);
+            return;
+        case ACCESS_SORTED:
+            get_range_sorted(col->index, comp->p_low, comp->p_high, result_col);
+            result_col->is_sorted = col->clustered;
+            return;
+        case ACCESS_BTREE_CLUSTERED:
+            find_values_clustered(col->index, comp->p_low, comp->p_high, result_col);
+            return;
+        case ACCESS_BTREE_UNCLUSTERED:
+            find_values_unclustered(col->index, comp->p_low, comp->p_high, result_col);
+            result_col->is_sorted = false;
+            return;
+        default:
+            break;
+    }
+    // bring the zone map up to date so that we can skip zones
+    size_t num_rows = *col->size_ptr;
+    zone_map_refresh(col->zone_map, col->data, num_rows);
+
+    // sample the column to pick the kernel for this selectivity
+    double selectivity = 0;
+    SelectKernelFunc kernel = choose_select_kernel(
+        col->data,
+        num_rows,
+        low,
+        high,
+        &selectivity
+    );
+
+    // if a lot of the column qualifies a bitmap is far smaller than
+    // a position list (1 bit per row vs 32 bits per match)
+    if (num_rows >= BITMAP_MIN_ROWS && selectivity > BITMAP_MIN_SELECTIVITY) {
+        uint32_t* bitmap = malloc(sizeof(uint32_t) * BITMAP_WORDS(num_rows));
+        result_col->data_type = BITMAP;
+        result_col->capacity = num_rows;
+        result_col->num_tuples = select_morsels(
+            col,
+            low,
+            high,
+            kernel,
+            NULL,
+            bitmap
+        );
+        result_col->payload = bitmap;
+        return;
+    }
+    pos_t* positions = malloc(sizeof(pos_t) * num_rows);
+
+    // large columns are split into morsels across threads
+    result_col->num_tuples = select_morsels(
+        col,
+        low,
+        high,
+        kernel,
+        positions,
+        NULL
+    );
+
+    // if no matches return
+    if (result_col->num_tuples == 0) {
+        free(positions);
+        result_col->payload = NULL;
+        return;
+    }
+    // reallocate to the exact size of the column
+    result_col->payload = (void*) realloc(
+        positions,
+        sizeof(pos_t) * result_col->num_tuples
+    );
 }
 //**
 // * @brief Shared column selector working version
@@ -410,7 +1005,7 @@ void select_from_col(Comparator* comp, Result* result_col) {
 /*     int maxval = INT_MIN; */
 /*     int minval = INT_MAX; */
 /*     for (size_t i = 0; i < ss_op->num_scans; ++i) { */
-/*         results[i] = malloc(sizeof(Result)); */
+/*         results[i] = calloc(1, sizeof(Result)); */
 /*         comps[i] = &ss_op->db_scans[i]->operator_fields.select_operator.comparator; */
 /*         // DELETE - set the ranges */
 /*         maxval = MAX(maxval, comps[i]->p_high); */
@@ -444,111 +1039,422 @@ typedef struct SharedScanArg {
     int maxval;
 } SharedScanArg;
 
+// the per query state a shared scan needs while it goes over the values
+typedef struct SharedPredicates {
+    size_t num_queries;
+    int* lows;
+    int* highs;
+    bool* predicated;       // write every value (predicated) or only matches
+    int minval;             // values outside [minval, maxval] match nothing
+    int maxval;
+    IntervalIndex* intervals;   // for large batches (NULL otherwise)
+} SharedPredicates;
+
 /**
- * @brief Shared column selector
+ * @brief This function sets up the predicates of a group of shared queries.
+ *  Large groups get an interval index, the others pick the branching or
+ *  predicated loop for each query.
  *
- * @param comp
- * @param result_col
+ * @param preds - the predicates to fill in
+ * @param comps - the comparators of the queries
+ * @param num_queries
+ * @param col - the column that will be scanned
+ * @param minval - the lowest low bound of the group
+ * @param maxval - the highest high bound of the group
  */
-void* shared_col_select(void* ss_thread_arg) {
-    SharedScanArg* ss_arg = (SharedScanArg*) ss_thread_arg;
-    Comparator** comps = ss_arg->comps;
-    size_t num_queries = ss_arg->num_queries;
-    Result** result_cols = ss_arg->result_cols;
-    int maxval = ss_arg->maxval;
-    int minval = ss_arg->minval;
-    Column* col = comps[0]->gen_col->column_pointer.column;
-
-    // create a result column for each position
-    size_t* all_positions[num_queries];
+void init_shared_predicates(
+    SharedPredicates* preds,
+    Comparator** comps,
+    size_t num_queries,
+    Column* col,
+    int minval,
+    int maxval
+) {
+    preds->num_queries = num_queries;
+    preds->lows = malloc(sizeof(int) * num_queries);
+    preds->highs = malloc(sizeof(int) * num_queries);
+    preds->predicated = malloc(sizeof(bool) * num_queries);
+    preds->minval = minval;
+    preds->maxval = maxval;
+    preds->intervals = NULL;
     for (size_t i = 0; i < num_queries; i++) {
-        all_positions[i] = malloc(sizeof(size_t) * (*col->size_ptr));
-        result_cols[i]->num_tuples = 0;
+        comparator_int_bounds(comps[i], &preds->lows[i], &preds->highs[i]);
     }
-
-    // Go through the columns and create the new indices
-    for (size_t idx = 0; idx < *col->size_ptr; idx++) {
-        // skip val if it's not in the range
-        int val = col->data[idx];
-        if (val < minval || val > maxval) {
-            continue;
-        }
-        for (size_t q_num = 0; q_num < num_queries; q_num++) {
-            // METHOD 1 - conditional
-            if ((val >= comps[q_num]->p_low) && (val < comps[q_num]->p_high)) {
-                all_positions[q_num][result_cols[q_num]->num_tuples++] = idx;
-            }
-
-            // METHOD 2 - always inc - this is slower
-            /* all_positions[q_num][result_cols[q_num]->num_tuples] = idx; */
-            /* // todo: what if we are at the top bound for high? will we not get max? */
-            /* result_cols[q_num]->num_tuples += ( */
-            /*         (col->data[idx] >= comps[q_num]->p_low) && */
-            /*         (col->data[idx] < comps[q_num]->p_high) */
-            /* ); */
+    // with a lot of queries a value should only touch the queries that
+    // contain it
+    if (num_queries >= INTERVAL_MIN_QUERIES) {
+        preds->intervals = create_interval_index(preds->lows, preds->highs,
+                                                 num_queries);
+        cs165_log(stdout, "-- shared select of %zu queries: %s\n", num_queries,
+                  preds->intervals ? "interval index" : "per query tests");
+        if (preds->intervals) {
+            return;
         }
     }
-
-    // for each query reallocate the column size and set it to a result
-    // column, if no results free the column
     for (size_t i = 0; i < num_queries; i++) {
-        if (result_cols[i]->num_tuples == 0) {
-            free(all_positions[i]);
-            result_cols[i]->payload = NULL;
-        } else {
-            result_cols[i]->payload = (void*) realloc(
-                all_positions[i],
-                sizeof(size_t) * result_cols[i]->num_tuples
-            );
-        }
+        double selectivity = estimate_selectivity(
+            col->data,
+            *col->size_ptr,
+            preds->lows[i],
+            preds->highs[i]
+        );
+        preds->predicated[i] = choose_select_method(selectivity) != SELECT_BRANCHING;
+        cs165_log(stdout, "-- shared select [%d, %d): selectivity %.4f, %s\n",
+                  preds->lows[i], preds->highs[i], selectivity,
+                  preds->predicated[i] ? "predicated" : "branching");
     }
-    return NULL;
 }
 
-// 4 , 9
-#define MIN_QUERIES_PER_THREAD 5
-#define MAX_THREADS 11
-#define NUM_THREADS (MAX_THREADS - 1)
-
 /**
- * @brief Attempt at threading these
+ * @brief This function frees the arrays of shared predicates
  *
- * @param ss_op
- * @param context
- * @param status
+ * @param preds
  */
-void process_shared_scans(SharedScanOperator* ss_op, ClientContext* context, Status* status) {
-    // make it so we
-    Comparator** comps = malloc(ss_op->num_scans * sizeof(Comparator*));
-    Result** results = malloc(ss_op->num_scans * sizeof(Result*));
+void free_shared_predicates(SharedPredicates* preds) {
+    free_interval_index(preds->intervals);
+    free(preds->lows);
+    free(preds->highs);
+    free(preds->predicated);
+}
 
-    int maxval = INT_MIN;
-    int minval = INT_MAX;
+/**
+ * @brief This function evaluates a large shared scan with an interval
+ *  index - the cost per value is a binary search plus its matches instead
+ *  of a test per query.
+ *
+ * @param col - the column (its zone map must be refreshed)
+ * @param preds - the queries (with an interval index)
+ * @param first_zone - the first zone to scan
+ * @param last_zone - one past the last zone to scan
+ * @param outputs - position output per query
+ * @param counts - number of positions written per query
+ */
+void shared_select_zones_intervals(
+    Column* col,
+    SharedPredicates* preds,
+    size_t first_zone,
+    size_t last_zone,
+    pos_t** outputs,
+    size_t* counts
+) {
+    size_t num_rows = *col->size_ptr;
+    for (size_t zone_idx = first_zone; zone_idx < last_zone; zone_idx++) {
+        // skip the zone if no query of the batch can match it
+        if (zone_map_check(col->zone_map, zone_idx,
+                           preds->minval, preds->maxval) == ZONE_NONE) {
+            continue;
+        }
+        size_t end = MIN((zone_idx + 1) * ZONE_SZ, num_rows);
+        for (size_t idx = zone_idx * ZONE_SZ; idx < end; idx++) {
+            const size_t* queries = NULL;
+            size_t num_matches = interval_index_lookup(
+                preds->intervals,
+                col->data[idx],
+                &queries
+            );
+            for (size_t match = 0; match < num_matches; match++) {
+                size_t q_num = queries[match];
+                outputs[q_num][counts[q_num]++] = idx;
+            }
+        }
+    }
+}
 
-    // this is the number of threads. We want to guarentee about
-    // MIN QUERIES PER THREAD
-    size_t num_threads = MIN(NUM_THREADS, (ss_op->num_scans / MIN_QUERIES_PER_THREAD));
-    if (num_threads == 0 || ss_op->num_scans % num_threads != 0) {
-        num_threads++;
+/**
+ * @brief This function evaluates every query of a shared scan on a range
+ *  of zones in one pass. Query q writes its positions to
+ *  outputs[q][counts[q]++].
+ *
+ * @param col - the column (its zone map must be refreshed)
+ * @param preds - the queries
+ * @param first_zone - the first zone to scan
+ * @param last_zone - one past the last zone to scan
+ * @param outputs - position output per query
+ * @param counts - number of positions written per query
+ */
+void shared_select_zones(
+    Column* col,
+    SharedPredicates* preds,
+    size_t first_zone,
+    size_t last_zone,
+    pos_t** outputs,
+    size_t* counts
+) {
+    size_t num_queries = preds->num_queries;
+    int* lows = preds->lows;
+    int* highs = preds->highs;
+    // the queries that have to look at the values of the current zone
+    size_t zone_queries[num_queries];
+    size_t num_rows = *col->size_ptr;
+    if (preds->intervals) {
+        shared_select_zones_intervals(col, preds, first_zone, last_zone,
+                                      outputs, counts);
+        return;
     }
+    for (size_t zone_idx = first_zone; zone_idx < last_zone; zone_idx++) {
+        size_t start = zone_idx * ZONE_SZ;
+        size_t end = MIN(start + ZONE_SZ, num_rows);
+        size_t num_zone_queries = 0;
+        for (size_t q_num = 0; q_num < num_queries; q_num++) {
+            switch (zone_map_check(col->zone_map, zone_idx, lows[q_num], highs[q_num])) {
+                case ZONE_NONE:
+                    break;
+                case ZONE_ALL:
+                    for (size_t idx = start; idx < end; idx++) {
+                        outputs[q_num][counts[q_num]++] = idx;
+                    }
+                    break;
+                default:
+                    zone_queries[num_zone_queries++] = q_num;
+                    break;
+            }
+        }
+        if (num_zone_queries == 0) {
+            continue;
+        }
 
-    // if it doesn't evenly divide add a new thread for the remainder
-    size_t q_per_thread = ss_op->num_scans / num_threads;
-    if (ss_op->num_scans % num_threads != 0) {
-        q_per_thread++;
+        // Go through the zone and create the new indices
+        for (size_t idx = start; idx < end; idx++) {
+            // skip val if it's not in the range
+            int val = col->data[idx];
+            if (val < preds->minval || val > preds->maxval) {
+                continue;
+            }
+            for (size_t z_num = 0; z_num < num_zone_queries; z_num++) {
+                size_t q_num = zone_queries[z_num];
+                if (preds->predicated[q_num]) {
+                    // METHOD 2 - always inc (for unpredictable matches)
+                    outputs[q_num][counts[q_num]] = idx;
+                    counts[q_num] += ((val >= lows[q_num]) & (val < highs[q_num]));
+                } else if ((val >= lows[q_num]) && (val < highs[q_num])) {
+                    // METHOD 1 - conditional
+                    outputs[q_num][counts[q_num]++] = idx;
+                }
+            }
+        }
     }
-    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
-    SharedScanArg* ss_arg_array = malloc(num_threads * sizeof(SharedScanArg));
+}
 
-    size_t queries_grouped = 0;
-    size_t group_num = 0;
+/**
+ * @brief This function hands the positions of a shared query to its result
+ *  (shrinking the buffer to the number of matches)
+ *
+ * @param result_col
+ * @param positions - buffer with room for the whole column
+ * @param num_found - number of matches
+ */
+void set_shared_result(Result* result_col, pos_t* positions, size_t num_found) {
+    result_col->num_tuples = num_found;
+    result_col->is_sorted = true;
+    if (num_found == 0) {
+        free(positions);
+        result_col->payload = NULL;
+    } else {
+        result_col->payload = (void*) realloc(positions, sizeof(pos_t) * num_found);
+    }
+}
+
+/**
+ * @brief Shared column selector - evaluates a group of queries over the
+ *  whole column (query partitioned)
+ *
+ * @param comp
+ * @param result_col
+ */
+void* shared_col_select(void* ss_thread_arg) {
+    SharedScanArg* ss_arg = (SharedScanArg*) ss_thread_arg;
+    size_t num_queries = ss_arg->num_queries;
+    Result** result_cols = ss_arg->result_cols;
+    Column* col = ss_arg->comps[0]->gen_col->column_pointer.column;
+
+    SharedPredicates preds;
+    init_shared_predicates(&preds, ss_arg->comps, num_queries, col,
+                           ss_arg->minval, ss_arg->maxval);
+
+    // create a result column for each position
+    pos_t* all_positions[num_queries];
+    size_t counts[num_queries];
+    for (size_t i = 0; i < num_queries; i++) {
+        all_positions[i] = malloc(sizeof(pos_t) * (*col->size_ptr));
+        counts[i] = 0;
+    }
+    shared_select_zones(col, &preds, 0, NUM_ZONES(*col->size_ptr),
+                        all_positions, counts);
+
+    // for each query reallocate the column size and set it to a result
+    // column, if no results free the column
+    for (size_t i = 0; i < num_queries; i++) {
+        set_shared_result(result_cols[i], all_positions[i], counts[i]);
+    }
+    free_shared_predicates(&preds);
+    return NULL;
+}
+
+/// ***************************************************************************
+/// Data Partitioned Shared Scans
+/// ***************************************************************************
+
+// rows of a chunk - small enough for the chunk to stay in the L2 cache
+// while every query of the batch is evaluated on it
+#define SHARED_CHUNK_ZONES 4
+#define SHARED_CHUNK_SZ (SHARED_CHUNK_ZONES * ZONE_SZ)
+#define CACHE_LINE_SZ 64
+// number of counts that fill whole cache lines
+#define PADDED_COUNTS(n) \
+    ((((n) * sizeof(size_t) + CACHE_LINE_SZ - 1) / CACHE_LINE_SZ) * \
+     (CACHE_LINE_SZ / sizeof(size_t)))
+
+typedef struct SharedChunkArg {
+    Column* col;
+    SharedPredicates* preds;
+    pos_t** all_positions;      // per query, room for the whole column
+    size_t num_chunks;
+    size_t counts_stride;       // padded length of a row of chunk_counts
+    size_t* chunk_counts;       // matches per chunk and query
+    size_t next_chunk;          // the next chunk to be claimed
+} SharedChunkArg;
+
+/**
+ * @brief Worker for a data partitioned shared scan - it claims chunks and
+ *  evaluates every query on a chunk before moving to the next one. A chunk
+ *  writes its positions starting at its own first row (so workers never
+ *  overlap) and its counts to its own cache lines.
+ *
+ * @param chunk_arg - SharedChunkArg*
+ */
+void* shared_chunk_worker(void* chunk_arg) {
+    SharedChunkArg* arg = (SharedChunkArg*) chunk_arg;
+    size_t num_queries = arg->preds->num_queries;
+    size_t num_zones = NUM_ZONES(*arg->col->size_ptr);
+    pos_t* outputs[num_queries];
+    size_t chunk;
+    while ((chunk = __sync_fetch_and_add(&arg->next_chunk, 1)) < arg->num_chunks) {
+        size_t* counts = &arg->chunk_counts[chunk * arg->counts_stride];
+        for (size_t q_num = 0; q_num < num_queries; q_num++) {
+            outputs[q_num] = &arg->all_positions[q_num][chunk * SHARED_CHUNK_SZ];
+            counts[q_num] = 0;
+        }
+        size_t first_zone = chunk * SHARED_CHUNK_ZONES;
+        shared_select_zones(
+            arg->col,
+            arg->preds,
+            first_zone,
+            MIN(first_zone + SHARED_CHUNK_ZONES, num_zones),
+            outputs,
+            counts
+        );
+    }
+    return NULL;
+}
+
+/**
+ * @brief This function runs a whole batch over a column split into cache
+ *  sized chunks, so the column only crosses the memory bus once no matter
+ *  how many threads work on it.
+ *
+ * @param comps - the comparators of the batch
+ * @param result_cols - the results of the batch
+ * @param num_queries
+ * @param minval - the lowest low bound of the batch
+ * @param maxval - the highest high bound of the batch
+ */
+void shared_select_chunks(
+    Comparator** comps,
+    Result** result_cols,
+    size_t num_queries,
+    int minval,
+    int maxval
+) {
+    Column* col = comps[0]->gen_col->column_pointer.column;
+    size_t num_rows = *col->size_ptr;
+    SharedPredicates preds;
+    init_shared_predicates(&preds, comps, num_queries, col, minval, maxval);
+
+    SharedChunkArg arg = {
+        .col = col,
+        .preds = &preds,
+        .num_chunks = (num_rows + SHARED_CHUNK_SZ - 1) / SHARED_CHUNK_SZ,
+        .counts_stride = PADDED_COUNTS(num_queries),
+        .next_chunk = 0
+    };
+    arg.all_positions = malloc(sizeof(pos_t*) * num_queries);
+    for (size_t i = 0; i < num_queries; i++) {
+        arg.all_positions[i] = malloc(sizeof(pos_t) * num_rows);
+    }
+    // over allocate by a line so the rows of counts start on a line
+    size_t* counts_buffer = malloc(
+        sizeof(size_t) * arg.counts_stride * arg.num_chunks + CACHE_LINE_SZ
+    );
+    arg.chunk_counts = (size_t*) (
+        ((uintptr_t) counts_buffer + CACHE_LINE_SZ - 1) &
+        ~((uintptr_t) CACHE_LINE_SZ - 1)
+    );
+
+    // the calling thread is one of the workers
+    size_t num_workers = MIN(thread_pool_parallelism(), arg.num_chunks);
+    TaskGroup task_group;
+    task_group_init(&task_group);
+    for (size_t i = 1; i < num_workers; i++) {
+        thread_pool_submit(&task_group, &shared_chunk_worker, (void*) &arg);
+    }
+    shared_chunk_worker(&arg);
+    task_group_wait(&task_group);
+
+    // concatenate the chunks of every query in order
+    for (size_t q_num = 0; q_num < num_queries; q_num++) {
+        pos_t* positions = arg.all_positions[q_num];
+        size_t num_found = 0;
+        for (size_t chunk = 0; chunk < arg.num_chunks; chunk++) {
+            size_t count = arg.chunk_counts[chunk * arg.counts_stride + q_num];
+            if (num_found != chunk * SHARED_CHUNK_SZ) {
+                memmove(&positions[num_found],
+                        &positions[chunk * SHARED_CHUNK_SZ],
+                        sizeof(pos_t) * count);
+            }
+            num_found += count;
+        }
+        set_shared_result(result_cols[q_num], positions, num_found);
+    }
+    free(counts_buffer);
+    free(arg.all_positions);
+    free_shared_predicates(&preds);
+}
+
+// 4 , 9
+#define MIN_QUERIES_PER_THREAD 5
+
+/**
+ * @brief Attempt at threading these
+ *
+ * @param ss_op
+ * @param context
+ * @param status
+ */
+void process_shared_scans(SharedScanOperator* ss_op, ClientContext* context, Status* status) {
+    // an empty batch has nothing to scan
+    if (ss_op->num_scans == 0) {
+        free(ss_op->db_scans);
+        status->msg_type = OK_DONE;
+        return;
+    }
+    // make it so we
+    Comparator** comps = malloc(ss_op->num_scans * sizeof(Comparator*));
+    Result** results = malloc(ss_op->num_scans * sizeof(Result*));
+
+    // the bounds of the whole batch
+    int batch_maxval = INT_MIN;
+    int batch_minval = INT_MAX;
+    // whether every query of the batch is on the same column
+    bool one_column = true;
+    bool any_compressed = false;
 
     for (size_t i = 0; i < ss_op->num_scans; ++i) {
-        results[i] = malloc(sizeof(Result));
+        results[i] = calloc(1, sizeof(Result));
         comps[i] = &ss_op->db_scans[i]->operator_fields.select_operator.comparator;
-        // DELETE - set the ranges
-        maxval = MAX(maxval, comps[i]->p_high);
-        minval = MIN(minval, comps[i]->p_low);
+        batch_maxval = MAX(batch_maxval, comps[i]->p_high);
+        batch_minval = MIN(batch_minval, comps[i]->p_low);
+        one_column &= (comps[i]->gen_col->column_pointer.column ==
+                       comps[0]->gen_col->column_pointer.column);
 
         GeneralizedColumnHandle* gcol_handle = add_result_column(
             context,
@@ -558,12 +1464,70 @@ void process_shared_scans(SharedScanOperator* ss_op, ClientContext* context, Sta
         gcol_handle->generalized_column.column_pointer.result = results[i];
         results[i]->data_type = INDEX;
 
+        // the zone maps are shared by the threads so refresh them up front
+        Column* col = comps[i]->gen_col->column_pointer.column;
+        compress_loaded_column(col);
+        any_compressed |= col->compressed != NULL;
+        if (col->compressed == NULL) {
+            zone_map_refresh(col->zone_map, col->data, *col->size_ptr);
+        }
+    }
+
+    // compressed columns are small enough that each query just scans the
+    // codes on its own
+    if (any_compressed) {
+        for (size_t i = 0; i < ss_op->num_scans; ++i) {
+            select_from_col(comps[i], results[i]);
+        }
+        free(comps);
+        free(results);
+        free(ss_op->db_scans);
+        status->msg_type = OK_DONE;
+        return;
+    }
+
+    // with several threads on a large column we split the column instead
+    // of the batch, so that the column is only read once
+    Column* col = comps[0]->gen_col->column_pointer.column;
+    if (one_column &&
+        thread_pool_parallelism() > 1 &&
+        *col->size_ptr >= PARALLEL_SCAN_MIN_ROWS
+    ) {
+        shared_select_chunks(comps, results, ss_op->num_scans,
+                             batch_minval, batch_maxval);
+        free(comps);
+        free(results);
+        free(ss_op->db_scans);
+        status->msg_type = OK_DONE;
+        return;
+    }
+
+    // this is the number of pool tasks. We want to guarentee about
+    // MIN QUERIES PER THREAD and don't need more tasks than threads
+    size_t num_groups = MIN(thread_pool_parallelism(),
+                            ss_op->num_scans / MIN_QUERIES_PER_THREAD);
+    num_groups = MAX(num_groups, 1);
+
+    // if it doesn't evenly divide the last group gets the remainder
+    size_t q_per_thread = (ss_op->num_scans + num_groups - 1) / num_groups;
+    SharedScanArg* ss_arg_array = malloc(num_groups * sizeof(SharedScanArg));
+
+    size_t queries_grouped = 0;
+    size_t group_num = 0;
+    int maxval = INT_MIN;
+    int minval = INT_MAX;
+
+    for (size_t i = 0; i < ss_op->num_scans; ++i) {
+        // DELETE - set the ranges
+        maxval = MAX(maxval, comps[i]->p_high);
+        minval = MIN(minval, comps[i]->p_low);
+
         queries_grouped++;
         // if it is the last query or we have our desired number of queries
         if (i + 1 == ss_op->num_scans || queries_grouped == q_per_thread) {
-            ss_arg_array[group_num].comps = &comps[i - (q_per_thread - 1)];
+            ss_arg_array[group_num].comps = &comps[i + 1 - queries_grouped];
             ss_arg_array[group_num].num_queries = queries_grouped;
-            ss_arg_array[group_num].result_cols = &results[i - (q_per_thread - 1)];
+            ss_arg_array[group_num].result_cols = &results[i + 1 - queries_grouped];
             ss_arg_array[group_num].maxval = maxval;
             ss_arg_array[group_num].minval = minval;
             // now reset the values
@@ -573,17 +1537,16 @@ void process_shared_scans(SharedScanOperator* ss_op, ClientContext* context, Sta
             minval = INT_MAX;
         }
     }
-    for (size_t i = 0; i < num_threads; i++) {
-        pthread_create(&threads[i], NULL, &shared_col_select,
-                (void*) (ss_arg_array + i));
-    }
-    for (size_t i = 0; i < num_threads; i++) {
-        pthread_join(threads[i], NULL);
+    TaskGroup task_group;
+    task_group_init(&task_group);
+    for (size_t i = 0; i < group_num; i++) {
+        thread_pool_submit(&task_group, &shared_col_select,
+                           (void*) (ss_arg_array + i));
     }
+    task_group_wait(&task_group);
     free(comps);
     free(results);
     free(ss_arg_array);
-    free(threads);
     free(ss_op->db_scans);
     status->msg_type = OK_DONE;
 }
@@ -601,21 +1564,59 @@ void select_from_selection(Comparator*comp, Result* idx_col, Result* result_col)
     Result* queryed_col = comp->gen_col->column_pointer.result;
     // this length should be correct (otherwise we have an issue)
     assert(queryed_col->num_tuples == idx_col->num_tuples);
+    int low, high;
+    comparator_int_bounds(comp, &low, &high);
+
+    // a selection over a bitmap stays a bitmap - the k-th fetched value
+    // belongs to the k-th set bit, so we just clear the bits that fail
+    if (idx_col->data_type == BITMAP) {
+        size_t num_words = BITMAP_WORDS(idx_col->capacity);
+        uint32_t* bitmap = malloc(sizeof(uint32_t) * num_words);
+        memcpy(bitmap, idx_col->payload, sizeof(uint32_t) * num_words);
+        int* values = (int*) queryed_col->payload;
+        size_t num_found = 0;
+        size_t pos = 0;
+        for (size_t k = 0; k < queryed_col->num_tuples; k++, pos++) {
+            pos = bitmap_next_set(bitmap, idx_col->capacity, pos);
+            if ((values[k] >= low) & (values[k] < high)) {
+                num_found++;
+            } else {
+                ClearBit(bitmap, pos);
+            }
+        }
+        result_col->data_type = BITMAP;
+        result_col->capacity = idx_col->capacity;
+        result_col->num_tuples = num_found;
+        result_col->payload = bitmap;
+        return;
+    }
     // make space for the results which we will add to the result col later
-    size_t* positions = malloc(sizeof(size_t) * queryed_col->num_tuples);
-    // init the count to 0;
-    result_col->num_tuples = 0;
-    for (size_t idx = 0; idx < queryed_col->num_tuples; idx++) {
-        // cast the index column as a int
-        positions[result_col->num_tuples] = ((size_t*) idx_col->payload)[idx];
-        // TODO: what if we are at the top bound for high? will we not get max?
-        // TODO - switch to bitwise and
-        // TODO: this needs to work for longs...
-        result_col->num_tuples += (
-                ((int*)queryed_col->payload)[idx] >= comp->p_low &&
-                ((int*)queryed_col->payload)[idx] < comp->p_high
-        );
+    pos_t* positions = malloc(sizeof(pos_t) * queryed_col->num_tuples);
+    // TODO: this needs to work for longs...
+    // the kernel gives us offsets into the selection which we then
+    // map back to positions (in place as offsets only grow) - over a range
+    // the offsets are the positions once the range start is added
+    bool is_range = idx_col->is_contiguous;
+    SelectKernelFunc kernel = choose_select_kernel(
+        (int*) queryed_col->payload,
+        queryed_col->num_tuples,
+        low,
+        high,
+        NULL
+    );
+    result_col->num_tuples = kernel(
+        (int*) queryed_col->payload,
+        queryed_col->num_tuples,
+        is_range ? idx_col->first_row : 0,
+        low,
+        high,
+        positions
+    );
+    for (size_t idx = 0; !is_range && idx < result_col->num_tuples; idx++) {
+        positions[idx] = ((pos_t*) idx_col->payload)[positions[idx]];
     }
+    // the offsets are ascending so the positions keep their order
+    result_col->is_sorted = idx_col->is_sorted;
     // if no matches return
     if (result_col->num_tuples == 0) {
         free(positions);
@@ -625,8 +1626,334 @@ void select_from_selection(Comparator*comp, Result* idx_col, Result* result_col)
     // reallocate to the exact size of the column
     result_col->payload = (void*) realloc(
         positions,
-        sizeof(size_t) * result_col->num_tuples
+        sizeof(pos_t) * result_col->num_tuples
+    );
+}
+
+/// ***************************************************************************
+/// Conjunctive Selection
+/// ***************************************************************************
+
+// one range predicate of a conjunctive select
+typedef struct ConjunctPredicate {
+    Comparator* comp;
+    Column* col;
+    int low;
+    int high;
+    double selectivity;
+    SelectKernelFunc kernel;    // the kernel when the predicate leads a zone
+} ConjunctPredicate;
+
+typedef struct ConjunctScanArg {
+    ConjunctPredicate* preds;
+    size_t num_preds;
+    size_t num_rows;
+    pos_t* positions;
+    size_t num_morsels;
+    size_t* morsel_counts;
+    size_t next_morsel;
+} ConjunctScanArg;
+
+/**
+ * @brief This function keeps the positions whose value passes a predicate
+ *  (in place and without branches)
+ *
+ * @param pred - the predicate
+ * @param positions - the candidate positions
+ * @param num_positions
+ *
+ * @return the number of positions kept
+ */
+size_t filter_positions(ConjunctPredicate* pred, pos_t* positions, size_t num_positions) {
+    int low = pred->low;
+    int high = pred->high;
+    size_t num_kept = 0;
+    if (pred->col->compressed == NULL) {
+        const int* data = pred->col->data;
+        for (size_t i = 0; i < num_positions; i++) {
+            int value = data[positions[i]];
+            positions[num_kept] = positions[i];
+            num_kept += (value >= low) & (value < high);
+        }
+        return num_kept;
+    }
+    // compressed columns decode the candidates a block at a time
+    int values[UNPACK_BLOCK_SZ];
+    for (size_t start = 0; start < num_positions; start += UNPACK_BLOCK_SZ) {
+        size_t count = MIN(UNPACK_BLOCK_SZ, num_positions - start);
+        compressed_fetch(pred->col->compressed, &positions[start], count, values);
+        for (size_t i = 0; i < count; i++) {
+            positions[num_kept] = positions[start + i];
+            num_kept += (values[i] >= low) & (values[i] < high);
+        }
+    }
+    return num_kept;
+}
+
+/**
+ * @brief This function evaluates every predicate over a range of zones.
+ *  The zone maps decide which predicates a zone needs: a zone is skipped
+ *  if any predicate excludes it, and predicates that hold for the whole
+ *  zone are not checked. The most selective remaining predicate scans the
+ *  zone and the others only filter its matches.
+ *
+ * @param preds - the predicates (most selective first)
+ * @param num_preds
+ * @param num_rows - the number of rows in the table
+ * @param first_zone - the first zone to scan
+ * @param last_zone - one past the last zone to scan
+ * @param buffer - room for ZONE_SZ values (to decode compressed zones)
+ * @param positions - output
+ *
+ * @return the number of matches
+ */
+size_t conjunct_select_zones(
+    ConjunctPredicate* preds,
+    size_t num_preds,
+    size_t num_rows,
+    size_t first_zone,
+    size_t last_zone,
+    int* buffer,
+    pos_t* positions
+) {
+    size_t num_found = 0;
+    bool needed[num_preds];
+    for (size_t zone_idx = first_zone; zone_idx < last_zone; zone_idx++) {
+        size_t start = zone_idx * ZONE_SZ;
+        size_t zone_rows = MIN(ZONE_SZ, num_rows - start);
+        bool skip = false;
+        for (size_t i = 0; i < num_preds && !skip; i++) {
+            ZoneCheck check = zone_map_check(preds[i].col->zone_map, zone_idx,
+                                             preds[i].low, preds[i].high);
+            skip = check == ZONE_NONE;
+            needed[i] = check == ZONE_SOME;
+        }
+        if (skip) {
+            continue;
+        }
+        size_t lead = 0;
+        while (lead < num_preds && !needed[lead]) {
+            lead++;
+        }
+        pos_t* zone_positions = &positions[num_found];
+        size_t zone_found;
+        if (lead == num_preds) {
+            for (size_t i = 0; i < zone_rows; i++) {
+                zone_positions[i] = start + i;
+            }
+            zone_found = zone_rows;
+        } else {
+            const int* values = &preds[lead].col->data[start];
+            if (preds[lead].col->compressed != NULL) {
+                decompress_range(preds[lead].col->compressed, start, zone_rows, buffer);
+                values = buffer;
+            }
+            zone_found = preds[lead].kernel(values, zone_rows, start,
+                                            preds[lead].low, preds[lead].high,
+                                            zone_positions);
+        }
+        for (size_t i = lead + 1; i < num_preds && zone_found > 0; i++) {
+            if (needed[i]) {
+                zone_found = filter_positions(&preds[i], zone_positions, zone_found);
+            }
+        }
+        num_found += zone_found;
+    }
+    return num_found;
+}
+
+/**
+ * @brief Worker for a morsel driven conjunctive select
+ *
+ * @param scan_arg - ConjunctScanArg*
+ */
+void* conjunct_scan_worker(void* scan_arg) {
+    ConjunctScanArg* arg = (ConjunctScanArg*) scan_arg;
+    size_t num_zones = NUM_ZONES(arg->num_rows);
+    int* buffer = malloc(sizeof(int) * ZONE_SZ);
+    size_t morsel;
+    while ((morsel = __sync_fetch_and_add(&arg->next_morsel, 1)) < arg->num_morsels) {
+        size_t first_zone = morsel * MORSEL_ZONES;
+        arg->morsel_counts[morsel] = conjunct_select_zones(
+            arg->preds,
+            arg->num_preds,
+            arg->num_rows,
+            first_zone,
+            MIN(first_zone + MORSEL_ZONES, num_zones),
+            buffer,
+            &arg->positions[morsel * MORSEL_SZ]
+        );
+    }
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * @brief This function compares predicates by their selectivity (qsort)
+ */
+int compare_conjunct_predicates(const void* a, const void* b) {
+    double sel_a = ((const ConjunctPredicate*) a)->selectivity;
+    double sel_b = ((const ConjunctPredicate*) b)->selectivity;
+    return (sel_a > sel_b) - (sel_a < sel_b);
+}
+
+/**
+ * @brief This function processes a conjunctive select. All predicates are
+ *  evaluated in one pass over the table (most selective first), so no
+ *  intermediate positions or fetched values are materialized. If the cost
+ *  model prefers the index of the most selective predicate over a scan the
+ *  index finds the candidates instead.
+ *
+ * @param ms_op
+ * @param context
+ * @param status
+ */
+void process_multi_select(MultiSelectOperator* ms_op, ClientContext* context, Status* status) {
+    size_t num_preds = ms_op->num_predicates;
+    ConjunctPredicate* preds = malloc(sizeof(ConjunctPredicate) * num_preds);
+    for (size_t i = 0; i < num_preds; i++) {
+        ConjunctPredicate* pred = &preds[i];
+        pred->comp = &ms_op->comparators[i];
+        pred->col = pred->comp->gen_col->column_pointer.column;
+        comparator_int_bounds(pred->comp, &pred->low, &pred->high);
+        compress_loaded_column(pred->col);
+        if (pred->col->compressed == NULL) {
+            zone_map_refresh(pred->col->zone_map, pred->col->data, *pred->col->size_ptr);
+        }
+        pred->selectivity = histogram_selectivity(
+            column_histogram(pred->col),
+            pred->low,
+            pred->high
+        );
+        pred->kernel = select_method_kernel(choose_select_method(pred->selectivity));
+    }
+    qsort(preds, num_preds, sizeof(ConjunctPredicate), &compare_conjunct_predicates);
+    cs165_log(stdout, "-- conjunctive select of %zu predicates, leading %.4f\n",
+              num_preds, preds[0].selectivity);
+
+    Result* result_col = calloc(1, sizeof(Result));
+    result_col->data_type = INDEX;
+    size_t num_rows = *preds[0].col->size_ptr;
+    pos_t* positions = NULL;
+    if (preds[0].col->compressed == NULL &&
+            choose_access_path(preds[0].col, preds[0].low, preds[0].high) != ACCESS_SCAN) {
+        // the index finds the candidates, the rest filter them
+        select_from_col(preds[0].comp, result_col);
+        materialize_positions(result_col);
+        positions = (pos_t*) result_col->payload;
+        for (size_t i = 1; i < num_preds && result_col->num_tuples > 0; i++) {
+            result_col->num_tuples = filter_positions(&preds[i], positions,
+                                                      result_col->num_tuples);
+        }
+    } else {
+        positions = malloc(sizeof(pos_t) * MAX(num_rows, 1));
+        result_col->is_sorted = true;
+        size_t num_workers = num_scan_workers(num_rows);
+        ConjunctScanArg arg = {
+            .preds = preds,
+            .num_preds = num_preds,
+            .num_rows = num_rows,
+            .positions = positions,
+            .num_morsels = (num_rows + MORSEL_SZ - 1) / MORSEL_SZ,
+            .next_morsel = 0
+        };
+        arg.morsel_counts = malloc(sizeof(size_t) * MAX(arg.num_morsels, 1));
+        TaskGroup task_group;
+        task_group_init(&task_group);
+        for (size_t i = 1; i < num_workers; i++) {
+            thread_pool_submit(&task_group, &conjunct_scan_worker, (void*) &arg);
+        }
+        conjunct_scan_worker(&arg);
+        task_group_wait(&task_group);
+        result_col->num_tuples = compact_morsels(positions, arg.morsel_counts,
+                                                 arg.num_morsels);
+        free(arg.morsel_counts);
+    }
+
+    // if no matches return
+    if (result_col->num_tuples == 0) {
+        free(positions);
+        result_col->payload = NULL;
+    } else {
+        result_col->payload = (void*) realloc(
+            positions,
+            sizeof(pos_t) * result_col->num_tuples
+        );
+    }
+    GeneralizedColumnHandle* gcol_handle = add_result_column(context, ms_op->handle);
+    gcol_handle->generalized_column.column_pointer.result = result_col;
+    gcol_handle->generalized_column.column_type = RESULT;
+
+    for (size_t i = 0; i < num_preds; i++) {
+        free(ms_op->comparators[i].gen_col);
+    }
+    free(ms_op->comparators);
+    free(preds);
+    status->msg_type = OK_DONE;
+}
+
+/// ***************************************************************************
+/// Recycled Selection
+/// ***************************************************************************
+
+/**
+ * @brief This function narrows a copy of a wider selection down to
+ *  low <= col < high (the result becomes a position list)
+ *
+ * @param col - the selected column
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param result_col - the wider selection (updated in place)
+ */
+void refine_selection(Column* col, int low, int high, Result* result_col) {
+    // bitmaps and ranges are in position order
+    if (result_col->data_type == BITMAP || result_col->is_contiguous) {
+        materialize_positions(result_col);
+        result_col->is_sorted = true;
+    }
+    ConjunctPredicate pred = { .col = col, .low = low, .high = high };
+    result_col->num_tuples = filter_positions(
+        &pred,
+        (pos_t*) result_col->payload,
+        result_col->num_tuples
     );
+    if (result_col->num_tuples == 0) {
+        free(result_col->payload);
+        result_col->payload = NULL;
+    }
+}
+
+/**
+ * @brief This function answers a select on a column from the recycler if
+ *  it can - an exact hit is copied, a cached selection of a wider range is
+ *  filtered - and otherwise runs the select and offers the result to it
+ *
+ * @param comp
+ * @param result_col
+ */
+void select_from_col_recycled(Comparator* comp, Result* result_col) {
+    Column* col = comp->gen_col->column_pointer.column;
+    int low, high;
+    comparator_int_bounds(comp, &low, &high);
+
+    bool exact = false;
+    RecycleEntry* entry = recycler_find_select(col, low, high, &exact);
+    if (entry && exact) {
+        recycler_copy_result(entry, result_col);
+        return;
+    }
+    if (entry) {
+        cs165_log(stdout, "-- select [%d, %d) refines recycled [%d, %d)\n",
+                  low, high, entry->low, entry->high);
+        recycler_copy_result(entry, result_col);
+        refine_selection(col, low, high, result_col);
+    } else {
+        select_from_col(comp, result_col);
+    }
+    // a scan has to be redone in full, an index only finds the matches
+    double cost = col->index_type == NONE
+        ? (double) *col->size_ptr : (double) result_col->num_tuples + 1;
+    result_col->recycle_id = recycler_add_select(col, low, high, result_col, cost);
 }
 
 /**
@@ -643,7 +1970,7 @@ void process_select(SelectOperator* select_op, ClientContext* context, Status* s
         select_op->comparator.handle
     );
     // this is the result column
-    Result* result_col = malloc(sizeof(Result));
+    Result* result_col = calloc(1, sizeof(Result));
     result_col->data_type = INDEX;
     if (select_op->pos_col) {
         assert(select_op->comparator.gen_col->column_type == RESULT);
@@ -651,7 +1978,8 @@ void process_select(SelectOperator* select_op, ClientContext* context, Status* s
     } else {
         // assert that the column will be a result column
         assert(select_op->comparator.gen_col->column_type == COLUMN);
-        select_from_col(&select_op->comparator, result_col);
+        compress_loaded_column(select_op->comparator.gen_col->column_pointer.column);
+        select_from_col_recycled(&select_op->comparator, result_col);
     }
     // set the resulting column
     gcol_handle->generalized_column.column_pointer.result = result_col;
@@ -659,7 +1987,6 @@ void process_select(SelectOperator* select_op, ClientContext* context, Status* s
     status->msg_type = OK_DONE;
 }
 
-
 /// ***************************************************************************
 /// Fetching Functions
 /// ***************************************************************************
@@ -674,18 +2001,201 @@ void process_select(SelectOperator* select_op, ClientContext* context, Status* s
  */
 void process_fetch(FetchOperator* fetch_op, ClientContext*context, Status* status) {
     GeneralizedColumnHandle* gcol_handle = add_result_column(context, fetch_op->handle);
-    Result* result_col = malloc(sizeof(Result));
+    Result* result_col = calloc(1, sizeof(Result));
+    gcol_handle->generalized_column.column_pointer.result = result_col;
+    gcol_handle->generalized_column.column_type = RESULT;
+    status->msg_type = OK_DONE;
+
+    // positions that came from the recycler may have been fetched before
+    size_t source_id = fetch_op->idx_col->recycle_id;
+    RecycleEntry* entry = source_id
+        ? recycler_find_fetch(fetch_op->from_col, source_id) : NULL;
+    if (entry) {
+        recycler_copy_result(entry, result_col);
+        return;
+    }
+    CompressedColumn* compressed = fetch_op->from_col->compressed;
+    if (fetch_op->idx_col->is_contiguous && compressed == NULL) {
+        // a range of a raw column is already laid out as the result, so
+        // the result just points at it (no copy and nothing to recycle)
+        make_view(result_col, fetch_op->from_col,
+                  fetch_op->idx_col->first_row, fetch_op->idx_col->num_tuples);
+        return;
+    }
     result_col->data_type = INT;
     result_col->num_tuples = fetch_op->idx_col->num_tuples;
     int* values = malloc(sizeof(int) * result_col->num_tuples);
-    for (size_t i = 0; i < result_col->num_tuples; i++) {
-        values[i] = fetch_op->from_col->data[
-            ((size_t*) fetch_op->idx_col->payload)[i]
-        ];
+    if (fetch_op->idx_col->is_contiguous) {
+        decompress_range(compressed, fetch_op->idx_col->first_row,
+                         result_col->num_tuples, values);
+    } else if (compressed != NULL && fetch_op->idx_col->data_type == BITMAP) {
+        compressed_fetch_bitmap(compressed, fetch_op->idx_col->payload,
+                                fetch_op->idx_col->capacity, values);
+    } else if (compressed != NULL) {
+        compressed_fetch(compressed, fetch_op->idx_col->payload,
+                         result_col->num_tuples, values);
+    } else if (fetch_op->idx_col->data_type == BITMAP) {
+        // walk the set bits one word at a time
+        uint32_t* bitmap = (uint32_t*) fetch_op->idx_col->payload;
+        size_t num_words = BITMAP_WORDS(fetch_op->idx_col->capacity);
+        size_t i = 0;
+        for (size_t word_idx = 0; word_idx < num_words; word_idx++) {
+            uint32_t word = bitmap[word_idx];
+            int* word_data = &fetch_op->from_col->data[word_idx * BIT_SZ];
+            while (word) {
+                values[i++] = word_data[__builtin_ctz(word)];
+                word &= word - 1;
+            }
+        }
+    } else {
+        // positions from an unclustered index come in value order
+        gather_values(
+            fetch_op->from_col->data,
+            (pos_t*) fetch_op->idx_col->payload,
+            result_col->num_tuples,
+            fetch_op->idx_col->is_sorted,
+            values
+        );
     }
     result_col->payload = values;
-    gcol_handle->generalized_column.column_pointer.result = result_col;
-    gcol_handle->generalized_column.column_type = RESULT;
+    if (source_id) {
+        result_col->recycle_id = recycler_add_fetch(
+            fetch_op->from_col,
+            source_id,
+            result_col,
+            (double) result_col->num_tuples
+        );
+    }
+}
+
+
+// positions gathered by every column of a multi-column fetch before moving
+// on (small enough to stay in the L1 cache)
+#define MULTI_FETCH_BLOCK_SZ 1024
+
+/**
+ * @brief This function gathers one block of positions for every column of
+ *  a multi-column fetch that still needs values
+ *
+ * @param mf_op
+ * @param values - the output of each column (NULL once a column is done)
+ * @param positions - the block
+ * @param num_positions
+ * @param offset - where the block starts in the outputs
+ * @param sorted - whether the positions are ascending
+ */
+void multi_fetch_block(
+    MultiFetchOperator* mf_op,
+    int** values,
+    const pos_t* positions,
+    size_t num_positions,
+    size_t offset,
+    bool sorted
+) {
+    for (size_t i = 0; i < mf_op->num_cols; i++) {
+        if (values[i] == NULL) {
+            continue;
+        }
+        Column* col = mf_op->from_cols[i];
+        if (col->compressed != NULL) {
+            compressed_fetch(col->compressed, positions, num_positions,
+                             &values[i][offset]);
+        } else {
+            gather_values(col->data, positions, num_positions, sorted,
+                          &values[i][offset]);
+        }
+    }
+}
+
+/**
+ * @brief This function fetches several columns at the same positions. The
+ *  positions are read once, a block at a time, and every column gathers
+ *  from the block while it is in cache. Columns that are recycled or can be
+ *  views of a range don't take part in the pass.
+ *
+ * @param mf_op
+ * @param context
+ * @param status
+ */
+void process_multi_fetch(MultiFetchOperator* mf_op, ClientContext* context, Status* status) {
+    Result* idx_col = mf_op->idx_col;
+    size_t num_tuples = idx_col->num_tuples;
+    size_t source_id = idx_col->recycle_id;
+    Result** results = malloc(sizeof(Result*) * mf_op->num_cols);
+    int** values = calloc(mf_op->num_cols, sizeof(int*));
+    size_t num_pending = 0;
+
+    for (size_t i = 0; i < mf_op->num_cols; i++) {
+        Column* col = mf_op->from_cols[i];
+        results[i] = calloc(1, sizeof(Result));
+        RecycleEntry* entry = source_id ? recycler_find_fetch(col, source_id) : NULL;
+        if (entry) {
+            recycler_copy_result(entry, results[i]);
+        } else if (idx_col->is_contiguous && col->compressed == NULL) {
+            make_view(results[i], col, idx_col->first_row, num_tuples);
+        } else {
+            results[i]->data_type = INT;
+            results[i]->num_tuples = num_tuples;
+            results[i]->payload = malloc(sizeof(int) * MAX(num_tuples, 1));
+            if (idx_col->is_contiguous) {
+                decompress_range(col->compressed, idx_col->first_row,
+                                 num_tuples, results[i]->payload);
+            } else {
+                values[i] = results[i]->payload;
+                num_pending++;
+            }
+        }
+    }
+
+    if (num_pending > 0 && idx_col->data_type == BITMAP) {
+        // turn the bitmap into positions a block of words at a time
+        pos_t block[MULTI_FETCH_BLOCK_SZ];
+        uint32_t* bitmap = (uint32_t*) idx_col->payload;
+        size_t num_words = BITMAP_WORDS(idx_col->capacity);
+        size_t block_words = MULTI_FETCH_BLOCK_SZ / BIT_SZ;
+        size_t offset = 0;
+        for (size_t word_idx = 0; word_idx < num_words; word_idx += block_words) {
+            size_t num_bits = MIN(block_words, num_words - word_idx) * BIT_SZ;
+            size_t num_found = bitmap_to_positions(&bitmap[word_idx], num_bits, block);
+            for (size_t j = 0; j < num_found; j++) {
+                block[j] += word_idx * BIT_SZ;
+            }
+            multi_fetch_block(mf_op, values, block, num_found, offset, true);
+            offset += num_found;
+        }
+    } else if (num_pending > 0) {
+        pos_t* positions = (pos_t*) idx_col->payload;
+        for (size_t start = 0; start < num_tuples; start += MULTI_FETCH_BLOCK_SZ) {
+            multi_fetch_block(
+                mf_op,
+                values,
+                &positions[start],
+                MIN(MULTI_FETCH_BLOCK_SZ, num_tuples - start),
+                start,
+                idx_col->is_sorted
+            );
+        }
+    }
+
+    // the handles are only replaced at the end as one of them can be the
+    // handle of the positions
+    for (size_t i = 0; i < mf_op->num_cols; i++) {
+        if (values[i] != NULL && source_id) {
+            results[i]->recycle_id = recycler_add_fetch(
+                mf_op->from_cols[i],
+                source_id,
+                results[i],
+                (double) num_tuples
+            );
+        }
+        GeneralizedColumnHandle* gcol_handle = add_result_column(context, mf_op->handles[i]);
+        gcol_handle->generalized_column.column_pointer.result = results[i];
+        gcol_handle->generalized_column.column_type = RESULT;
+    }
+    free(values);
+    free(results);
+    free(mf_op->from_cols);
+    free(mf_op->handles);
     status->msg_type = OK_DONE;
 }
 
@@ -705,28 +2215,55 @@ void process_fetch(FetchOperator* fetch_op, ClientContext*context, Status* statu
  */
 long int calculate_sum(DataType data_type, void* data, size_t data_size) {
     long int sum = 0;
-    DataPtr data_ptr = { .void_array = data };
     switch (data_type) {
         case INT:
-            for (size_t i = 0; i < data_size; i++) {
-                sum += data_ptr.int_array[i];
-            }
-            break;
         case DOUBLE:
-            for (size_t i = 0; i < data_size; i++) {
-                sum += data_ptr.double_array[i];
-            }
-            break;
         case LONG:
-            for (size_t i = 0; i < data_size; i++) {
-                sum += data_ptr.long_array[i];
+        case INDEX:
+            sum = aggregate_sum(data_type, data, data_size);
+            break;
+        case BITMAP:
+            // data_size is the number of set bits so we stop once we
+            // have seen all of them
+            for (size_t word_idx = 0, found = 0; found < data_size; word_idx++) {
+                uint32_t word = ((uint32_t*) data)[word_idx];
+                while (word) {
+                    sum += word_idx * BIT_SZ + __builtin_ctz(word);
+                    word &= word - 1;
+                    found++;
+                }
             }
+            break;
         default:
             break;
     }
     return sum;
 }
 
+/**
+ * @brief This function sums the rows [first_row, first_row + num_items) of
+ *  a raw column. The columns of a clustered table keep prefix sums (built
+ *  the first time they are summed) so that this is two lookups.
+ *
+ * @param col - a column that isn't compressed
+ * @param first_row
+ * @param num_items
+ *
+ * @return the sum
+ */
+static long column_range_sum(Column* col, size_t first_row, size_t num_items) {
+    if (CLUSTERED_PREFIX_SUMS && col->table->primary_index != NULL) {
+        if (col->prefix_sums == NULL) {
+            col->prefix_sums = create_prefix_sums(col->table->table_length);
+        }
+        if (col->prefix_sums != NULL) {
+            return prefix_sums_range(col->prefix_sums, col->data,
+                                     *col->size_ptr, first_row, num_items);
+        }
+    }
+    return calculate_sum(INT, (void*) &col->data[first_row], num_items);
+}
+
 /**
  * @brief This function sums and averages a column
  *
@@ -738,23 +2275,35 @@ long int calculate_sum(DataType data_type, void* data, size_t data_size) {
 void process_sum_avg(MathOperator* math_op, OperatorType op_type, ClientContext* context, Status* status) {
     long int* sum = malloc(sizeof(long int));
     size_t num_results = 0;
-    if (math_op->gcol1.column_type == RESULT) {
+    if (math_op->gcol1.column_type == RESULT &&
+            math_op->gcol1.column_pointer.result->is_contiguous &&
+            math_op->gcol1.column_pointer.result->data_type == INDEX) {
+        // the positions of a range form an arithmetic series
+        num_results = math_op->gcol1.column_pointer.result->num_tuples;
+        size_t first_row = math_op->gcol1.column_pointer.result->first_row;
+        *sum = num_results * first_row + num_results * (num_results - 1) / 2;
+    } else if (math_op->gcol1.column_type == RESULT &&
+            math_op->gcol1.column_pointer.result->view_column != NULL) {
+        // a view is a range of its column
+        Result* view = math_op->gcol1.column_pointer.result;
+        num_results = view->num_tuples;
+        *sum = column_range_sum(view->view_column, view->first_row, num_results);
+    } else if (math_op->gcol1.column_type == RESULT) {
         num_results = math_op->gcol1.column_pointer.result->num_tuples;
         *sum = calculate_sum(
             math_op->gcol1.column_pointer.result->data_type,
             math_op->gcol1.column_pointer.result->payload,
             num_results
         );
+    } else if (math_op->gcol1.column_pointer.column->compressed != NULL) {
+        num_results = *math_op->gcol1.column_pointer.column->size_ptr;
+        *sum = compressed_sum(math_op->gcol1.column_pointer.column->compressed);
     } else {
         num_results = *math_op->gcol1.column_pointer.column->size_ptr;
-        *sum = calculate_sum(
-            INT,
-            (void*) math_op->gcol1.column_pointer.column->data,
-            num_results
-        );
+        *sum = column_range_sum(math_op->gcol1.column_pointer.column, 0, num_results);
     }
     // allocate the result column
-    Result* result_col = malloc(sizeof(Result));
+    Result* result_col = calloc(1, sizeof(Result));
     GeneralizedColumnHandle* gcol_handle = add_result_column(context,
                                                              math_op->handle1);
     if (num_results > 0) {
@@ -872,7 +2421,7 @@ void process_col_op(
         return;
     }
 
-    Result* result_col = malloc(sizeof(Result));
+    Result* result_col = calloc(1, sizeof(Result));
     // Columns of the same length can be added
     if (math_op->gcol1.column_type == RESULT) {
         result_col->num_tuples = math_op->gcol1.column_pointer.result->num_tuples;
@@ -883,6 +2432,9 @@ void process_col_op(
             free(result_col);
             return;
         }
+        // position results are added as explicit positions
+        materialize_positions(math_op->gcol1.column_pointer.result);
+        materialize_positions(math_op->gcol2.column_pointer.result);
         combine_columns(
             op_type,
             result_col,
@@ -902,9 +2454,9 @@ void process_col_op(
         combine_columns(
             op_type,
             result_col,
-            math_op->gcol1.column_pointer.column->data,
+            column_data(math_op->gcol1.column_pointer.column),
             INT,
-            math_op->gcol2.column_pointer.column->data,
+            column_data(math_op->gcol2.column_pointer.column),
             INT
         );
     }
@@ -934,51 +2486,36 @@ void* single_col_bound(
     DataType data_type,
     void* data,
     size_t data_size
-) {
-    DataPtr data_ptr = { .void_array = data };
-    DataPtr result;
-    result.void_array = malloc(1 * type_to_size(data_type));
-    switch (data_type) {
-        case INT:
-            result.int_array[0] = data_ptr.int_array[0];
-            if (op_type == MAX) {
-                for (size_t i = 1; i < data_size; i++) {
-                    result.int_array[0] = MAX(result.int_array[0],
-                                              data_ptr.int_array[i]);
-                }
-            } else {
-                for (size_t i = 1; i < data_size; i++) {
-                    result.int_array[0] = MIN(result.int_array[0],
-                                              data_ptr.int_array[i]);
-                }
-            }
-            break;
-        case DOUBLE:
-            result.double_array[0] = data_ptr.double_array[0];
-            if (op_type == MAX) {
-                for (size_t i = 1; i < data_size; i++) {
-                    result.double_array[0] = MAX(result.double_array[0],
-                                              data_ptr.double_array[i]);
-                }
-            } else {
-                for (size_t i = 1; i < data_size; i++) {
-                    result.double_array[0] = MIN(result.double_array[0],
-                                              data_ptr.double_array[i]);
-                }
-            }
-            break;
+) {
+    DataPtr result;
+    result.void_array = malloc(1 * type_to_size(data_type));
+    switch (data_type) {
+        case INT:
+        case DOUBLE:
         case LONG:
-            result.long_array[0] = data_ptr.long_array[0];
-            if (op_type == MAX) {
-                for (size_t i = 1; i < data_size; i++) {
-                    result.long_array[0] = MAX(result.long_array[0],
-                                              data_ptr.long_array[i]);
+        case INDEX: {
+            // min and max come out of the same pass
+            Value min, max;
+            aggregate_min_max(data_type, data, data_size, &min, &max);
+            memcpy(result.void_array, op_type == MAX ? &max : &min, type_to_size(data_type));
+            break;
+        }
+        case BITMAP:
+            // the bits are in position order, so min is the first set bit
+            // and max the last one
+            result.void_array = realloc(result.void_array, sizeof(pos_t));
+            result.index_array[0] = 0;
+            for (size_t word_idx = 0, found = 0; found < data_size; word_idx++) {
+                uint32_t word = ((uint32_t*) data)[word_idx];
+                if (word == 0) {
+                    continue;
                 }
-            } else {
-                for (size_t i = 1; i < data_size; i++) {
-                    result.long_array[0] = MIN(result.long_array[0],
-                                               data_ptr.long_array[i]);
+                if (op_type != MAX) {
+                    result.index_array[0] = word_idx * BIT_SZ + __builtin_ctz(word);
+                    break;
                 }
+                result.index_array[0] = word_idx * BIT_SZ + (BIT_SZ - 1 - __builtin_clz(word));
+                found += __builtin_popcount(word);
             }
             break;
         default:
@@ -1002,16 +2539,50 @@ void get_range_value(
     Status* status
 ) {
     // sum the column
-    Result* result_col = malloc(sizeof(Result));
+    Result* result_col = calloc(1, sizeof(Result));
     result_col->num_tuples = 1;
-    if (math_op->gcol1.column_type == RESULT) {
-        result_col->data_type = math_op->gcol1.column_pointer.result->data_type;
+    if (math_op->gcol1.column_type == RESULT &&
+            math_op->gcol1.column_pointer.result->is_contiguous &&
+            math_op->gcol1.column_pointer.result->data_type == INDEX) {
+        // the bounds of a range are its ends
+        Result* range = math_op->gcol1.column_pointer.result;
+        result_col->data_type = INDEX;
+        result_col->payload = malloc(sizeof(pos_t));
+        *((pos_t*) result_col->payload) = op_type == MAX && range->num_tuples > 0
+            ? range->first_row + range->num_tuples - 1 : range->first_row;
+    } else if (math_op->gcol1.column_type == RESULT &&
+            math_op->gcol1.column_pointer.result->data_type != BITMAP &&
+            math_op->gcol1.column_pointer.result->num_tuples > 0) {
+        // both bounds come out of one pass, so the other one is kept with
+        // the result for a min or max that follows
+        Result* input = math_op->gcol1.column_pointer.result;
+        if (!input->has_bounds) {
+            aggregate_min_max(input->data_type, input->payload, input->num_tuples,
+                              &input->min_value, &input->max_value);
+            input->has_bounds = true;
+        }
+        result_col->data_type = input->data_type;
+        result_col->payload = malloc(type_to_size(input->data_type));
+        memcpy(result_col->payload,
+               op_type == MAX ? &input->max_value : &input->min_value,
+               type_to_size(input->data_type));
+    } else if (math_op->gcol1.column_type == RESULT) {
+        DataType data_type = math_op->gcol1.column_pointer.result->data_type;
+        // the bound of a bitmap is a position
+        result_col->data_type = data_type == BITMAP ? INDEX : data_type;
         result_col->payload = single_col_bound(
             op_type,
-            result_col->data_type,
+            data_type,
             math_op->gcol1.column_pointer.result->payload,
             math_op->gcol1.column_pointer.result->num_tuples
         );
+    } else if (math_op->gcol1.column_pointer.column->compressed != NULL) {
+        // the bounds of a compressed column are kept with it
+        CompressedColumn* compressed = math_op->gcol1.column_pointer.column->compressed;
+        result_col->data_type = INT;
+        result_col->payload = malloc(sizeof(int));
+        *((int*) result_col->payload) = op_type == MAX ?
+            compressed->max_value : compressed->min_value;
     } else {
         result_col->data_type = INT;
         result_col->payload = single_col_bound(
@@ -1185,8 +2756,8 @@ void get_index_and_range(
     Status* status
 ) {
     // sum the column
-    Result* result_col = malloc(sizeof(Result));
-    Result* result_indices = malloc(sizeof(Result));
+    Result* result_col = calloc(1, sizeof(Result));
+    Result* result_indices = calloc(1, sizeof(Result));
     result_indices->data_type = INDEX;
 
 
@@ -1196,6 +2767,8 @@ void get_index_and_range(
         assert(math_op->gcol1.column_pointer.result != NULL);
         assert(math_op->gcol2.column_pointer.result != NULL);
         assert(math_op->gcol2.column_pointer.result != NULL);
+        // we hand back positions so we need them explicitly
+        materialize_positions(math_op->gcol1.column_pointer.result);
         col_bound_and_index(
             op_type,
             math_op->gcol2.column_pointer.result->data_type,
@@ -1209,7 +2782,7 @@ void get_index_and_range(
         col_bound_and_index(
             op_type,
             INT,
-            (void*) math_op->gcol1.column_pointer.column->data,
+            (void*) column_data(math_op->gcol1.column_pointer.column),
             NULL,
             *math_op->gcol1.column_pointer.column->size_ptr,
             result_col,
@@ -1227,176 +2800,604 @@ void get_index_and_range(
     status->msg_type = OK_DONE;
 }
 
+/// ***************************************************************************
+/// Group By Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function returns the values of a generalized column as an
+ *  array. Ranges and bitmaps are turned into positions, compressed columns
+ *  are decoded into a copy.
+ *
+ * @param gcol
+ * @param data_type - set to the type of the values
+ * @param num_rows - set to the number of values
+ * @param owned - set to whether the caller has to free the array
+ *
+ * @return the values
+ */
+static void* group_input(GeneralizedColumn* gcol, DataType* data_type,
+                         size_t* num_rows, bool* owned) {
+    *owned = false;
+    if (gcol->column_type == RESULT) {
+        Result* result = gcol->column_pointer.result;
+        materialize_positions(result);
+        *data_type = result->data_type;
+        *num_rows = result->num_tuples;
+        return result->payload;
+    }
+    Column* col = gcol->column_pointer.column;
+    *data_type = INT;
+    *num_rows = *col->size_ptr;
+    if (col->compressed == NULL) {
+        return col->data;
+    }
+    int* data = malloc(sizeof(int) * MAX(*num_rows, 1));
+    decompress_range(col->compressed, 0, *num_rows, data);
+    *owned = true;
+    return data;
+}
+
+/**
+ * @brief This function groups the rows of a column by the values of another
+ *  and returns the distinct keys and the aggregate of each of them
+ *
+ * @param group_op
+ * @param context
+ * @param status
+ */
+void process_group(GroupOperator* group_op, ClientContext* context, Status* status) {
+    DataType key_type;
+    DataType value_type = INT;
+    size_t num_rows;
+    size_t num_values = 0;
+    bool keys_owned;
+    bool values_owned = false;
+    void* keys = group_input(&group_op->keys, &key_type, &num_rows, &keys_owned);
+    void* values = NULL;
+    if (group_op->aggregate != GROUP_COUNT) {
+        values = group_input(&group_op->values, &value_type, &num_values, &values_owned);
+    }
+    if ((key_type != INT && key_type != INDEX) ||
+            (values != NULL && value_type != INT && value_type != LONG &&
+             value_type != INDEX) ||
+            (values != NULL && num_values != num_rows)) {
+        status->code = ERROR;
+        status->msg_type = QUERY_UNSUPPORTED;
+        status->msg = "Group by needs integer keys and values of the same length";
+        if (keys_owned) {
+            free(keys);
+        }
+        if (values_owned) {
+            free(values);
+        }
+        return;
+    }
+    // positions are grouped as ints
+    if (key_type == INDEX) {
+        int* int_keys = malloc(sizeof(int) * MAX(num_rows, 1));
+        for (size_t i = 0; i < num_rows; i++) {
+            int_keys[i] = ((pos_t*) keys)[i];
+        }
+        keys = int_keys;
+        keys_owned = true;
+    }
+
+    GroupResult groups;
+    group_aggregate(group_op->aggregate, keys, value_type, values, num_rows, &groups);
+    if (keys_owned) {
+        free(keys);
+    }
+    if (values_owned) {
+        free(values);
+    }
+
+    // the keys keep their type
+    Result* key_result = calloc(1, sizeof(Result));
+    key_result->data_type = key_type;
+    key_result->num_tuples = key_result->capacity = groups.num_groups;
+    if (key_type == INDEX) {
+        pos_t* positions = malloc(sizeof(pos_t) * MAX(groups.num_groups, 1));
+        for (size_t i = 0; i < groups.num_groups; i++) {
+            positions[i] = groups.keys[i];
+        }
+        key_result->payload = positions;
+        free(groups.keys);
+    } else {
+        key_result->payload = groups.keys;
+    }
+
+    // sums and counts are longs, an average is a double and a min or max
+    // has the type of the values
+    Result* agg_result = calloc(1, sizeof(Result));
+    agg_result->num_tuples = agg_result->capacity = groups.num_groups;
+    switch (group_op->aggregate) {
+        case GROUP_COUNT:
+            agg_result->data_type = LONG;
+            agg_result->payload = groups.counts;
+            groups.counts = NULL;
+            break;
+        case GROUP_AVG: {
+            double* avgs = malloc(sizeof(double) * MAX(groups.num_groups, 1));
+            for (size_t i = 0; i < groups.num_groups; i++) {
+                avgs[i] = (double) groups.accs[i] / (double) groups.counts[i];
+            }
+            agg_result->data_type = DOUBLE;
+            agg_result->payload = avgs;
+            break;
+        }
+        case GROUP_MIN:
+        case GROUP_MAX:
+            agg_result->data_type = value_type;
+            if (value_type == LONG) {
+                agg_result->payload = groups.accs;
+                groups.accs = NULL;
+                break;
+            }
+            agg_result->payload = malloc(type_to_size(value_type) * MAX(groups.num_groups, 1));
+            for (size_t i = 0; i < groups.num_groups; i++) {
+                if (value_type == INDEX) {
+                    ((pos_t*) agg_result->payload)[i] = groups.accs[i];
+                } else {
+                    ((int*) agg_result->payload)[i] = groups.accs[i];
+                }
+            }
+            break;
+        default:
+            agg_result->data_type = LONG;
+            agg_result->payload = groups.accs;
+            groups.accs = NULL;
+            break;
+    }
+    free(groups.accs);
+    free(groups.counts);
+
+    GeneralizedColumnHandle* key_gcol = add_result_column(context, group_op->handle1);
+    key_gcol->generalized_column.column_pointer.result = key_result;
+    key_gcol->generalized_column.column_type = RESULT;
+    GeneralizedColumnHandle* agg_gcol = add_result_column(context, group_op->handle2);
+    agg_gcol->generalized_column.column_pointer.result = agg_result;
+    agg_gcol->generalized_column.column_type = RESULT;
+    status->msg_type = OK_DONE;
+}
+
 /// ***************************************************************************
 /// Join Functions
 /// ***************************************************************************
 
-/* #define JOIN_SIZE 256 */
-#define NUM_PARTITIONS 256
-#define PARTITION_BASE_NUM 4096
+// the build side of a partition should fit in the L2 cache
+#define JOIN_PARTITION_BYTES (256 << 10)
+// partitions a pass writes to at once (more would thrash the TLB)
+#define JOIN_MAX_PASS_BITS 6
+#define JOIN_MAX_PASSES 2
+// fibonacci hashing: the top bits of key * 2^32 / phi are well mixed
+#define JOIN_HASH_MULT 0x9E3779B1U
+// joins with at least this many rows (both sides) run on the thread pool
+#define PARALLEL_JOIN_MIN_ROWS (1 << 18)
+
+// the rows of both sides with the same radix bits (they point into the
+// partitioned arrays of the join)
 typedef struct JoinPartion {
     size_t l_sz;  // number of left values
-    size_t l_alloc;  // number of left values
     size_t r_sz;  // number of right values
-    size_t r_alloc;  // number of right values
     int* l_join_keys;
-    size_t* l_join_vals;
+    pos_t* l_join_vals;
     int* r_join_keys;
-    size_t* r_join_vals;
+    pos_t* r_join_vals;
 } JoinPartion;
 
+// one partition of a join, as a task. The build side goes into a hash
+// table that is kept between counting the matches and writing them.
+typedef struct JoinTask {
+    JoinPartion partition;
+    JoinHashTable table;    // (slots is NULL if nothing joins)
+    bool left_builds;       // whether the left side is in the table
+    size_t num_matches;
+    pos_t* l_out;           // where the partition writes its matches
+    pos_t* r_out;
+} JoinTask;
+
+// a slice of one side of a join for a radix pass
+typedef struct RadixTask {
+    const int* keys;
+    const pos_t* positions;
+    size_t first;
+    size_t last;
+    int* out_keys;
+    pos_t* out_positions;
+    unsigned shift;         // the bits below the ones of the pass
+    unsigned bits;
+    bool hashed;            // partition on hashed keys (joins) or on the
+    uint32_t key_base;      // bits of key - key_base (sorts)
+    // rows per partition, then where the slice writes them
+    size_t offsets[1 << JOIN_MAX_PASS_BITS];
+    size_t* part_starts;    // the partition offsets (a whole pass only)
+} RadixTask;
+
+// one side of a join: its keys and positions, stored by partition
+typedef struct JoinRelation {
+    int* keys;
+    pos_t* positions;
+    size_t num_rows;
+    size_t* part_starts;    // 2^radix_bits + 1 offsets
+} JoinRelation;
 
 /**
- * @brief Function to initialize a partition
+ * @brief This function returns the radix bits of a key. The keys are hashed
+ *  first so strided or clustered keys still spread over the partitions.
  *
- * @param partitions[]
+ * @param key
+ * @param shift - the bits below the ones wanted
+ * @param mask - (1 << bits) - 1
+ *
+ * @return the partition of the key
  */
-void init_partitions(JoinPartion* partitions) {
-    for (size_t i = 0; i < NUM_PARTITIONS; i++) {
-        partitions[i].l_sz = partitions[i].r_sz = 0;
-        partitions[i].l_alloc = partitions[i].r_alloc = PARTITION_BASE_NUM;
-        partitions[i].l_join_keys = malloc(PARTITION_BASE_NUM * sizeof(int));
-        partitions[i].l_join_vals = malloc(PARTITION_BASE_NUM * sizeof(size_t));
-        partitions[i].r_join_keys = malloc(PARTITION_BASE_NUM * sizeof(int));
-        partitions[i].r_join_vals = malloc(PARTITION_BASE_NUM * sizeof(size_t));
-    }
+static inline size_t join_radix(int key, unsigned shift, size_t mask) {
+    // (widened so that a shift of 32 for zero bits is defined)
+    return (size_t) (((uint64_t) ((uint32_t) key * JOIN_HASH_MULT)) >> shift) & mask;
 }
 
+/**
+ * @brief This function returns the digit of a key for a radix pass. Sorts
+ *  use the key minus the smallest key, so the digits come in key order and
+ *  the bits above the range of the keys are never sorted on.
+ *
+ * @param task
+ * @param key
+ * @param mask - (1 << bits) - 1
+ *
+ * @return the partition of the key
+ */
+static inline size_t radix_digit(const RadixTask* task, int key, size_t mask) {
+    if (task->hashed) {
+        return join_radix(key, task->shift, mask);
+    }
+    return (size_t) (((uint32_t) key - task->key_base) >> task->shift) & mask;
+}
 
 /**
- * @brief Function that partitions the data into two sets
+ * @brief This function picks the number of radix bits: enough that the
+ *  build (smaller) side of an average partition fits in the cache, at most
+ *  JOIN_MAX_PASS_BITS per pass
  *
- * @param partitions[]
- * @param left_vals
- * @param left_pos
  * @param num_left
- * @param right_vals
- * @param right_pos
  * @param num_right
+ *
+ * @return the total number of bits
  */
-void partition_data(
-    JoinPartion* partitions,
-    int* left_vals,
-    size_t* left_pos,
-    size_t num_left,
-    int* right_vals,
-    size_t* right_pos,
-    size_t num_right
-) {
-    // to partition data we will just
-    // make join partitions - these will be used to join the data
-    for (size_t i = 0; i < num_left; i++) {
-        unsigned partition_loc = ((unsigned int) left_vals[i]) % NUM_PARTITIONS;
-        JoinPartion* partition = &partitions[partition_loc];
-        if (partition->l_sz == partition->l_alloc) {
-            partition->l_alloc *= 2;
-            partition->l_join_keys = realloc(partition->l_join_keys,
-                                             partition->l_alloc * sizeof(int));
-            partition->l_join_vals = realloc(partition->l_join_vals,
-                                             partition->l_alloc * sizeof(size_t));
-        }
-        partition->l_join_keys[partition->l_sz] = left_vals[i];
-        partition->l_join_vals[partition->l_sz++] = left_pos[i];
-
+static unsigned join_radix_bits(size_t num_left, size_t num_right) {
+    size_t build_bytes = MIN(num_left, num_right) * (sizeof(int) + sizeof(pos_t));
+    unsigned bits = 0;
+    while ((build_bytes >> bits) > JOIN_PARTITION_BYTES &&
+            bits < JOIN_MAX_PASS_BITS * JOIN_MAX_PASSES) {
+        bits++;
     }
-    for (size_t i = 0; i < num_right; i++) {
-        unsigned partition_loc = ((unsigned int) right_vals[i]) % NUM_PARTITIONS;
-        JoinPartion* partition = &partitions[partition_loc];
-        if (partition->r_sz == partition->r_alloc) {
-            partition->r_alloc *= 2;
-            partition->r_join_keys = realloc(partition->r_join_keys,
-                                             partition->r_alloc * sizeof(int));
-            partition->r_join_vals = realloc(partition->r_join_vals,
-                                             partition->r_alloc * sizeof(size_t));
-        }
-        partition->r_join_keys[partition->r_sz] = right_vals[i];
-        partition->r_join_vals[partition->r_sz++] = right_pos[i];
+    return bits;
+}
+
+/**
+ * @brief This function counts the rows of a slice that go to each
+ *  partition of a radix pass
+ *
+ * @param task
+ */
+static void radix_histogram(RadixTask* task) {
+    size_t mask = ((size_t) 1 << task->bits) - 1;
+    memset(task->offsets, 0, sizeof(task->offsets));
+    for (size_t i = task->first; i < task->last; i++) {
+        task->offsets[radix_digit(task, task->keys[i], mask)]++;
     }
 }
 
 /**
- * @brief This function increases the size of a result array
- *      TODO: make it so the function can increase using an actual
- *      result from the database
+ * @brief This function copies the rows of a slice to their partitions,
+ *  starting at the offsets of the slice
  *
- * @param result
+ * @param task
  */
-void increase_result_array(Result *result) {
-    result->capacity *= 2;
-    result->payload = realloc(result->payload, sizeof(size_t) * result->capacity);
+static void radix_scatter(RadixTask* task) {
+    size_t mask = ((size_t) 1 << task->bits) - 1;
+    for (size_t i = task->first; i < task->last; i++) {
+        size_t dest = task->offsets[radix_digit(task, task->keys[i], mask)]++;
+        task->out_keys[dest] = task->keys[i];
+        task->out_positions[dest] = task->positions[i];
+    }
 }
 
-// TODO unused
-void add_to_results(Result* result, size_t value) {
-    if (result->num_tuples == result->capacity) {
-        increase_result_array(result);
+/**
+ * @brief This function does a whole radix pass over the rows of a task: a
+ *  histogram sizes every partition exactly, then the rows are scattered to
+ *  their partition in the output arrays (starting at first). The
+ *  2^bits + 1 partition offsets are written to task->part_starts.
+ *
+ * @param task
+ */
+static void radix_pass(RadixTask* task) {
+    size_t num_parts = (size_t) 1 << task->bits;
+    radix_histogram(task);
+    size_t offset = task->first;
+    for (size_t p = 0; p < num_parts; p++) {
+        size_t count = task->offsets[p];
+        task->part_starts[p] = task->offsets[p] = offset;
+        offset += count;
     }
-    // add the value to the array
-    ((size_t*)result->payload)[result->num_tuples++] = value;
+    task->part_starts[num_parts] = task->last;
+    radix_scatter(task);
+}
+
+static void* radix_histogram_worker(void* task_arg) {
+    radix_histogram((RadixTask*) task_arg);
+    return NULL;
+}
+
+static void* radix_scatter_worker(void* task_arg) {
+    radix_scatter((RadixTask*) task_arg);
+    return NULL;
+}
+
+static void* radix_pass_worker(void* task_arg) {
+    radix_pass((RadixTask*) task_arg);
+    return NULL;
 }
 
 /**
- * @brief Function that partitions the dataset
+ * @brief This function returns how many slices the sides of a join are
+ *  partitioned in (1 means the calling thread does it all)
  *
- * @param partition
+ * @param num_rows - the rows of both sides
+ *
+ * @return the number of slices
  */
+static size_t join_parallelism(size_t num_rows) {
+    if (num_rows < PARALLEL_JOIN_MIN_ROWS) {
+        return 1;
+    }
+    return MAX(MIN(thread_pool_parallelism(), MAX_POOL_THREADS), 1);
+}
 
-void process_partition(JoinPartion* partition, Result* l_res, Result* r_res) {
-    // don't do anything if nothing is in the partition
-    if (partition->l_sz == 0 || partition->r_sz == 0) {
+/**
+ * @brief This function runs a function over an array of tasks, on the pool
+ *  if there is more than one slice. The pool hands every task to whichever
+ *  thread is free next, so a large partition doesn't hold up the others.
+ *
+ * @param func
+ * @param tasks - the array of tasks
+ * @param task_size - the size of one task
+ * @param num_tasks
+ * @param parallel - whether to use the pool
+ */
+static void run_join_tasks(TaskFunc func, void* tasks, size_t task_size,
+                           size_t num_tasks, bool parallel) {
+    char* task = (char*) tasks;
+    if (!parallel || num_tasks == 1) {
+        for (size_t t = 0; t < num_tasks; t++) {
+            func(task + t * task_size);
+        }
         return;
     }
-    ExtHashTable* ht = create_ext_hash_table();
-    size_t small_size;
-    int* big_keys = NULL;
-    size_t* big_pos = NULL;
-    Result* big_res = NULL;
-    size_t big_size;
-    int* small_keys = NULL;
-    size_t* small_pos = NULL;
-    Result* small_res = NULL;
-
-    // set the side
-    if (partition->l_sz <= partition->r_sz) {
-        // when the left side is smaller
-        small_size = partition->l_sz;
-        small_keys = partition->l_join_keys;
-        small_pos = partition->l_join_vals;
-        small_res = l_res;
-        big_size = partition->r_sz;
-        big_keys = partition->r_join_keys;
-        big_pos = partition->r_join_vals;
-        big_res = r_res;
-    } else {
-        // when the right_side is smaller side is bigger
-        small_size = partition->r_sz;
-        small_keys = partition->r_join_keys;
-        small_pos = partition->r_join_vals;
-        small_res = r_res;
-        big_size = partition->l_sz;
-        big_keys = partition->l_join_keys;
-        big_pos = partition->l_join_vals;
-        big_res = l_res;
+    TaskGroup group;
+    task_group_init(&group);
+    for (size_t t = 0; t < num_tasks; t++) {
+        thread_pool_submit(&group, func, task + t * task_size);
     }
+    task_group_wait(&group);
+}
 
-    // load smaller side into the hashtable
-    for (size_t i = 0; i < small_size; i++) {
-        ext_hash_table_put(ht, small_keys[i], small_pos[i]);
+/**
+ * @brief This function does a radix pass over all of the rows of a side in
+ *  slices. Each slice builds a histogram, then every slice writes its rows
+ *  of a partition after the rows of the slices before it (so no slice has
+ *  to lock or move anything). The pass is stable.
+ *
+ * @param keys
+ * @param positions
+ * @param num_rows
+ * @param out_keys
+ * @param out_positions
+ * @param shift - the bits below the ones of this pass
+ * @param bits - the bits of this pass
+ * @param hashed - whether the digits are of the hashed keys
+ * @param key_base - subtracted from the keys (if not hashed)
+ * @param part_starts - set to the 2^bits + 1 partition offsets
+ * @param num_slices
+ */
+static void parallel_radix_pass(
+    const int* keys,
+    const pos_t* positions,
+    size_t num_rows,
+    int* out_keys,
+    pos_t* out_positions,
+    unsigned shift,
+    unsigned bits,
+    bool hashed,
+    uint32_t key_base,
+    size_t* part_starts,
+    size_t num_slices
+) {
+    size_t num_parts = (size_t) 1 << bits;
+    RadixTask* tasks = malloc(sizeof(RadixTask) * num_slices);
+    size_t slice = (num_rows + num_slices - 1) / num_slices;
+    for (size_t t = 0; t < num_slices; t++) {
+        tasks[t].keys = keys;
+        tasks[t].positions = positions;
+        tasks[t].first = MIN(t * slice, num_rows);
+        tasks[t].last = MIN(tasks[t].first + slice, num_rows);
+        tasks[t].out_keys = out_keys;
+        tasks[t].out_positions = out_positions;
+        tasks[t].shift = shift;
+        tasks[t].bits = bits;
+        tasks[t].hashed = hashed;
+        tasks[t].key_base = key_base;
+        tasks[t].part_starts = NULL;
     }
-    // now query it
-    for (size_t i = 0; i < small_size; i++) {
-        HashResults* hres = ext_hash_func_get(ht, big_keys[i]);
-        for (size_t res_idx = 0; res_idx < hres->num_found; res_idx++) {
-            add_to_results(big_res, big_pos[i]);
-            add_to_results(small_res, hres->hb_results[res_idx]);
+    run_join_tasks(radix_histogram_worker, tasks, sizeof(RadixTask), num_slices, true);
+    size_t offset = 0;
+    for (size_t p = 0; p < num_parts; p++) {
+        part_starts[p] = offset;
+        for (size_t t = 0; t < num_slices; t++) {
+            size_t count = tasks[t].offsets[p];
+            tasks[t].offsets[p] = offset;
+            offset += count;
         }
-        free_hash_result(hres);
     }
-    free_ext_hash_table(ht);
+    part_starts[num_parts] = num_rows;
+    run_join_tasks(radix_scatter_worker, tasks, sizeof(RadixTask), num_slices, true);
+    free(tasks);
+}
+
+/**
+ * @brief This function radix partitions one side of a join. More bits than
+ *  a pass can write at once are split over two passes, the second one
+ *  refines every partition of the first (each one is a task).
+ *
+ * @param relation - set to the partitioned rows
+ * @param keys
+ * @param positions
+ * @param num_rows
+ * @param bits - the total number of radix bits
+ * @param num_slices - how many slices the first pass is split into
+ */
+static void radix_partition(
+    JoinRelation* relation,
+    const int* keys,
+    const pos_t* positions,
+    size_t num_rows,
+    unsigned bits,
+    size_t num_slices
+) {
+    size_t num_parts = (size_t) 1 << bits;
+    relation->num_rows = num_rows;
+    relation->keys = malloc(sizeof(int) * MAX(num_rows, 1));
+    relation->positions = malloc(sizeof(pos_t) * MAX(num_rows, 1));
+    relation->part_starts = malloc(sizeof(size_t) * (num_parts + 1));
+    if (bits <= JOIN_MAX_PASS_BITS) {
+        parallel_radix_pass(keys, positions, num_rows, relation->keys,
+                            relation->positions, 32 - bits, bits, true, 0,
+                            relation->part_starts, num_slices);
+        return;
+    }
+    unsigned first_bits = (bits + 1) / 2;
+    unsigned second_bits = bits - first_bits;
+    size_t num_first = (size_t) 1 << first_bits;
+    size_t first_starts[(1 << JOIN_MAX_PASS_BITS) + 1];
+    int* tmp_keys = malloc(sizeof(int) * MAX(num_rows, 1));
+    pos_t* tmp_positions = malloc(sizeof(pos_t) * MAX(num_rows, 1));
+    parallel_radix_pass(keys, positions, num_rows, tmp_keys, tmp_positions,
+                        32 - first_bits, first_bits, true, 0, first_starts,
+                        num_slices);
+    RadixTask* tasks = malloc(sizeof(RadixTask) * num_first);
+    for (size_t p = 0; p < num_first; p++) {
+        tasks[p].keys = tmp_keys;
+        tasks[p].positions = tmp_positions;
+        tasks[p].first = first_starts[p];
+        tasks[p].last = first_starts[p + 1];
+        tasks[p].out_keys = relation->keys;
+        tasks[p].out_positions = relation->positions;
+        tasks[p].shift = 32 - bits;
+        tasks[p].bits = second_bits;
+        tasks[p].hashed = true;
+        tasks[p].key_base = 0;
+        tasks[p].part_starts = &relation->part_starts[p << second_bits];
+    }
+    run_join_tasks(radix_pass_worker, tasks, sizeof(RadixTask), num_first,
+                   num_slices > 1);
+    free(tasks);
+    free(tmp_keys);
+    free(tmp_positions);
+}
+
+/**
+ * @brief This function frees the partitioned rows of one side of a join
+ *
+ * @param relation
+ */
+static void free_join_relation(JoinRelation* relation) {
+    free(relation->keys);
+    free(relation->positions);
+    free(relation->part_starts);
+}
+
+/**
+ * @brief This worker builds the hash table of a partition (from its smaller
+ *  side) and counts the matches of the other side. The table is kept for
+ *  join_write_worker.
+ *
+ * @param task_arg - a JoinTask
+ *
+ * @return NULL
+ */
+static void* join_count_worker(void* task_arg) {
+    JoinTask* task = (JoinTask*) task_arg;
+    JoinPartion* partition = &task->partition;
+    task->num_matches = 0;
+    task->table.slots = NULL;
+    // don't do anything if nothing is in the partition
+    if (partition->l_sz == 0 || partition->r_sz == 0) {
+        return NULL;
+    }
+    task->left_builds = partition->l_sz <= partition->r_sz;
+    size_t build_size = task->left_builds ? partition->l_sz : partition->r_sz;
+    int* build_keys = task->left_builds ? partition->l_join_keys : partition->r_join_keys;
+    pos_t* build_pos = task->left_builds ? partition->l_join_vals : partition->r_join_vals;
+    size_t probe_size = task->left_builds ? partition->r_sz : partition->l_sz;
+    int* probe_keys = task->left_builds ? partition->r_join_keys : partition->l_join_keys;
+
+    // load smaller side into the hashtable and count the matches
+    join_table_build(&task->table, build_keys, build_pos, build_size);
+    task->num_matches = join_table_count(&task->table, probe_keys, probe_size);
+    return NULL;
+}
+
+/**
+ * @brief This worker probes the table of a partition again and writes the
+ *  matches to the partition's share of the results
+ *
+ * @param task_arg - a JoinTask
+ *
+ * @return NULL
+ */
+static void* join_write_worker(void* task_arg) {
+    JoinTask* task = (JoinTask*) task_arg;
+    JoinPartion* partition = &task->partition;
+    if (task->table.slots == NULL) {
+        return NULL;
+    }
+    size_t probe_size = task->left_builds ? partition->r_sz : partition->l_sz;
+    int* probe_keys = task->left_builds ? partition->r_join_keys : partition->l_join_keys;
+    pos_t* probe_pos = task->left_builds ? partition->r_join_vals : partition->l_join_vals;
+    pos_t* build_out = task->left_builds ? task->l_out : task->r_out;
+    pos_t* probe_out = task->left_builds ? task->r_out : task->l_out;
+    join_table_probe(&task->table, probe_keys, probe_pos, probe_size,
+                     probe_out, build_out);
+    free_join_table(&task->table);
+    return NULL;
+}
+
+/**
+ * @brief This function makes a position result of a join and registers it
+ *
+ * @param context
+ * @param handle
+ * @param positions - the positions (owned by the result)
+ * @param num_results
+ */
+static void set_join_result(ClientContext* context, const char* handle,
+                            pos_t* positions, size_t num_results) {
+    Result* result_column = calloc(1, sizeof(Result));
+    result_column->data_type = INDEX;
+    result_column->num_tuples = num_results;
+    result_column->capacity = num_results;
+    result_column->payload = positions;
+    GeneralizedColumnHandle* gcol = add_result_column(context, handle);
+    gcol->generalized_column.column_pointer.result = result_column;
+    gcol->generalized_column.column_type = RESULT;
 }
 
 /**
- * @brief This function performs a hash join of two columns
+ * @brief This function performs a hash join of two columns. Both sides are
+ *  radix partitioned, then every partition is joined as a task in two
+ *  phases: the matches are counted first, so that after a prefix sum each
+ *  partition writes its matches straight into its share of the results.
  *
  * @param join_op - the struct containing the join stuff
  * @param context - the client context (for returning)
@@ -1409,7 +3410,7 @@ void process_hash_join(
 ) {
 
     int* left_values = (int*) join_op->col1_values->payload;
-    size_t* left_pos = (size_t*) join_op->col1_positions->payload;
+    pos_t* left_pos = (pos_t*) join_op->col1_positions->payload;
     assert(join_op->col1_values->num_tuples ==
             join_op->col1_positions->num_tuples);
     size_t num_left = join_op->col1_values->num_tuples;
@@ -1417,67 +3418,326 @@ void process_hash_join(
 
     // this should also hold true
     int* right_values = (int*) join_op->col2_values->payload;
-    size_t* right_pos = (size_t*) join_op->col2_positions->payload;
+    pos_t* right_pos = (pos_t*) join_op->col2_positions->payload;
     assert(join_op->col2_values->num_tuples ==
             join_op->col2_positions->num_tuples);
     size_t num_right = join_op->col2_values->num_tuples;
 
-    JoinPartion* partitions = malloc(NUM_PARTITIONS * sizeof(JoinPartion));
-    init_partitions(partitions);
-    // partition the data
-    partition_data(
-        partitions,
-        left_values,
-        left_pos,
-        num_left,
-        right_values,
-        right_pos,
-        num_right
-    );
+    // both sides are partitioned on the same radix bits so partition i of
+    // the left only joins with partition i of the right
+    size_t num_slices = join_parallelism(num_left + num_right);
+    unsigned radix_bits = join_radix_bits(num_left, num_right);
+    size_t num_partitions = (size_t) 1 << radix_bits;
+    JoinRelation left;
+    JoinRelation right;
+    radix_partition(&left, left_values, left_pos, num_left, radix_bits, num_slices);
+    radix_partition(&right, right_values, right_pos, num_right, radix_bits, num_slices);
+
+    JoinTask* tasks = malloc(sizeof(JoinTask) * num_partitions);
+    for (size_t i = 0; i < num_partitions; i++) {
+        size_t l_start = left.part_starts[i];
+        size_t r_start = right.part_starts[i];
+        JoinPartion* partition = &tasks[i].partition;
+        partition->l_sz = left.part_starts[i + 1] - l_start;
+        partition->r_sz = right.part_starts[i + 1] - r_start;
+        partition->l_join_keys = &left.keys[l_start];
+        partition->l_join_vals = &left.positions[l_start];
+        partition->r_join_keys = &right.keys[r_start];
+        partition->r_join_vals = &right.positions[r_start];
+    }
+    run_join_tasks(join_count_worker, tasks, sizeof(JoinTask), num_partitions,
+                   num_slices > 1);
+
+    // every partition writes after the matches of the partitions before it
+    size_t num_results = 0;
+    for (size_t i = 0; i < num_partitions; i++) {
+        num_results += tasks[i].num_matches;
+    }
+    pos_t* result_left = malloc(sizeof(pos_t) * MAX(num_results, 1));
+    pos_t* result_right = malloc(sizeof(pos_t) * MAX(num_results, 1));
+    size_t offset = 0;
+    for (size_t i = 0; i < num_partitions; i++) {
+        tasks[i].l_out = &result_left[offset];
+        tasks[i].r_out = &result_right[offset];
+        offset += tasks[i].num_matches;
+    }
+    run_join_tasks(join_write_worker, tasks, sizeof(JoinTask), num_partitions,
+                   num_slices > 1);
+    free(tasks);
+    free_join_relation(&left);
+    free_join_relation(&right);
 
     // create the results
-    Result* left_result_column = malloc(sizeof(Result));
-    left_result_column->data_type = INDEX;
-    left_result_column->num_tuples = 0;
-    left_result_column->capacity = DEFAULT_COLUMN_SIZE;
-    left_result_column->payload =
-            malloc(left_result_column->capacity * sizeof(size_t));
-    // create the column
-    GeneralizedColumnHandle* left_gcol = add_result_column(context,
-                                                           join_op->handle1);
-    left_gcol->generalized_column.column_pointer.result = left_result_column;
-    left_gcol->generalized_column.column_type = RESULT;
+    set_join_result(context, join_op->handle1, result_left, num_results);
+    set_join_result(context, join_op->handle2, result_right, num_results);
+    status->msg_type = OK_DONE;
+    return;
+}
 
-    // create the right result struct
-    Result* right_result_column = malloc(sizeof(Result));
-    right_result_column->data_type = INDEX;
-    right_result_column->num_tuples = 0;
-    right_result_column->capacity = DEFAULT_COLUMN_SIZE;
-    right_result_column->payload =
-            malloc(right_result_column->capacity * sizeof(size_t));
-    GeneralizedColumnHandle* right_gcol = add_result_column(context,
-                                                            join_op->handle2);
-    // create the right result column
-    right_gcol->generalized_column.column_pointer.result = right_result_column;
-    right_gcol->generalized_column.column_type = RESULT;
+/// ***************************************************************************
+/// Sort Merge Join Functions
+/// ***************************************************************************
 
-    // this is the goal
-    for (size_t i = 0; i < NUM_PARTITIONS; i++) {
-        // PARTITION and join!!
-        process_partition(
-            &partitions[i],
-            left_result_column,
-            right_result_column
-        );
-        free(partitions[i].l_join_keys);
-        free(partitions[i].l_join_vals);
-        free(partitions[i].r_join_keys);
-        free(partitions[i].r_join_vals);
+// one side of a sort merge join, in key order
+typedef struct SortedRelation {
+    const int* keys;
+    const pos_t* positions;
+    int* sorted_keys;           // the sorted copies (NULL if the side was
+    pos_t* sorted_positions;    // already in key order)
+} SortedRelation;
+
+// a key range of both sides of a sort merge join, as a task
+typedef struct MergeTask {
+    const int* l_keys;
+    const pos_t* l_positions;
+    size_t l_sz;
+    const int* r_keys;
+    const pos_t* r_positions;
+    size_t r_sz;
+    size_t num_matches;
+    pos_t* l_out;           // where the range writes its matches (NULL
+    pos_t* r_out;           // while they are counted)
+} MergeTask;
+
+/**
+ * @brief This function checks whether keys are in (non descending) order
+ *
+ * @param keys
+ * @param num_keys
+ *
+ * @return bool
+ */
+static bool keys_in_order(const int* keys, size_t num_keys) {
+    for (size_t i = 1; i < num_keys; i++) {
+        if (keys[i - 1] > keys[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief This function binary searches sorted keys
+ *
+ * @param keys
+ * @param num_keys
+ * @param key
+ * @param after - find the first key above key (instead of the first one
+ *  not below it)
+ *
+ * @return the index of the first such key (num_keys if there is none)
+ */
+static size_t search_keys(const int* keys, size_t num_keys, int key, bool after) {
+    size_t low = 0;
+    size_t high = num_keys;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (keys[mid] < key || (after && keys[mid] == key)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief This function puts one side of a sort merge join in key order.
+ *  Sides that already are (e.g. fetched from a clustered column) are used
+ *  as they are. The others get an LSD radix sort of their (key, position)
+ *  pairs, on only the bits that the range of the keys spans. Every pass is
+ *  a stable parallel radix pass and the passes ping-pong between the
+ *  sorted arrays and a buffer so the last one ends in the sorted arrays.
+ *
+ * @param relation - set to the side in key order
+ * @param keys
+ * @param positions
+ * @param num_rows
+ * @param num_slices - how many slices every pass is split into
+ */
+static void sort_relation(
+    SortedRelation* relation,
+    const int* keys,
+    const pos_t* positions,
+    size_t num_rows,
+    size_t num_slices
+) {
+    relation->sorted_keys = NULL;
+    relation->sorted_positions = NULL;
+    if (keys_in_order(keys, num_rows)) {
+        relation->keys = keys;
+        relation->positions = positions;
+        return;
+    }
+    // (the keys aren't in order so there are two different ones)
+    int min_key;
+    int max_key;
+    aggregate_min_max(INT, keys, num_rows, &min_key, &max_key);
+    uint32_t key_base = (uint32_t) min_key;
+    unsigned bits = 32 - __builtin_clz((uint32_t) max_key - key_base);
+    size_t num_passes = (bits + JOIN_MAX_PASS_BITS - 1) / JOIN_MAX_PASS_BITS;
+
+    relation->sorted_keys = malloc(sizeof(int) * num_rows);
+    relation->sorted_positions = malloc(sizeof(pos_t) * num_rows);
+    int* tmp_keys = NULL;
+    pos_t* tmp_positions = NULL;
+    if (num_passes > 1) {
+        tmp_keys = malloc(sizeof(int) * num_rows);
+        tmp_positions = malloc(sizeof(pos_t) * num_rows);
+    }
+    size_t part_starts[(1 << JOIN_MAX_PASS_BITS) + 1];
+    const int* src_keys = keys;
+    const pos_t* src_positions = positions;
+    unsigned shift = 0;
+    for (size_t pass = 0; pass < num_passes; pass++) {
+        // the bits are spread evenly over the passes
+        size_t passes_left = num_passes - pass;
+        unsigned pass_bits = (bits - shift + passes_left - 1) / passes_left;
+        bool last_in_sorted = passes_left % 2 == 1;
+        int* dst_keys = last_in_sorted ? relation->sorted_keys : tmp_keys;
+        pos_t* dst_positions = last_in_sorted ? relation->sorted_positions : tmp_positions;
+        parallel_radix_pass(src_keys, src_positions, num_rows, dst_keys,
+                            dst_positions, shift, pass_bits, false, key_base,
+                            part_starts, num_slices);
+        src_keys = dst_keys;
+        src_positions = dst_positions;
+        shift += pass_bits;
+    }
+    free(tmp_keys);
+    free(tmp_positions);
+    relation->keys = relation->sorted_keys;
+    relation->positions = relation->sorted_positions;
+}
+
+/**
+ * @brief This worker merges the key range of a task. Every run of equal
+ *  keys on the left is joined with the run of that key on the right, so
+ *  duplicates on both sides give all their pairs. The matches are only
+ *  counted if there is nowhere to write them yet.
+ *
+ * @param task_arg - a MergeTask
+ *
+ * @return NULL
+ */
+static void* merge_join_worker(void* task_arg) {
+    MergeTask* task = (MergeTask*) task_arg;
+    size_t l_idx = 0;
+    size_t r_idx = 0;
+    size_t num_matches = 0;
+    while (l_idx < task->l_sz && r_idx < task->r_sz) {
+        int key = task->l_keys[l_idx];
+        if (key < task->r_keys[r_idx]) {
+            l_idx++;
+            continue;
+        } else if (key > task->r_keys[r_idx]) {
+            r_idx++;
+            continue;
+        }
+        size_t l_end = l_idx + 1;
+        while (l_end < task->l_sz && task->l_keys[l_end] == key) {
+            l_end++;
+        }
+        size_t r_end = r_idx + 1;
+        while (r_end < task->r_sz && task->r_keys[r_end] == key) {
+            r_end++;
+        }
+        if (task->l_out != NULL) {
+            for (size_t l = l_idx; l < l_end; l++) {
+                for (size_t r = r_idx; r < r_end; r++) {
+                    task->l_out[num_matches] = task->l_positions[l];
+                    task->r_out[num_matches++] = task->r_positions[r];
+                }
+            }
+        } else {
+            num_matches += (l_end - l_idx) * (r_end - r_idx);
+        }
+        l_idx = l_end;
+        r_idx = r_end;
+    }
+    task->num_matches = num_matches;
+    return NULL;
+}
+
+/**
+ * @brief This function performs a sort merge join of two columns. Both
+ *  sides are put in key order (see sort_relation), then cut into key
+ *  ranges: the left is sliced by rows (never inside a run of equal keys)
+ *  and the right is cut at the first key of every slice. The ranges are
+ *  merged as tasks in two phases like the hash join, counting and then
+ *  writing, so the results come out in key order.
+ *
+ * @param join_op - the struct containing the join stuff
+ * @param context - the client context (for returning)
+ * @param status - the status;
+ */
+void process_sort_merge_join(
+    JoinOperator* join_op,
+    ClientContext* context,
+    Status* status
+) {
+    assert(join_op->col1_values->num_tuples ==
+            join_op->col1_positions->num_tuples);
+    assert(join_op->col2_values->num_tuples ==
+            join_op->col2_positions->num_tuples);
+    size_t num_left = join_op->col1_values->num_tuples;
+    size_t num_right = join_op->col2_values->num_tuples;
+
+    size_t num_slices = join_parallelism(num_left + num_right);
+    SortedRelation left;
+    SortedRelation right;
+    sort_relation(&left, (int*) join_op->col1_values->payload,
+                  (pos_t*) join_op->col1_positions->payload, num_left, num_slices);
+    sort_relation(&right, (int*) join_op->col2_values->payload,
+                  (pos_t*) join_op->col2_positions->payload, num_right, num_slices);
+
+    MergeTask* tasks = malloc(sizeof(MergeTask) * num_slices);
+    size_t slice = (num_left + num_slices - 1) / num_slices;
+    size_t l_start = 0;
+    size_t r_start = 0;
+    for (size_t t = 0; t < num_slices; t++) {
+        size_t l_end = MAX(MIN((t + 1) * slice, num_left), l_start);
+        if (l_end > 0 && l_end < num_left) {
+            l_end = search_keys(left.keys, num_left, left.keys[l_end - 1], true);
+        }
+        size_t r_end = l_end < num_left ?
+            search_keys(right.keys, num_right, left.keys[l_end], false) : num_right;
+        tasks[t].l_keys = &left.keys[l_start];
+        tasks[t].l_positions = &left.positions[l_start];
+        tasks[t].l_sz = l_end - l_start;
+        tasks[t].r_keys = &right.keys[r_start];
+        tasks[t].r_positions = &right.positions[r_start];
+        tasks[t].r_sz = r_end - r_start;
+        tasks[t].l_out = tasks[t].r_out = NULL;
+        l_start = l_end;
+        r_start = r_end;
+    }
+    run_join_tasks(merge_join_worker, tasks, sizeof(MergeTask), num_slices,
+                   num_slices > 1);
+
+    // every range writes after the matches of the ranges before it
+    size_t num_results = 0;
+    for (size_t t = 0; t < num_slices; t++) {
+        num_results += tasks[t].num_matches;
+    }
+    pos_t* result_left = malloc(sizeof(pos_t) * MAX(num_results, 1));
+    pos_t* result_right = malloc(sizeof(pos_t) * MAX(num_results, 1));
+    size_t offset = 0;
+    for (size_t t = 0; t < num_slices; t++) {
+        tasks[t].l_out = &result_left[offset];
+        tasks[t].r_out = &result_right[offset];
+        offset += tasks[t].num_matches;
     }
-    free(partitions);
-    // partition data
+    run_join_tasks(merge_join_worker, tasks, sizeof(MergeTask), num_slices,
+                   num_slices > 1);
+    free(tasks);
+    free(left.sorted_keys);
+    free(left.sorted_positions);
+    free(right.sorted_keys);
+    free(right.sorted_positions);
+
+    set_join_result(context, join_op->handle1, result_left, num_results);
+    set_join_result(context, join_op->handle2, result_right, num_results);
     status->msg_type = OK_DONE;
-    return;
 }
 
 /**
@@ -1494,14 +3754,14 @@ void process_nested_loop_join(
 ) {
     // this should be true
     int* left_values = (int*) join_op->col1_values->payload;
-    size_t* left_pos = (size_t*) join_op->col1_positions->payload;
+    pos_t* left_pos = (pos_t*) join_op->col1_positions->payload;
     assert(join_op->col1_values->num_tuples == join_op->col1_positions->num_tuples);
     size_t num_left = join_op->col1_values->num_tuples;
 
 
     // this should also hold true
     int* right_values = (int*) join_op->col2_values->payload;
-    size_t* right_pos = (size_t*) join_op->col2_positions->payload;
+    pos_t* right_pos = (pos_t*) join_op->col2_positions->payload;
     assert(join_op->col2_values->num_tuples == join_op->col2_positions->num_tuples);
     size_t num_right = join_op->col2_values->num_tuples;
 
@@ -1514,8 +3774,8 @@ void process_nested_loop_join(
     // result counter
     size_t num_results = 0;
     size_t capacity = PAGE_SZ;  // we just picked this as our scaling var
-    size_t* result_left = malloc(capacity * sizeof(size_t));
-    size_t* result_right = malloc(capacity * sizeof(size_t));
+    pos_t* result_left = malloc(capacity * sizeof(pos_t));
+    pos_t* result_right = malloc(capacity * sizeof(pos_t));
 
     // loop through page sized chunks of left values
     for (size_t outer_l = 0; outer_l < num_left; outer_l += lp) {
@@ -1536,9 +3796,9 @@ void process_nested_loop_join(
                         if (num_results == capacity) {
                             capacity *= 2;
                             result_left = realloc(result_left,
-                                                  capacity * sizeof(size_t));
+                                                  capacity * sizeof(pos_t));
                             result_right = realloc(result_right,
-                                                   capacity * sizeof(size_t));
+                                                   capacity * sizeof(pos_t));
                         }
                         result_left[num_results] = left_pos[l_idx];
                         result_right[num_results++] = right_pos[r_idx];
@@ -1551,7 +3811,7 @@ void process_nested_loop_join(
 
     // tighten the bound for the results
 
-    Result* left_result_column = malloc(sizeof(Result));
+    Result* left_result_column = calloc(1, sizeof(Result));
     left_result_column->num_tuples = num_results;
     left_result_column->capacity = num_results;
     if (num_results == 0) {
@@ -1559,7 +3819,7 @@ void process_nested_loop_join(
         left_result_column->payload = NULL;
     } else {
         left_result_column->payload = realloc(result_left,
-                                              num_results * sizeof(size_t));
+                                              num_results * sizeof(pos_t));
     }
     left_result_column->data_type = INDEX;
     GeneralizedColumnHandle* left_gcol = add_result_column(context, join_op->handle1);
@@ -1567,7 +3827,7 @@ void process_nested_loop_join(
     left_gcol->generalized_column.column_type = RESULT;
 
 
-    Result* right_result_column = malloc(sizeof(Result));
+    Result* right_result_column = calloc(1, sizeof(Result));
     right_result_column->num_tuples = num_results;
     right_result_column->capacity = num_results;
     if (num_results == 0) {
@@ -1575,7 +3835,7 @@ void process_nested_loop_join(
         right_result_column->payload = NULL;
     } else {
         right_result_column->payload = realloc(result_right,
-                                               num_results * sizeof(size_t));
+                                               num_results * sizeof(pos_t));
     }
     right_result_column->data_type = INDEX;
     GeneralizedColumnHandle* right_gcol = add_result_column(context, join_op->handle2);
@@ -1632,14 +3892,49 @@ PrintOperator* execute_DbOperator(DbOperator* query, Status* status) {
                 return NULL;
             }
             break;
+        case MULTI_SELECT:
+            process_multi_select(
+                &query->operator_fields.multi_select_operator,
+                query->context,
+                status
+            );
+            break;
+        case MULTI_FETCH:
+            process_multi_fetch(
+                &query->operator_fields.multi_fetch_operator,
+                query->context,
+                status
+            );
+            break;
+        case GROUP_BY:
+            process_group(
+                &query->operator_fields.group_operator,
+                query->context,
+                status
+            );
+            break;
         case HASH_JOIN:
+            // the joins work on explicit position lists
+            materialize_positions(query->operator_fields.join_operator.col1_positions);
+            materialize_positions(query->operator_fields.join_operator.col2_positions);
             process_hash_join(
                 &query->operator_fields.join_operator,
                 query->context,
                 status
             );
             break;
+        case SORT_MERGE_JOIN:
+            materialize_positions(query->operator_fields.join_operator.col1_positions);
+            materialize_positions(query->operator_fields.join_operator.col2_positions);
+            process_sort_merge_join(
+                &query->operator_fields.join_operator,
+                query->context,
+                status
+            );
+            break;
         case NESTED_LOOP_JOIN:
+            materialize_positions(query->operator_fields.join_operator.col1_positions);
+            materialize_positions(query->operator_fields.join_operator.col2_positions);
             process_nested_loop_join(
                 &query->operator_fields.join_operator,
                 query->context,
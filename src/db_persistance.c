@@ -4,6 +4,12 @@
 #include <string.h>
 #include "cs165_api.h"
 #include "db_index.h"
+#include "db_crack.h"
+#include "zone_map.h"
+#include "compression.h"
+#include "recycler.h"
+#include "histogram.h"
+#include "prefix_sum.h"
 // TODO: remove
 #include <assert.h>
 #define MAX_LINE_LEN 2048
@@ -12,10 +18,15 @@
 /// Serialization Types
 /// ***************************************************************************
 
+// the layout of the files in ./database - bump it whenever a struct that is
+// written out as is changes (2: 32 bit positions and page sized b+tree leaves)
+#define DB_FORMAT_VERSION 2
+
 // This is used for the storage
 typedef enum StorageType {
     STORED_DB = 1,
     STORED_TABLE = 2,
+    STORED_FORMAT = 3,
 } StorageType;
 
 // this is used for the storage group
@@ -100,6 +111,58 @@ int make_index_fname(char* db_name, char* table_name, char* col_name, char* file
     return sprintf(fileoutname, "./database/%s.%s.%s.index.bin", db_name, table_name, col_name);
 }
 
+/**
+ * @brief This function makes the binary file name for the column's zone map
+ *
+ * @param db_name - this is the db name (char*)
+ * @param table_name - this is the table name (char*)
+ * @param col_name - this is the col name
+ * @param fileoutname - this is where it all gets returned
+ *
+ * @return
+ */
+int make_zone_map_fname(char* db_name, char* table_name, char* col_name, char* fileoutname) {
+    return sprintf(fileoutname, "./database/%s.%s.%s.zmap.bin", db_name, table_name, col_name);
+}
+
+/**
+ * @brief This function makes the binary file name for the column's prefix sums
+ *
+ * @param db_name - this is the db name (char*)
+ * @param table_name - this is the table name (char*)
+ * @param col_name - this is the col name
+ * @param fileoutname - this is where it all gets returned
+ *
+ * @return
+ */
+int make_prefix_sums_fname(char* db_name, char* table_name, char* col_name, char* fileoutname) {
+    return sprintf(fileoutname, "./database/%s.%s.%s.psum.bin", db_name, table_name, col_name);
+}
+
+/**
+ * @brief This function reads one node. The header says which layout the
+ *  rest of the node has.
+ *
+ * @param loadfile - the file to read from
+ *
+ * @return - the node (NULL if the file ended)
+ */
+BPTNode* load_btree_node(FILE* loadfile) {
+    BPTNode header;
+    if (fread(&header, sizeof(BPTNode), 1, loadfile) != 1) {
+        return NULL;
+    }
+    size_t node_size = header.is_leaf ? sizeof(BPTLeaf) : sizeof(BPTInner);
+    BPTNode* node = calloc(1, node_size);
+    *node = header;
+    if (fread((char*) node + sizeof(BPTNode), node_size - sizeof(BPTNode),
+              1, loadfile) != 1) {
+        free(node);
+        return NULL;
+    }
+    return node;
+}
+
 /**
  * @brief This function loads all of the nodes back in
  *
@@ -113,8 +176,10 @@ BPTNode* load_btree(FILE* loadfile) {
     }
 
     // otherwise start loading
-    BPTNode* root_node = calloc(1, sizeof(BPTNode));
-    fread(root_node, sizeof(BPTNode), 1, loadfile);
+    BPTNode* root_node = load_btree_node(loadfile);
+    if (root_node == NULL) {
+        return NULL;
+    }
 
     // allocate space to hold the nodes
     BPTNode** all_nodes = malloc(sizeof(BPTNode*) * 2);
@@ -122,14 +187,15 @@ BPTNode* load_btree(FILE* loadfile) {
     size_t node_idx = 0;
     all_nodes[node_idx] = root_node;
 
-    BPTNode* first_child = NULL;
-    BPTNode* prev_child = NULL;
+    BPTLeaf* first_child = NULL;
+    BPTLeaf* prev_child = NULL;
     while (node_idx < num_nodes) {
-        // if there are bpt_ptrs.children nodes
+        // if there are children nodes
         // copy the node into a current node
         BPTNode* current_node = all_nodes[node_idx];
-        // if we have have a node with bpt_ptrs.children
+        // if we have have a node with children
         if (current_node->is_leaf == false) {
+            BPTInner* inner = BPT_INNER(current_node);
             // these are the number of nodes that we will be adding
             size_t to_add = current_node->num_elements + 1;
             // increase our queue of nodes, it will now be equal to the length
@@ -138,25 +204,25 @@ BPTNode* load_btree(FILE* loadfile) {
             // create a list of child nodes
             // set the parent to point to the children
             for (size_t i = 0; i < to_add; i++) {
-                BPTNode* read_node = calloc(1, sizeof(BPTNode));
-                fread((void*) read_node, sizeof(BPTNode), 1, loadfile);
-                current_node->bpt_meta.bpt_ptrs.children[i] = read_node;
+                inner->children[i] = load_btree_node(loadfile);
             }
             // add to the queue
             memcpy(
                 (void*) &all_nodes[num_nodes],
-                (void*) current_node->bpt_meta.bpt_ptrs.children,
+                (void*) inner->children,
                 sizeof(BPTNode*) * to_add
             );
             // increase number of nodes
             num_nodes += to_add;
         } else {
+            BPTLeaf* current_leaf = BPT_LEAF(current_node);
+            current_leaf->prev_leaf = current_leaf->next_leaf = NULL;
             if (first_child == NULL) {
-                first_child = prev_child = current_node;
+                first_child = prev_child = current_leaf;
             } else {
-                prev_child->bpt_meta.bpt_leaf.next_leaf = current_node;
-                current_node->bpt_meta.bpt_leaf.prev_leaf = prev_child;
-                prev_child = current_node;
+                prev_child->next_leaf = current_leaf;
+                current_leaf->prev_leaf = prev_child;
+                prev_child = current_leaf;
             }
         }
         node_idx++;
@@ -192,11 +258,21 @@ void load_index(char* filename, Column* column) {
         FILE* index_file = fopen(filename, "rb");
         fread(sorted_index->keys, sizeof(int),
               sorted_index->num_items, index_file);
-        fread(sorted_index->col_positions, sizeof(size_t),
+        fread(sorted_index->col_positions, sizeof(pos_t),
               sorted_index->num_items, index_file);
         fclose(index_file);
         column->index = (void*) sorted_index;
         return;
+    } else if (column->index_type == CRACKED) {
+        // if the column was never queried there is no cracker column yet
+        FILE* index_file = fopen(filename, "rb");
+        if (index_file == NULL) {
+            column->index = NULL;
+            return;
+        }
+        column->index = load_cracker_index(index_file);
+        fclose(index_file);
+        return;
     } else {
         FILE* index_file = fopen(filename, "rb");
         column->index = load_btree(index_file);
@@ -206,6 +282,57 @@ void load_index(char* filename, Column* column) {
 }
 
 
+/**
+ * @brief This function loads the clean zones of a zone map. If the file is
+ *  missing the zones are just rebuilt on the first scan.
+ *
+ * @param filename
+ * @param column
+ */
+void load_zone_map(char* filename, Column* column) {
+    ZoneMap* zone_map = column->zone_map;
+    FILE* zone_file = fopen(filename, "rb");
+    if (zone_file == NULL) {
+        return;
+    }
+    size_t num_clean = 0;
+    if (fread(&num_clean, sizeof(size_t), 1, zone_file) == 1 &&
+        num_clean <= zone_map->capacity &&
+        fread(zone_map->mins, sizeof(int), num_clean, zone_file) == num_clean &&
+        fread(zone_map->maxs, sizeof(int), num_clean, zone_file) == num_clean
+    ) {
+        zone_map->num_clean = num_clean;
+    }
+    fclose(zone_file);
+}
+
+/**
+ * @brief This function loads the clean entries of a column's prefix sums.
+ *  Columns without the file only get prefix sums once they are summed.
+ *
+ * @param filename
+ * @param column
+ */
+void load_prefix_sums(char* filename, Column* column) {
+    FILE* psum_file = fopen(filename, "rb");
+    if (psum_file == NULL) {
+        return;
+    }
+    PrefixSums* prefix_sums = create_prefix_sums(column->table->table_length);
+    size_t num_clean = 0;
+    if (prefix_sums != NULL &&
+        fread(&num_clean, sizeof(size_t), 1, psum_file) == 1 &&
+        num_clean < prefix_sums->capacity &&
+        fread(prefix_sums->sums, sizeof(long), num_clean + 1, psum_file) == num_clean + 1
+    ) {
+        prefix_sums->num_clean = num_clean;
+    } else if (prefix_sums != NULL) {
+        prefix_sums->sums[0] = 0;
+    }
+    column->prefix_sums = prefix_sums;
+    fclose(psum_file);
+}
+
 /**
  * @brief This function takes in a loaded storage group and updates the status
  *
@@ -242,9 +369,14 @@ void load_table(StorageGroup* sg_ptr, Status* status) {
         Column* col = tbl_ptr->columns + i;
         // load if data was allocated
         col->data = malloc(tbl_ptr->table_length * sizeof(int));
+        col->zone_map = create_zone_map(tbl_ptr->table_length);
+        col->compressed = NULL;
+        col->compress_pending = false;
+        col->histogram = NULL;
+        col->prefix_sums = NULL;
         col->size_ptr = &tbl_ptr->table_size;
         col->table = tbl_ptr;
-        if (col->data == NULL) {
+        if (col->data == NULL || col->zone_map == NULL) {
             status->code = ERROR;
             status->msg_type = MEM_ALLOC_FAILED;
             fclose(table_file);
@@ -260,6 +392,15 @@ void load_table(StorageGroup* sg_ptr, Status* status) {
         }
         // load in all the data
         fread(col->data, sizeof(int), tbl_ptr->table_size, col_file);
+        fclose(col_file);
+
+        char zone_fname[MAX_SIZE_NAME * 4 + 8];
+        make_zone_map_fname(current_db->name, tbl_ptr->name, col->name, zone_fname);
+        load_zone_map(zone_fname, col);
+
+        char psum_fname[MAX_SIZE_NAME * 4 + 8];
+        make_prefix_sums_fname(current_db->name, tbl_ptr->name, col->name, psum_fname);
+        load_prefix_sums(psum_fname, col);
 
         // This is the
         if (col->index_type != NONE) {
@@ -275,7 +416,11 @@ void load_table(StorageGroup* sg_ptr, Status* status) {
                 tbl_ptr->primary_col_pos = i;
             }
             load_index(index_fname, col);
+        } else {
+            // unindexed columns are encoded once they are scanned
+            col->compress_pending = true;
         }
+        column_histogram(col);
     }
     /* free(scolumns); */
     fclose(table_file);
@@ -298,6 +443,21 @@ Status db_startup() {
         return startup_status;
     }
 
+    // the files have to be in the layout this build writes, the first
+    // record says which one that is (files from before it was recorded
+    // start with a database and have 64 bit positions)
+    StorageGroup stored_format;
+    if (fread(&stored_format, sizeof(StorageGroup), 1, db_fp) != 1 ||
+            stored_format.type != STORED_FORMAT ||
+            stored_format.count_1 != DB_FORMAT_VERSION ||
+            stored_format.count_2 != sizeof(pos_t)) {
+        startup_status.code = ERROR;
+        startup_status.msg_type = INCORRECT_FILE_FORMAT;
+        startup_status.msg = "The database was written in an older format";
+        fclose(db_fp);
+        return startup_status;
+    }
+
     // create a new storage group object
     StorageGroup stored_db;
     while (startup_status.code != ERROR &&
@@ -348,6 +508,19 @@ void store_table(Table* table, StorageGroup* sg) {
     strcpy(sg->name, table->name);
 }
 
+/**
+ * @brief This function makes the storage obj that records the file format
+ *
+ * @return StorageGroup object
+ */
+StorageGroup store_format() {
+    StorageGroup sg = { .type = STORED_FORMAT };
+    sg.count_1 = DB_FORMAT_VERSION;
+    sg.count_2 = sizeof(pos_t);
+    strcpy(sg.name, "format");
+    return sg;
+}
+
 /**
  * @brief This function takes in a database and formats it into a storage obj
  *
@@ -379,14 +552,57 @@ void dump_index(char* filename, Column* column) {
         FILE* index_file = fopen(filename, "wb");
         fwrite(sorted_index->keys, sizeof(int),
                sorted_index->num_items, index_file);
-        fwrite(sorted_index->col_positions, sizeof(size_t),
+        fwrite(sorted_index->col_positions, sizeof(pos_t),
                sorted_index->num_items, index_file);
         fclose(index_file);
+    } else if (column->index_type == CRACKED) {
+        FILE* index_file = fopen(filename, "wb");
+        if (index_file == NULL) {
+            return;
+        }
+        dump_cracker_index(column->index, index_file);
+        fclose(index_file);
     } else {
         dump_tree(column->index, filename);
     }
 }
 
+/**
+ * @brief Function that dumps the clean entries of a column's prefix sums
+ *  into a binary file
+ *
+ * @param filename
+ * @param column
+ */
+void dump_prefix_sums(char* filename, Column* column) {
+    PrefixSums* prefix_sums = column->prefix_sums;
+    FILE* psum_file = fopen(filename, "wb");
+    if (psum_file == NULL) {
+        return;
+    }
+    fwrite(&prefix_sums->num_clean, sizeof(size_t), 1, psum_file);
+    fwrite(prefix_sums->sums, sizeof(long), prefix_sums->num_clean + 1, psum_file);
+    fclose(psum_file);
+}
+
+/**
+ * @brief Function that dumps the clean zones of a zone map into a binary file
+ *
+ * @param filename
+ * @param column
+ */
+void dump_zone_map(char* filename, Column* column) {
+    ZoneMap* zone_map = column->zone_map;
+    FILE* zone_file = fopen(filename, "wb");
+    if (zone_file == NULL) {
+        return;
+    }
+    fwrite(&zone_map->num_clean, sizeof(size_t), 1, zone_file);
+    fwrite(zone_map->mins, sizeof(int), zone_map->num_clean, zone_file);
+    fwrite(zone_map->maxs, sizeof(int), zone_map->num_clean, zone_file);
+    fclose(zone_file);
+}
+
 /**
  * @brief This function takes a column and a file name and dumps the column
  *
@@ -403,7 +619,18 @@ void dump_column(const char* fname, Column* col, size_t data_len, Status* status
         status->msg_type = FILE_NOT_FOUND;
         return;
     }
-    fwrite(col->data, sizeof(int), data_len, col_file);
+    if (col->compressed != NULL) {
+        // columns are stored raw, so decode one block at a time
+        int block[DEFAULT_COLUMN_SIZE];
+        for (size_t start = 0; start < data_len; start += DEFAULT_COLUMN_SIZE) {
+            size_t block_sz = data_len - start < DEFAULT_COLUMN_SIZE ?
+                data_len - start : DEFAULT_COLUMN_SIZE;
+            decompress_range(col->compressed, start, block_sz, block);
+            fwrite(block, sizeof(int), block_sz, col_file);
+        }
+    } else {
+        fwrite(col->data, sizeof(int), data_len, col_file);
+    }
     fclose(col_file);
 }
 
@@ -430,6 +657,19 @@ Status dump_db_table(const char* fname, Db* db, Table* table) {
         // dump the column
         make_column_fname(db->name, table->name, col->name, col_fname);
         dump_column(col_fname, col, table->table_size, &status);
+        if (col->zone_map != NULL) {
+            char zone_fname[MAX_SIZE_NAME * 4 + 8];
+            make_zone_map_fname(db->name, table->name, col->name, zone_fname);
+            dump_zone_map(zone_fname, col);
+        }
+        char psum_fname[MAX_SIZE_NAME * 4 + 8];
+        make_prefix_sums_fname(db->name, table->name, col->name, psum_fname);
+        if (col->prefix_sums != NULL) {
+            dump_prefix_sums(psum_fname, col);
+        } else {
+            // don't leave the sums of an older version of the column around
+            remove(psum_fname);
+        }
         if (col->index_type != NONE && col->index != NULL) {
             char index_fname[MAX_SIZE_NAME * 4 + 8];
             make_index_fname(db->name, table->name, col->name, index_fname);
@@ -460,6 +700,10 @@ Status dump_databases() {
         return status;
     }
 
+    // the format comes first so a later build can tell if it can read the rest
+    StorageGroup format_obj = store_format();
+    fwrite(&format_obj, sizeof(StorageGroup), 1, db_fp);
+
     // see if db exists and return (if not from load)
     while (db_ptr) {
         // write out the database object
@@ -533,10 +777,16 @@ void free_column(Column* column) {
     if (column->index) {
         if (column->index_type == BTREE) {
             free_tree(column->index);
+        } else if (column->index_type == CRACKED) {
+            free_cracker_index(column->index);
         } else {
             free_sorted_index(column->index);
         }
     }
+    free_zone_map(column->zone_map);
+    free_compressed_column(column->compressed);
+    free_histogram(column->histogram);
+    free_prefix_sums(column->prefix_sums);
     free(column->data);
 }
 
@@ -561,6 +811,8 @@ void free_table(Table* table) {
  * @return
  */
 void shutdown_database(Db* db) {
+    // the recycled results point into the columns
+    recycler_clear();
     for (size_t i = 0; i < db->tables_size; i++) {
         free_table(db->tables + i);
     }
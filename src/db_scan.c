@@ -0,0 +1,853 @@
+#include <limits.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <immintrin.h>
+#include "db_scan.h"
+#include "utils.h"
+
+/// ***************************************************************************
+/// Helper Functions
+/// ***************************************************************************
+
+// for every 8 bit match mask this holds the lane numbers of the set bits
+// packed to the front (the rest are zero). This is what lets us do a
+// "compress store" of positions on hardware without a compress instruction
+static uint8_t compress_lut[256][8];
+
+/**
+ * @brief Function that fills the compress lookup table
+ */
+static void init_compress_lut() {
+    for (unsigned mask = 0; mask < 256; mask++) {
+        size_t num_set = 0;
+        memset(compress_lut[mask], 0, sizeof(compress_lut[mask]));
+        for (uint8_t lane = 0; lane < 8; lane++) {
+            if (mask & (1U << lane)) {
+                compress_lut[mask][num_set++] = lane;
+            }
+        }
+    }
+}
+
+/**
+ * @brief This function takes a comparator and returns its bounds as ints so
+ *  they can be broadcast into vector registers.
+ *
+ * @param comp - the comparator (p_low inclusive, p_high exclusive)
+ * @param low - where to store the low bound
+ * @param high - where to store the high bound
+ */
+void comparator_int_bounds(Comparator* comp, int* low, int* high) {
+    *low = (int) MIN(MAX(comp->p_low, (long) INT_MIN), (long) INT_MAX);
+    *high = (int) MIN(MAX(comp->p_high, (long) INT_MIN), (long) INT_MAX);
+}
+
+/// ***************************************************************************
+/// Select Kernels
+/// ***************************************************************************
+
+/**
+ * @brief Nonbranching scalar selection - every position is written and the
+ *  output cursor only moves forward on a match
+ *
+ * @param data - the values to compare
+ * @param num_items - number of values
+ * @param base - position of data[0] (added to every output position)
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param positions - output array
+ *
+ * @return number of matches
+ */
+size_t select_range_scalar(
+    const int* data,
+    size_t num_items,
+    size_t base,
+    int low,
+    int high,
+    pos_t* positions
+) {
+    size_t num_found = 0;
+    for (size_t idx = 0; idx < num_items; idx++) {
+        positions[num_found] = base + idx;
+        num_found += ((data[idx] >= low) & (data[idx] < high));
+    }
+    return num_found;
+}
+
+/**
+ * @brief Branching scalar selection - only writes on a match. This wins when
+ *  almost nothing (or almost everything) matches as the branch is then
+ *  predicted correctly.
+ *
+ * @param data - the values to compare
+ * @param num_items - number of values
+ * @param base - position of data[0] (added to every output position)
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param positions - output array
+ *
+ * @return number of matches
+ */
+size_t select_range_branching(
+    const int* data,
+    size_t num_items,
+    size_t base,
+    int low,
+    int high,
+    pos_t* positions
+) {
+    size_t num_found = 0;
+    for (size_t idx = 0; idx < num_items; idx++) {
+        if (data[idx] >= low && data[idx] < high) {
+            positions[num_found++] = base + idx;
+        }
+    }
+    return num_found;
+}
+
+/**
+ * @brief Scalar bitmap selection - builds each 32 bit word without branches
+ *
+ * @param data - the values to compare
+ * @param num_items - number of values
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param bitmap - output bitmap (BITMAP_WORDS(num_items) words)
+ *
+ * @return number of matches
+ */
+size_t select_bitmap_scalar(
+    const int* data,
+    size_t num_items,
+    int low,
+    int high,
+    uint32_t* bitmap
+) {
+    size_t num_found = 0;
+    for (size_t word_idx = 0; word_idx < BITMAP_WORDS(num_items); word_idx++) {
+        size_t start = word_idx * BIT_SZ;
+        size_t end = MIN(start + BIT_SZ, num_items);
+        uint32_t word = 0;
+        for (size_t idx = start; idx < end; idx++) {
+            word |= ((uint32_t) ((data[idx] >= low) & (data[idx] < high))) <<
+                    (idx - start);
+        }
+        bitmap[word_idx] = word;
+        num_found += __builtin_popcount(word);
+    }
+    return num_found;
+}
+
+/**
+ * @brief SSE4 kernel - compares 4 values at once and expands the match
+ *  mask into positions with the lookup table
+ */
+__attribute__((target("sse4.1")))
+static size_t select_range_sse4(
+    const int* data,
+    size_t num_items,
+    size_t base,
+    int low,
+    int high,
+    pos_t* positions
+) {
+    const __m128i v_low = _mm_set1_epi32(low);
+    const __m128i v_high = _mm_set1_epi32(high);
+    size_t num_found = 0;
+    size_t idx = 0;
+    for (; idx + 4 <= num_items; idx += 4) {
+        __m128i vals = _mm_loadu_si128((const __m128i*) &data[idx]);
+        // a value matches when it is not below low and is below high
+        __m128i below = _mm_cmpgt_epi32(v_low, vals);
+        __m128i under = _mm_cmpgt_epi32(v_high, vals);
+        __m128i match = _mm_andnot_si128(below, under);
+        unsigned mask = (unsigned) _mm_movemask_ps(_mm_castsi128_ps(match));
+
+        // widen the packed lane numbers and add the row offset. we always
+        // store 4 positions, only the first popcount of them are kept
+        int packed;
+        memcpy(&packed, compress_lut[mask], sizeof(int));
+        __m128i lanes = _mm_cvtsi32_si128(packed);
+#if COMPACT_POSITIONS
+        __m128i row = _mm_set1_epi32((int) (base + idx));
+        _mm_storeu_si128((__m128i*) &positions[num_found],
+                         _mm_add_epi32(row, _mm_cvtepu8_epi32(lanes)));
+#else
+        __m128i row = _mm_set1_epi64x((long long) (base + idx));
+        _mm_storeu_si128((__m128i*) &positions[num_found],
+                         _mm_add_epi64(row, _mm_cvtepu8_epi64(lanes)));
+        _mm_storeu_si128((__m128i*) &positions[num_found + 2],
+                         _mm_add_epi64(row,
+                                       _mm_cvtepu8_epi64(_mm_srli_si128(lanes, 2))));
+#endif
+        num_found += __builtin_popcount(mask);
+    }
+    return num_found + select_range_scalar(&data[idx], num_items - idx,
+                                           base + idx, low, high,
+                                           &positions[num_found]);
+}
+
+/**
+ * @brief SSE4 bitmap kernel - 8 compares of 4 values per bitmap word
+ */
+__attribute__((target("sse4.1")))
+static size_t select_bitmap_sse4(
+    const int* data,
+    size_t num_items,
+    int low,
+    int high,
+    uint32_t* bitmap
+) {
+    const __m128i v_low = _mm_set1_epi32(low);
+    const __m128i v_high = _mm_set1_epi32(high);
+    size_t num_found = 0;
+    size_t word_idx = 0;
+    for (; (word_idx + 1) * BIT_SZ <= num_items; word_idx++) {
+        const int* word_data = &data[word_idx * BIT_SZ];
+        uint32_t word = 0;
+        for (unsigned lane = 0; lane < BIT_SZ; lane += 4) {
+            __m128i vals = _mm_loadu_si128((const __m128i*) &word_data[lane]);
+            __m128i match = _mm_andnot_si128(_mm_cmpgt_epi32(v_low, vals),
+                                             _mm_cmpgt_epi32(v_high, vals));
+            word |= ((uint32_t) _mm_movemask_ps(_mm_castsi128_ps(match))) << lane;
+        }
+        bitmap[word_idx] = word;
+        num_found += __builtin_popcount(word);
+    }
+    return num_found + select_bitmap_scalar(&data[word_idx * BIT_SZ],
+                                            num_items - word_idx * BIT_SZ,
+                                            low, high, &bitmap[word_idx]);
+}
+
+/**
+ * @brief AVX2 kernel - compares 8 values at once and expands the match
+ *  mask into positions with the lookup table
+ */
+__attribute__((target("avx2")))
+static size_t select_range_avx2(
+    const int* data,
+    size_t num_items,
+    size_t base,
+    int low,
+    int high,
+    pos_t* positions
+) {
+    const __m256i v_low = _mm256_set1_epi32(low);
+    const __m256i v_high = _mm256_set1_epi32(high);
+    size_t num_found = 0;
+    size_t idx = 0;
+    for (; idx + 8 <= num_items; idx += 8) {
+        __m256i vals = _mm256_loadu_si256((const __m256i*) &data[idx]);
+        __m256i below = _mm256_cmpgt_epi32(v_low, vals);
+        __m256i under = _mm256_cmpgt_epi32(v_high, vals);
+        __m256i match = _mm256_andnot_si256(below, under);
+        unsigned mask = (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(match));
+
+        // we always store 8 positions - this is safe as num_found <= idx
+        __m128i lanes = _mm_loadl_epi64((const __m128i*) compress_lut[mask]);
+#if COMPACT_POSITIONS
+        __m256i row = _mm256_set1_epi32((int) (base + idx));
+        _mm256_storeu_si256((__m256i*) &positions[num_found],
+                            _mm256_add_epi32(row, _mm256_cvtepu8_epi32(lanes)));
+#else
+        __m256i row = _mm256_set1_epi64x((long long) (base + idx));
+        _mm256_storeu_si256((__m256i*) &positions[num_found],
+                            _mm256_add_epi64(row, _mm256_cvtepu8_epi64(lanes)));
+        _mm256_storeu_si256((__m256i*) &positions[num_found + 4],
+                            _mm256_add_epi64(row,
+                                             _mm256_cvtepu8_epi64(_mm_srli_si128(lanes, 4))));
+#endif
+        num_found += __builtin_popcount(mask);
+    }
+    return num_found + select_range_scalar(&data[idx], num_items - idx,
+                                           base + idx, low, high,
+                                           &positions[num_found]);
+}
+
+/**
+ * @brief AVX2 bitmap kernel - 4 compares of 8 values per bitmap word
+ */
+__attribute__((target("avx2")))
+static size_t select_bitmap_avx2(
+    const int* data,
+    size_t num_items,
+    int low,
+    int high,
+    uint32_t* bitmap
+) {
+    const __m256i v_low = _mm256_set1_epi32(low);
+    const __m256i v_high = _mm256_set1_epi32(high);
+    size_t num_found = 0;
+    size_t word_idx = 0;
+    for (; (word_idx + 1) * BIT_SZ <= num_items; word_idx++) {
+        const int* word_data = &data[word_idx * BIT_SZ];
+        uint32_t word = 0;
+        for (unsigned lane = 0; lane < BIT_SZ; lane += 8) {
+            __m256i vals = _mm256_loadu_si256((const __m256i*) &word_data[lane]);
+            __m256i match = _mm256_andnot_si256(_mm256_cmpgt_epi32(v_low, vals),
+                                                _mm256_cmpgt_epi32(v_high, vals));
+            word |= ((uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(match))) << lane;
+        }
+        bitmap[word_idx] = word;
+        num_found += __builtin_popcount(word);
+    }
+    return num_found + select_bitmap_scalar(&data[word_idx * BIT_SZ],
+                                            num_items - word_idx * BIT_SZ,
+                                            low, high, &bitmap[word_idx]);
+}
+
+/**
+ * @brief AVX-512 kernel - compares 16 values at once and uses the native
+ *  compress store to write out the matching positions
+ */
+__attribute__((target("avx512f")))
+static size_t select_range_avx512(
+    const int* data,
+    size_t num_items,
+    size_t base,
+    int low,
+    int high,
+    pos_t* positions
+) {
+    const __m512i v_low = _mm512_set1_epi32(low);
+    const __m512i v_high = _mm512_set1_epi32(high);
+#if COMPACT_POSITIONS
+    const __m512i lanes = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8,
+                                           7, 6, 5, 4, 3, 2, 1, 0);
+#else
+    const __m512i lanes_lo = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m512i lanes_hi = _mm512_set_epi64(15, 14, 13, 12, 11, 10, 9, 8);
+#endif
+    size_t num_found = 0;
+    size_t idx = 0;
+    for (; idx + 16 <= num_items; idx += 16) {
+        __m512i vals = _mm512_loadu_si512((const void*) &data[idx]);
+        __mmask16 mask = _mm512_mask_cmplt_epi32_mask(
+            _mm512_cmpge_epi32_mask(vals, v_low),
+            vals,
+            v_high
+        );
+#if COMPACT_POSITIONS
+        __m512i row = _mm512_set1_epi32((int) (base + idx));
+        _mm512_mask_compressstoreu_epi32((void*) &positions[num_found], mask,
+                                         _mm512_add_epi32(row, lanes));
+        num_found += __builtin_popcount(mask);
+#else
+        // positions are 64 bits so the 16 lanes go out in two halves
+        __m512i row = _mm512_set1_epi64((long long) (base + idx));
+        __mmask8 mask_lo = (__mmask8) (mask & 0xff);
+        __mmask8 mask_hi = (__mmask8) (mask >> 8);
+        _mm512_mask_compressstoreu_epi64((void*) &positions[num_found], mask_lo,
+                                         _mm512_add_epi64(row, lanes_lo));
+        num_found += __builtin_popcount(mask_lo);
+        _mm512_mask_compressstoreu_epi64((void*) &positions[num_found], mask_hi,
+                                         _mm512_add_epi64(row, lanes_hi));
+        num_found += __builtin_popcount(mask_hi);
+#endif
+    }
+    return num_found + select_range_scalar(&data[idx], num_items - idx,
+                                           base + idx, low, high,
+                                           &positions[num_found]);
+}
+
+/**
+ * @brief AVX-512 bitmap kernel - the compare masks are the bitmap bits
+ */
+__attribute__((target("avx512f")))
+static size_t select_bitmap_avx512(
+    const int* data,
+    size_t num_items,
+    int low,
+    int high,
+    uint32_t* bitmap
+) {
+    const __m512i v_low = _mm512_set1_epi32(low);
+    const __m512i v_high = _mm512_set1_epi32(high);
+    size_t num_found = 0;
+    size_t word_idx = 0;
+    for (; (word_idx + 1) * BIT_SZ <= num_items; word_idx++) {
+        const int* word_data = &data[word_idx * BIT_SZ];
+        __m512i vals_lo = _mm512_loadu_si512((const void*) word_data);
+        __m512i vals_hi = _mm512_loadu_si512((const void*) &word_data[16]);
+        __mmask16 mask_lo = _mm512_mask_cmplt_epi32_mask(
+            _mm512_cmpge_epi32_mask(vals_lo, v_low), vals_lo, v_high);
+        __mmask16 mask_hi = _mm512_mask_cmplt_epi32_mask(
+            _mm512_cmpge_epi32_mask(vals_hi, v_low), vals_hi, v_high);
+        uint32_t word = ((uint32_t) mask_lo) | (((uint32_t) mask_hi) << 16);
+        bitmap[word_idx] = word;
+        num_found += __builtin_popcount(word);
+    }
+    return num_found + select_bitmap_scalar(&data[word_idx * BIT_SZ],
+                                            num_items - word_idx * BIT_SZ,
+                                            low, high, &bitmap[word_idx]);
+}
+
+/// ***************************************************************************
+/// Gather Kernels
+/// ***************************************************************************
+
+/**
+ * @brief This is the portable gather. Unsorted positions miss the cache on
+ *  almost every load, so the value GATHER_PREFETCH_DISTANCE positions ahead
+ *  is prefetched to overlap the misses.
+ */
+void gather_scalar(
+    const int* data,
+    const pos_t* positions,
+    size_t num_positions,
+    int* values
+) {
+    size_t idx = 0;
+    for (; idx + GATHER_PREFETCH_DISTANCE < num_positions; idx++) {
+        __builtin_prefetch(&data[positions[idx + GATHER_PREFETCH_DISTANCE]]);
+        values[idx] = data[positions[idx]];
+    }
+    for (; idx < num_positions; idx++) {
+        values[idx] = data[positions[idx]];
+    }
+}
+
+/**
+ * @brief AVX2 gather - loads 8 values with two gathers (the indexes are
+ *  widened to 64 bits so that every position is in range) while
+ *  prefetching the next ones
+ */
+__attribute__((target("avx2")))
+static void gather_avx2(
+    const int* data,
+    const pos_t* positions,
+    size_t num_positions,
+    int* values
+) {
+    size_t idx = 0;
+    for (; idx + 8 + GATHER_PREFETCH_DISTANCE <= num_positions; idx += 8) {
+        const pos_t* ahead = &positions[idx + GATHER_PREFETCH_DISTANCE];
+        for (size_t k = 0; k < 8; k++) {
+            __builtin_prefetch(&data[ahead[k]]);
+        }
+#if COMPACT_POSITIONS
+        __m256i rows = _mm256_loadu_si256((const __m256i*) &positions[idx]);
+        __m256i rows_lo = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(rows));
+        __m256i rows_hi = _mm256_cvtepu32_epi64(_mm256_extracti128_si256(rows, 1));
+#else
+        __m256i rows_lo = _mm256_loadu_si256((const __m256i*) &positions[idx]);
+        __m256i rows_hi = _mm256_loadu_si256((const __m256i*) &positions[idx + 4]);
+#endif
+        _mm_storeu_si128((__m128i*) &values[idx],
+                         _mm256_i64gather_epi32(data, rows_lo, sizeof(int)));
+        _mm_storeu_si128((__m128i*) &values[idx + 4],
+                         _mm256_i64gather_epi32(data, rows_hi, sizeof(int)));
+    }
+    gather_scalar(data, &positions[idx], num_positions - idx, &values[idx]);
+}
+
+/**
+ * @brief This function gathers sorted positions. They are read in order
+ *  (which the hardware prefetcher follows) and a run of consecutive
+ *  positions is just copied.
+ */
+static void gather_sorted(
+    const int* data,
+    const pos_t* positions,
+    size_t num_positions,
+    int* values
+) {
+    if (num_positions == 0) {
+        return;
+    }
+    if (positions[num_positions - 1] - positions[0] + 1 == num_positions) {
+        memcpy(values, &data[positions[0]], sizeof(int) * num_positions);
+        return;
+    }
+    for (size_t idx = 0; idx < num_positions; idx++) {
+        values[idx] = data[positions[idx]];
+    }
+}
+
+/// ***************************************************************************
+/// Kernel Dispatch
+/// ***************************************************************************
+
+static const SelectKernel select_kernels[] = {
+    { ISA_SCALAR, "scalar", select_range_scalar, select_bitmap_scalar, gather_scalar },
+    { ISA_SSE4, "sse4", select_range_sse4, select_bitmap_sse4, gather_scalar },
+    { ISA_AVX2, "avx2", select_range_avx2, select_bitmap_avx2, gather_avx2 },
+    { ISA_AVX512, "avx512", select_range_avx512, select_bitmap_avx512, gather_avx2 },
+};
+
+static const SelectKernel* best_kernel = &select_kernels[ISA_SCALAR];
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Function that checks the cpu once and picks the widest kernel
+ */
+static void init_select_kernels() {
+    init_compress_lut();
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        best_kernel = &select_kernels[ISA_AVX512];
+    } else if (__builtin_cpu_supports("avx2")) {
+        best_kernel = &select_kernels[ISA_AVX2];
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        best_kernel = &select_kernels[ISA_SSE4];
+    }
+    log_info("-- Select kernel: %s\n", best_kernel->name);
+}
+
+/**
+ * @brief This function returns the fastest select kernel for this machine
+ *
+ * @return the kernel
+ */
+const SelectKernel* get_select_kernel() {
+    pthread_once(&kernel_once, init_select_kernels);
+    return best_kernel;
+}
+
+/**
+ * @brief This function fetches the values at a list of positions
+ *
+ * @param data - the column
+ * @param positions
+ * @param num_positions
+ * @param sorted - whether the positions are known to be ascending
+ * @param values - output
+ */
+void gather_values(
+    const int* data,
+    const pos_t* positions,
+    size_t num_positions,
+    bool sorted,
+    int* values
+) {
+    if (sorted) {
+        gather_sorted(data, positions, num_positions, values);
+    } else {
+        get_select_kernel()->gather_func(data, positions, num_positions, values);
+    }
+}
+
+/**
+ * @brief This function returns the name of a select method (for logging)
+ *
+ * @param method
+ *
+ * @return the name
+ */
+const char* select_method_name(SelectMethod method) {
+    switch (method) {
+        case SELECT_BRANCHING:
+            return "branching";
+        case SELECT_PREDICATED:
+            return "predicated";
+        default:
+            return get_select_kernel()->name;
+    }
+}
+
+/**
+ * @brief This function picks the way a scan should be evaluated given its
+ *  estimated selectivity. When the branch is predictable (nearly nothing or
+ *  nearly everything matches) the branching loop beats the predicated one,
+ *  and it also beats the shuffle based vector kernels. Only a native
+ *  compress store (AVX-512) is faster at every selectivity.
+ *
+ * @param selectivity - the estimated fraction of matches
+ *
+ * @return the method to use
+ */
+SelectMethod choose_select_method(double selectivity) {
+    const SelectKernel* kernel = get_select_kernel();
+    bool predictable = (selectivity < BRANCHING_MAX_SELECTIVITY ||
+                        selectivity > 1 - BRANCHING_MAX_SELECTIVITY);
+    if (predictable && kernel->isa < ISA_AVX512) {
+        return SELECT_BRANCHING;
+    } else if (kernel->isa == ISA_SCALAR) {
+        return SELECT_PREDICATED;
+    }
+    return SELECT_SIMD;
+}
+
+/**
+ * @brief This function returns the kernel that evaluates a select method
+ *
+ * @param method
+ *
+ * @return the kernel function
+ */
+SelectKernelFunc select_method_kernel(SelectMethod method) {
+    switch (method) {
+        case SELECT_BRANCHING:
+            return select_range_branching;
+        case SELECT_PREDICATED:
+            return select_range_scalar;
+        default:
+            return get_select_kernel()->func;
+    }
+}
+
+/**
+ * @brief This function samples the data to be scanned and returns the
+ *  kernel that should be fastest for this predicate
+ *
+ * @param data - the values that will be scanned
+ * @param num_items - number of values
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param selectivity - where to store the estimate (can be NULL)
+ *
+ * @return the kernel function
+ */
+SelectKernelFunc choose_select_kernel(
+    const int* data,
+    size_t num_items,
+    int low,
+    int high,
+    double* selectivity
+) {
+    double estimate = estimate_selectivity(data, num_items, low, high);
+    SelectMethod method = choose_select_method(estimate);
+    cs165_log(stdout, "-- select [%d, %d) over %zu values: selectivity %.4f, %s kernel\n",
+              low, high, num_items, estimate, select_method_name(method));
+    if (selectivity) {
+        *selectivity = estimate;
+    }
+    return select_method_kernel(method);
+}
+
+/// ***************************************************************************
+/// Estimation Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function estimates the selectivity of a range predicate by
+ *  looking at an evenly strided sample of the data
+ *
+ * @param data - the values
+ * @param num_items - number of values
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ *
+ * @return the fraction of the sample that qualified
+ */
+double estimate_selectivity(const int* data, size_t num_items, int low, int high) {
+    if (num_items == 0) {
+        return 0;
+    }
+    size_t stride = MAX(num_items / SELECTIVITY_SAMPLE_SIZE, 1);
+    size_t num_sampled = 0;
+    size_t num_found = 0;
+    for (size_t idx = 0; idx < num_items; idx += stride) {
+        num_found += ((data[idx] >= low) & (data[idx] < high));
+        num_sampled++;
+    }
+    return (double) num_found / (double) num_sampled;
+}
+
+/// ***************************************************************************
+/// Bitmap Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function finds the next set bit in a bitmap
+ *
+ * @param bitmap - the bitmap words
+ * @param num_bits - number of valid bits
+ * @param from - the first bit to look at
+ *
+ * @return the index of the set bit (num_bits if nothing is left)
+ */
+size_t bitmap_next_set(const uint32_t* bitmap, size_t num_bits, size_t from) {
+    if (from >= num_bits) {
+        return num_bits;
+    }
+    size_t word_idx = from / BIT_SZ;
+    // mask off the bits before from in the first word
+    uint32_t word = bitmap[word_idx] & (~0U << (from % BIT_SZ));
+    while (word == 0) {
+        if (++word_idx >= BITMAP_WORDS(num_bits)) {
+            return num_bits;
+        }
+        word = bitmap[word_idx];
+    }
+    return MIN(word_idx * BIT_SZ + __builtin_ctz(word), num_bits);
+}
+
+/**
+ * @brief This function expands a bitmap into a list of positions
+ *
+ * @param bitmap - the bitmap words
+ * @param num_bits - number of valid bits
+ * @param positions - output (room for every set bit)
+ *
+ * @return number of positions written
+ */
+size_t bitmap_to_positions(const uint32_t* bitmap, size_t num_bits, pos_t* positions) {
+    size_t num_found = 0;
+    for (size_t word_idx = 0; word_idx < BITMAP_WORDS(num_bits); word_idx++) {
+        uint32_t word = bitmap[word_idx];
+        while (word) {
+            positions[num_found++] = word_idx * BIT_SZ + __builtin_ctz(word);
+            // clear the lowest set bit
+            word &= word - 1;
+        }
+    }
+    return num_found;
+}
+
+/// ***************************************************************************
+/// Interval Index Functions
+/// ***************************************************************************
+
+/**
+ * @brief Comparison function for sorting the endpoints
+ */
+static int compare_ints(const void* a, const void* b) {
+    int left = *(const int*) a;
+    int right = *(const int*) b;
+    return (left > right) - (left < right);
+}
+
+/**
+ * @brief This function returns the index of the first bound >= value
+ *
+ * @param bounds - sorted bounds
+ * @param num_bounds
+ * @param value
+ *
+ * @return the index (num_bounds if every bound is smaller)
+ */
+static size_t lower_bound(const int* bounds, size_t num_bounds, int value) {
+    size_t low = 0;
+    size_t high = num_bounds;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (bounds[mid] < value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief This function builds the interval index of a batch of ranges by
+ *  sweeping over their sorted endpoints
+ *
+ * @param lows - inclusive low bound of every query
+ * @param highs - exclusive high bound of every query
+ * @param num_queries
+ *
+ * @return the index (NULL if it would be too large)
+ */
+IntervalIndex* create_interval_index(const int* lows, const int* highs, size_t num_queries) {
+    // sort and dedup all of the endpoints
+    int* bounds = malloc(sizeof(int) * 2 * num_queries);
+    size_t num_bounds = 0;
+    for (size_t q_num = 0; q_num < num_queries; q_num++) {
+        if (lows[q_num] < highs[q_num]) {
+            bounds[num_bounds++] = lows[q_num];
+            bounds[num_bounds++] = highs[q_num];
+        }
+    }
+    qsort(bounds, num_bounds, sizeof(int), compare_ints);
+    size_t num_unique = 0;
+    for (size_t idx = 0; idx < num_bounds; idx++) {
+        if (num_unique == 0 || bounds[num_unique - 1] != bounds[idx]) {
+            bounds[num_unique++] = bounds[idx];
+        }
+    }
+    num_bounds = num_unique;
+    size_t num_segments = num_bounds > 0 ? num_bounds - 1 : 0;
+
+    // count the queries of every segment (the sweep), then turn the
+    // counts into offsets
+    size_t* offsets = calloc(num_segments + 1, sizeof(size_t));
+    size_t num_entries = 0;
+    for (size_t q_num = 0; q_num < num_queries; q_num++) {
+        if (lows[q_num] >= highs[q_num]) {
+            continue;
+        }
+        size_t first = lower_bound(bounds, num_bounds, lows[q_num]);
+        size_t last = lower_bound(bounds, num_bounds, highs[q_num]);
+        for (size_t seg = first; seg < last; seg++) {
+            offsets[seg + 1]++;
+        }
+        num_entries += last - first;
+    }
+    if (num_entries > INTERVAL_MAX_ENTRIES) {
+        free(bounds);
+        free(offsets);
+        return NULL;
+    }
+    for (size_t seg = 0; seg < num_segments; seg++) {
+        offsets[seg + 1] += offsets[seg];
+    }
+
+    // fill in the queries (in query order within every segment)
+    size_t* queries = malloc(sizeof(size_t) * MAX(num_entries, 1));
+    size_t* fill = malloc(sizeof(size_t) * MAX(num_segments, 1));
+    memcpy(fill, offsets, sizeof(size_t) * num_segments);
+    for (size_t q_num = 0; q_num < num_queries; q_num++) {
+        if (lows[q_num] >= highs[q_num]) {
+            continue;
+        }
+        size_t first = lower_bound(bounds, num_bounds, lows[q_num]);
+        size_t last = lower_bound(bounds, num_bounds, highs[q_num]);
+        for (size_t seg = first; seg < last; seg++) {
+            queries[fill[seg]++] = q_num;
+        }
+    }
+    free(fill);
+
+    IntervalIndex* index = malloc(sizeof(IntervalIndex));
+    index->num_bounds = num_bounds;
+    index->bounds = bounds;
+    index->offsets = offsets;
+    index->queries = queries;
+    return index;
+}
+
+/**
+ * @brief This function frees an interval index
+ *
+ * @param index
+ */
+void free_interval_index(IntervalIndex* index) {
+    if (index == NULL) {
+        return;
+    }
+    free(index->bounds);
+    free(index->offsets);
+    free(index->queries);
+    free(index);
+}
+
+/**
+ * @brief This function finds the queries whose range contains a value
+ *
+ * @param index
+ * @param value
+ * @param queries - set to the list of queries
+ *
+ * @return the number of queries
+ */
+size_t interval_index_lookup(const IntervalIndex* index, int value, const size_t** queries) {
+    // the segment is the last bound <= value
+    size_t seg = lower_bound(index->bounds, index->num_bounds, value);
+    if (seg == index->num_bounds || index->bounds[seg] != value) {
+        if (seg == 0) {
+            return 0;
+        }
+        seg--;
+    }
+    // values at or past the last bound are in no range
+    if (seg + 1 >= index->num_bounds) {
+        return 0;
+    }
+    *queries = &index->queries[index->offsets[seg]];
+    return index->offsets[seg + 1] - index->offsets[seg];
+}
@@ -2,8 +2,8 @@
 #include <string.h>
 #include <stdbool.h>
 #include "extensible_hash_table.h"
+#include "utils.h"
 #include <stdio.h>
-#include <time.h>
 
 
 /// ***************************************************************************
@@ -13,13 +13,15 @@
 /**
  * @brief Function to create hash result object
  *
+ * @param capacity - the number of results it holds
+ *
  * @return result
  */
-HashResults* create_hash_result() {
+static HashResults* create_hash_result(size_t capacity) {
     HashResults* hres = malloc(sizeof(HashResults));
     hres->num_found = 0;
-    hres->hr_capacity = MAX_BUCKET_SIZE;
-    hres->hb_results = malloc(hres->hr_capacity * sizeof(size_t));
+    hres->hr_capacity = capacity;
+    hres->hb_results = malloc(MAX(hres->hr_capacity, 1) * sizeof(pos_t));
     return hres;
 }
 
@@ -33,21 +35,6 @@ void free_hash_result(HashResults* hres) {
     free(hres);
 }
 
-/**
- * @brief Function for adding to the results of a hash table
- *
- * @param hres
- * @param result
- */
-void add_to_hb_results(HashResults* hres, size_t result) {
-    if (hres->num_found == hres->hr_capacity) {
-        hres->hr_capacity *= 2;  // double the size
-        hres->hb_results = realloc(hres->hb_results,
-                                   hres->hr_capacity * sizeof(size_t));
-    }
-    hres->hb_results[hres->num_found++] = result;
-}
-
 /// ***************************************************************************
 /// Extensible Hash bucket functions
 /// ***************************************************************************
@@ -57,12 +44,26 @@ void add_to_hb_results(HashResults* hres, size_t result) {
  *
  * @return ExtHashBucket* - pointer to ExtHashBucket
  */
-ExtHashBucket* create_hash_bucket() {
+static ExtHashBucket* create_hash_bucket() {
     ExtHashBucket* hb = malloc(sizeof(ExtHashBucket));
     hb->hb_size = hb->local_depth = 0;
+    hb->hb_overflow = NULL;
     return hb;
 }
 
+/**
+ * @brief Function that frees a bucket and its overflow buckets
+ *
+ * @param hb
+ */
+static void free_hash_bucket(ExtHashBucket* hb) {
+    while (hb != NULL) {
+        ExtHashBucket* next = hb->hb_overflow;
+        free(hb);
+        hb = next;
+    }
+}
+
 /**
  * @brief Function that returns whether we have a full bucket
  *
@@ -70,7 +71,7 @@ ExtHashBucket* create_hash_bucket() {
  *
  * @return bool if the values are equal
  */
-bool is_full_bucket(ExtHashBucket* hb) {
+static bool is_full_bucket(const ExtHashBucket* hb) {
     return hb->hb_size == MAX_BUCKET_SIZE;
 }
 
@@ -81,28 +82,28 @@ bool is_full_bucket(ExtHashBucket* hb) {
  * @param key - key to insert
  * @param value - value to insert
  */
-void hb_put(ExtHashBucket* hb, int key, size_t value) {
+static void hb_put(ExtHashBucket* hb, int key, pos_t value) {
     hb->hb_keys[hb->hb_size] = key;
     hb->hb_values[hb->hb_size++] = value;
 }
 
-
 /**
- * @brief Function to get all of the values for a key
- *
- * @param hb - takes in a hash bucket to query
- * @param key - takes in a key to lookup
+ * @brief Function that puts a pair in the overflow buckets of a full
+ *  bucket. New overflow buckets go right after the bucket, so the first
+ *  one is the only one that can have room.
  *
- * @return HashResult pointer that contains a list of the data
+ * @param hb - the full bucket
+ * @param key - key to insert
+ * @param value - value to insert
  */
-HashResults* hb_get(ExtHashBucket* hb, int key) {
-    HashResults* hres = create_hash_result();
-    for (size_t i = 0; i < hb->hb_size; i++) {
-        if (hb->hb_keys[i] == key) {
-            add_to_hb_results(hres, hb->hb_values[i]);
-        }
+static void hb_put_overflow(ExtHashBucket* hb, int key, pos_t value) {
+    if (hb->hb_overflow == NULL || is_full_bucket(hb->hb_overflow)) {
+        ExtHashBucket* new_bucket = create_hash_bucket();
+        new_bucket->local_depth = hb->local_depth;
+        new_bucket->hb_overflow = hb->hb_overflow;
+        hb->hb_overflow = new_bucket;
     }
-    return hres;
+    hb_put(hb->hb_overflow, key, value);
 }
 
 
@@ -128,26 +129,19 @@ ExtHashTable* create_ext_hash_table() {
 }
 
 /**
- * @brief This function frees a extensible hash table and all of its buckets
+ * @brief This function frees a extensible hash table and all of its buckets.
+ *  The directory entries of a bucket with local depth d all share their low
+ *  d bits, so walking the directory down the bucket is freed at its lowest
+ *  entry (the one below 2^d), after all its other entries were skipped.
  *
  * @param ext_ht
  */
 void free_ext_hash_table(ExtHashTable* ext_ht) {
-    while (ext_ht->num_exb-- > 0) {
-        // get the bucket
-        ExtHashBucket* bucket = ext_ht->hash_buckets[ext_ht->num_exb];
-        if (bucket == NULL) {
-            continue;
+    for (size_t i = ext_ht->num_exb; i-- > 0;) {
+        ExtHashBucket* bucket = ext_ht->hash_buckets[i];
+        if (i < ((size_t) 1 << bucket->local_depth)) {
+            free_hash_bucket(bucket);
         }
-        // set all other buckets that match to be null
-        for (size_t i = 0; i < ext_ht->num_exb; i++) {
-            if (ext_ht->hash_buckets[i] == bucket) {
-                ext_ht->hash_buckets[i] = NULL;
-            }
-        }
-        // then free the bucket
-        free(bucket);
-        ext_ht->hash_buckets[ext_ht->num_exb] = NULL;
     }
     free(ext_ht->hash_buckets);
     free(ext_ht);
@@ -160,7 +154,7 @@ void free_ext_hash_table(ExtHashTable* ext_ht) {
  *
  * @return hashed value
  */
-unsigned int ext_hash_func(unsigned int x) {
+static unsigned int ext_hash_func(unsigned int x) {
     x = ((x >> 16) ^ x) * 0x45d9f3b;
     x = ((x >> 16) ^ x) * 0x45d9f3b;
     x = (x >> 16) ^ x;
@@ -175,7 +169,7 @@ unsigned int ext_hash_func(unsigned int x) {
  *
  * @return
  */
-unsigned int get_hash_bucket_idx(ExtHashTable* ext_ht, int key) {
+static unsigned int get_hash_bucket_idx(const ExtHashTable* ext_ht, int key) {
     unsigned int h = ext_hash_func((unsigned int) key);
     return h & (( 1 << ext_ht->global_depth) - 1);
 }
@@ -188,92 +182,239 @@ unsigned int get_hash_bucket_idx(ExtHashTable* ext_ht, int key) {
  *
  * @return ExtHashBucket* - bucket that is related to the function
  */
-ExtHashBucket* get_ext_hash_bucket(ExtHashTable* ext_ht, int key) {
-    unsigned int idx = get_hash_bucket_idx(ext_ht, key);
-    return ext_ht->hash_buckets[idx];
-    /* return ext_ht->hash_buckets[get_hash_bucket_idx(ext_ht, key)]; */
+static ExtHashBucket* get_ext_hash_bucket(const ExtHashTable* ext_ht, int key) {
+    return ext_ht->hash_buckets[get_hash_bucket_idx(ext_ht, key)];
 }
 
+/**
+ * @brief Function that returns whether splitting a full bucket would move
+ *  anything. A bucket with overflow buckets (or at the max depth) is never
+ *  split, and neither is one whose keys all have the same hash (up to the
+ *  max depth) - those are duplicates or collisions no split can separate.
+ *
+ * @param hb - the full bucket
+ *
+ * @return bool
+ */
+static bool can_split_bucket(const ExtHashBucket* hb) {
+    if (hb->hb_overflow != NULL || hb->local_depth >= EXT_HT_MAX_DEPTH) {
+        return false;
+    }
+    unsigned int depth_mask = (1U << EXT_HT_MAX_DEPTH) - 1;
+    unsigned int first_hash = ext_hash_func((unsigned int) hb->hb_keys[0]);
+    for (size_t i = 1; i < hb->hb_size; i++) {
+        unsigned int h = ext_hash_func((unsigned int) hb->hb_keys[i]);
+        if (((h ^ first_hash) & depth_mask) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Function that doubles the directory, the new half points to the
+ *  same buckets as the old one
+ *
+ * @param ext_ht
+ */
+static void double_directory(ExtHashTable* ext_ht) {
+    ext_ht->global_depth++;
+    // increase the array for buckets if necessary
+    if (ext_ht->num_exb == ext_ht->max_exbs) {
+        ext_ht->max_exbs *= 2;
+        ext_ht->hash_buckets = realloc(
+                ext_ht->hash_buckets,
+                ext_ht->max_exbs * sizeof(ExtHashBucket*));
+    }
+    // copy over the buckets so they point correctly
+    memcpy(&ext_ht->hash_buckets[ext_ht->num_exb],
+           &ext_ht->hash_buckets[0],
+           ext_ht->num_exb * sizeof(ExtHashBucket*));
+    // now double the size
+    ext_ht->num_exb *= 2;
+}
+
+/**
+ * @brief Function that splits a bucket on the next bit of its hashes. The
+ *  local depth of the bucket has to be below the global depth.
+ *
+ * @param ext_ht
+ * @param ext_hb - the bucket to split
+ * @param hash_idx - a directory entry of the bucket
+ */
+static void split_bucket(ExtHashTable* ext_ht, ExtHashBucket* ext_hb,
+                         unsigned int hash_idx) {
+    size_t split_bit = ext_hb->local_depth;
+    ExtHashBucket* new_bucket = create_hash_bucket();
+    // number of items to add
+    size_t num_items = ext_hb->hb_size;
+    // reset the bucket size for the current bucket
+    ext_hb->hb_size = 0;
+    // redistribute the values between the two buckets
+    for (size_t i = 0; i < num_items; i++) {
+        int k = ext_hb->hb_keys[i];
+        pos_t v = ext_hb->hb_values[i];
+        // place in the correct new bucket
+        if (((ext_hash_func((unsigned int) k) >> split_bit) & 1) == 1) {
+            hb_put(new_bucket, k, v);
+        } else {
+            hb_put(ext_hb, k, v);
+        }
+    }
+    // the directory entries of the bucket are the ones that share its low
+    // local depth bits, the ones with the split bit set now point to the
+    // new bucket
+    size_t stride = (size_t) 1 << split_bit;
+    for (size_t i = hash_idx & (stride - 1); i < ext_ht->num_exb; i += stride) {
+        if (((i >> split_bit) & 1) == 1) {
+            ext_ht->hash_buckets[i] = new_bucket;
+        }
+    }
+    ext_hb->local_depth++;
+    new_bucket->local_depth = ext_hb->local_depth;
+}
 
 /**
- * @brief Function that adds the item to the table
+ * @brief Function that adds the item to the table. While the bucket the
+ *  item goes to is full it is split (doubling the directory when the
+ *  bucket is as deep as it), and once a split can't help the item goes to
+ *  an overflow bucket instead, so a put always ends.
  *
  * @param ext_ht
  * @param key
  * @param value
  */
-size_t recurse_limit = 0;
-void ext_hash_table_put(ExtHashTable* ext_ht, int key, size_t value) {
-    unsigned int hash_idx = get_hash_bucket_idx(ext_ht, key);
-    ExtHashBucket* ext_hb = ext_ht->hash_buckets[hash_idx];
-
-    // if we have a local bucket and it equals the local depth, increase
-    // the size of the table
-    if (is_full_bucket(ext_hb) == false) {
-        hb_put(ext_hb, key, value);
-        recurse_limit = 0;
-        return;
-    } else if (ext_hb->local_depth == ext_ht->global_depth) {
-        // if the table is full and the local depth equals the global
-        // depth, increase the size and try to add
-        ext_ht->global_depth++;
-        // increase the array for buckets if necessary
-        if (ext_ht->num_exb == ext_ht->max_exbs) {
-            ext_ht->max_exbs *= 2;
-            // increase the the array for buckets
-            ext_ht->hash_buckets = realloc(
-                    ext_ht->hash_buckets,
-                    ext_ht->max_exbs * sizeof(ExtHashBucket*));
+void ext_hash_table_put(ExtHashTable* ext_ht, int key, pos_t value) {
+    while (true) {
+        unsigned int hash_idx = get_hash_bucket_idx(ext_ht, key);
+        ExtHashBucket* ext_hb = ext_ht->hash_buckets[hash_idx];
+        if (is_full_bucket(ext_hb) == false) {
+            hb_put(ext_hb, key, value);
+            return;
+        } else if (can_split_bucket(ext_hb) == false) {
+            hb_put_overflow(ext_hb, key, value);
+            return;
+        }
+        if (ext_hb->local_depth == ext_ht->global_depth) {
+            double_directory(ext_ht);
         }
-        // copy over the buckets so they point correctly
-        memcpy(&ext_ht->hash_buckets[ext_ht->num_exb],
-               &ext_ht->hash_buckets[0],
-               ext_ht->num_exb * sizeof(ExtHashBucket*));
-        // now double the size
-        ext_ht->num_exb *= 2;
+        split_bucket(ext_ht, ext_hb, hash_idx);
     }
+}
 
-    // we have now resized our shit
-    if (ext_hb->local_depth < ext_ht->global_depth) {
-        // make a new bucket
-        ExtHashBucket* new_bucket = create_hash_bucket();
-        // number of items to add
-        size_t num_items = ext_hb->hb_size;
-        // reset the bucket size for the current bucket
-        ext_hb->hb_size = 0;
-        // redistribute the values between the two buckets
-        for (size_t i = 0; i < num_items; i++) {
-            int k = ext_hb->hb_keys[i];
-            size_t v = ext_hb->hb_values[i];
-            // re hash the balue
-            unsigned int hash_v = ext_hash_func((unsigned int) k);
-            hash_v = hash_v & ((1 << ext_ht->global_depth) - 1);
-            // place in the correct new bucket
-            if (((hash_v >> ext_hb->local_depth) & 1) == 1) {
-                hb_put(new_bucket, k, v);
-            } else {
-                hb_put(ext_hb, k, v);
+
+/// ***************************************************************************
+/// Probe Functions
+/// ***************************************************************************
+
+/**
+ * @brief Function that points a cursor at the values of a key
+ *
+ * @param ext_ht
+ * @param key
+ * @param cursor - the cursor to set up
+ */
+void ext_hash_table_find(const ExtHashTable* ext_ht, int key, ExtHashCursor* cursor) {
+    cursor->bucket = get_ext_hash_bucket(ext_ht, key);
+    cursor->slot = 0;
+    cursor->key = key;
+}
+
+/**
+ * @brief Function that moves a cursor to the next value of its key. The
+ *  values of a key come in no particular order.
+ *
+ * @param cursor
+ * @param value - set to the value
+ *
+ * @return bool - false once there are no more values
+ */
+bool ext_hash_cursor_next(ExtHashCursor* cursor, pos_t* value) {
+    while (cursor->bucket != NULL) {
+        const ExtHashBucket* hb = cursor->bucket;
+        while (cursor->slot < hb->hb_size) {
+            size_t i = cursor->slot++;
+            if (hb->hb_keys[i] == cursor->key) {
+                *value = hb->hb_values[i];
+                return true;
             }
         }
-        ext_hb->local_depth++;
-        new_bucket->local_depth = ext_hb->local_depth;
-        ext_ht->hash_buckets[hash_idx + (ext_ht->num_exb / 2)] = new_bucket;
-        // after redistributing, call the function again
-        if (recurse_limit++ == 10) {
-            // this means there was a terrible error and we tried to
-            // rebalance the nodes 10 times
-            exit(-1);
+        cursor->bucket = hb->hb_overflow;
+        cursor->slot = 0;
+    }
+    return false;
+}
+
+/**
+ * @brief Function that counts the values of a key
+ *
+ * @param ext_ht
+ * @param key
+ *
+ * @return the number of values
+ */
+size_t ext_hash_table_count(const ExtHashTable* ext_ht, int key) {
+    size_t num_found = 0;
+    for (const ExtHashBucket* hb = get_ext_hash_bucket(ext_ht, key);
+            hb != NULL; hb = hb->hb_overflow) {
+        for (size_t i = 0; i < hb->hb_size; i++) {
+            num_found += hb->hb_keys[i] == key;
         }
-        ext_hash_table_put(ext_ht, key, value);
-        return;
-    } else {
-        // there was an error
-        exit(-1);
     }
+    return num_found;
 }
 
 /**
- * @brief Function that gets the values for a given key (from the table)
+ * @brief Function that probes the table with many keys. The keys are taken
+ *  EXT_HT_PROBE_BATCH at a time: the whole batch is hashed and its buckets
+ *  prefetched before any of them is scanned, so the cache misses of the
+ *  batch overlap instead of coming one after another.
+ *
+ * @param ext_ht
+ * @param keys - the keys to look up
+ * @param num_keys
+ * @param on_match - called for every match (or NULL to only count them)
+ * @param arg - passed to on_match
+ *
+ * @return the number of matches
+ */
+size_t ext_hash_table_probe_batch(
+    const ExtHashTable* ext_ht,
+    const int* keys,
+    size_t num_keys,
+    ExtHashMatchFunc on_match,
+    void* arg
+) {
+    const ExtHashBucket* buckets[EXT_HT_PROBE_BATCH];
+    size_t num_matches = 0;
+    for (size_t start = 0; start < num_keys; start += EXT_HT_PROBE_BATCH) {
+        size_t batch_sz = MIN(EXT_HT_PROBE_BATCH, num_keys - start);
+        // the bucket header and its first keys share a cache line
+        for (size_t b = 0; b < batch_sz; b++) {
+            buckets[b] = get_ext_hash_bucket(ext_ht, keys[start + b]);
+            __builtin_prefetch(buckets[b], 0, 1);
+        }
+        for (size_t b = 0; b < batch_sz; b++) {
+            int key = keys[start + b];
+            for (const ExtHashBucket* hb = buckets[b]; hb != NULL; hb = hb->hb_overflow) {
+                for (size_t i = 0; i < hb->hb_size; i++) {
+                    if (hb->hb_keys[i] != key) {
+                        continue;
+                    }
+                    if (on_match != NULL) {
+                        on_match(arg, start + b, hb->hb_values[i]);
+                    }
+                    num_matches++;
+                }
+            }
+        }
+    }
+    return num_matches;
+}
+
+/**
+ * @brief Function that gets the values for a given key (from the table).
+ *  The result is sized exactly, use the cursor to avoid the allocation.
  *
  * @param ext_ht
  * @param key
@@ -281,7 +422,13 @@ void ext_hash_table_put(ExtHashTable* ext_ht, int key, size_t value) {
  * @return
  */
 HashResults* ext_hash_func_get(ExtHashTable* ext_ht, int key) {
-    return hb_get(get_ext_hash_bucket(ext_ht, key), key);
+    HashResults* hres = create_hash_result(ext_hash_table_count(ext_ht, key));
+    ExtHashCursor cursor;
+    ext_hash_table_find(ext_ht, key, &cursor);
+    while (ext_hash_cursor_next(&cursor, &hres->hb_results[hres->num_found])) {
+        hres->num_found++;
+    }
+    return hres;
 }
 
 
@@ -289,57 +436,79 @@ HashResults* ext_hash_func_get(ExtHashTable* ext_ht, int key) {
 /// Testing Functions
 /// ***************************************************************************
 
-#if 0
-void print_bucket(ExtHashBucket* bucket) {
-    for (size_t i = 0; i < bucket->hb_size; i++) {
-        printf("\t(key: %d, value: %zu)\n",
-                bucket->hb_keys[i],
-                bucket->hb_values[i]);
-    }
+// build with `make ext_hash_table_test` (the table has no server caller)
+#ifdef EXT_HASH_TABLE_TEST
+#include <assert.h>
+
+#define TEST_NUM_ROWS 200000
+#define TEST_NUM_KEYS 50000
+#define TEST_HOT_KEY 7
+
+/**
+ * @brief The key of a test row: a third of the rows share one key (many
+ *  more than a bucket holds), the others spread over TEST_NUM_KEYS keys
+ */
+static int test_key(size_t row) {
+    return row % 3 == 0 ? TEST_HOT_KEY : (int) ((row * 2654435761U) % TEST_NUM_KEYS);
 }
-void print_ext_hash_table(ExtHashTable* ht) {
-    size_t num_buckets = 0;
-    ExtHashBucket* buckets[ht->num_exb];
-    for (size_t i = 0; i < ht->num_exb; i++) {
-        bool found = false;
-        printf("Bucket %zu\n", i);
-        ExtHashBucket* bucket = ht->hash_buckets[i];
-        for (size_t j = 0; j < num_buckets; j++) {
-            if (buckets[j] == bucket) {
-                found = true;
-                printf("Resused bucket\n");
-                break;
+
+static void add_match(void* arg, size_t key_idx, pos_t value) {
+    long* sums = (long*) arg;
+    sums[key_idx] += value;
+}
+
+int main(void) {
+    ExtHashTable* ht = create_ext_hash_table();
+    for (size_t row = 0; row < TEST_NUM_ROWS; row++) {
+        ext_hash_table_put(ht, test_key(row), (pos_t) row);
+    }
+    // the spread keys split the buckets, the hot key can't be split apart
+    assert(ht->global_depth > 0);
+    assert(get_ext_hash_bucket(ht, TEST_HOT_KEY)->hb_overflow != NULL);
+
+    // present, hot and absent keys
+    int keys[] = {TEST_HOT_KEY, 0, 1, 4242, TEST_NUM_KEYS - 1, -1, TEST_NUM_KEYS};
+    size_t num_keys = sizeof(keys) / sizeof(keys[0]);
+    long sums[sizeof(keys) / sizeof(keys[0])] = {0};
+    size_t total_count = 0;
+    for (size_t k = 0; k < num_keys; k++) {
+        size_t count = 0;
+        long sum = 0;
+        for (size_t row = 0; row < TEST_NUM_ROWS; row++) {
+            if (test_key(row) == keys[k]) {
+                count++;
+                sum += row;
             }
         }
-        if (found == false) {
-            buckets[num_buckets++] = bucket;
+        total_count += count;
+
+        assert(ext_hash_table_count(ht, keys[k]) == count);
+        ExtHashCursor cursor;
+        pos_t value;
+        size_t cursor_count = 0;
+        long cursor_sum = 0;
+        ext_hash_table_find(ht, keys[k], &cursor);
+        while (ext_hash_cursor_next(&cursor, &value)) {
+            cursor_count++;
+            cursor_sum += value;
         }
-        print_bucket(bucket);
-    }
-}
+        assert(cursor_count == count && cursor_sum == sum);
 
-void print_hash_results(ExtHashTable* ht, int key) {
-    printf("Results for key %d:\n", key);
-    HashResults* results = ext_hash_func_get(ht, key);
-    for (size_t i = 0; i < results->num_found; i++) {
-        printf("\t%zu\n", results->hb_results[i]);
+        HashResults* hres = ext_hash_func_get(ht, keys[k]);
+        assert(hres->num_found == count);
+        free_hash_result(hres);
+        sums[k] = sum;
     }
-    free_hash_result(results);
-}
 
-int main(void) {
-    ExtHashTable* ht = create_ext_hash_table();
-    srand(time(NULL));
-    for (int value = 0; value < 10; value++) {
-        /* int key = rand(); */
-        int key = value - 1;
-        printf("\n Inserting %d, at %d\n", key, value);
-        ext_hash_table_put(ht, key, value);
+    long batch_sums[sizeof(keys) / sizeof(keys[0])] = {0};
+    assert(ext_hash_table_probe_batch(ht, keys, num_keys, add_match, batch_sums) ==
+           total_count);
+    assert(ext_hash_table_probe_batch(ht, keys, num_keys, NULL, NULL) == total_count);
+    for (size_t k = 0; k < num_keys; k++) {
+        assert(batch_sums[k] == sums[k]);
     }
-    ext_hash_table_put(ht, 3, 6);
-    print_ext_hash_table(ht);
-    print_hash_results(ht, 3);
     free_ext_hash_table(ht);
+    printf("extensible hash table tests passed\n");
     return 0;
 }
 #endif
@@ -1,19 +1,27 @@
 #ifndef EXT_HASH_TABLE_H
 #define EXT_HASH_TABLE_H
 #include <stdlib.h>
+#include <stdbool.h>
+#include "cs165_api.h"
 
 // calculation for the bucket size - we want it to fit in a page
-/* 4 * n + 8 * n + 16 */
-/* 12n + 16 = 4096 */
-/* #define MAX_BUCKET_SIZE 340 */
-#define MAX_BUCKET_SIZE 340
+/* 4 * n + sizeof(pos_t) * n + 3 * 8 */
+/* (4 + sizeof(pos_t))n + 24 = 4096 */
+/* #define MAX_BUCKET_SIZE 509 */
+#define MAX_BUCKET_SIZE ((PAGE_SZ - 3 * sizeof(size_t)) / (sizeof(int) + sizeof(pos_t)))
 #define NUM_BUCKET_INIT 64
+// the directory stops doubling at this depth, full buckets past it (or
+// full of one hash value) get overflow buckets instead of being split
+#define EXT_HT_MAX_DEPTH 24
+// the number of keys a batched probe hashes (and prefetches) at a time
+#define EXT_HT_PROBE_BATCH 16
 
 typedef struct ExtHashBucket {
     size_t hb_size;
     size_t local_depth;
+    struct ExtHashBucket* hb_overflow;  // chained when a split can't help
     int hb_keys[MAX_BUCKET_SIZE];
-    size_t hb_values[MAX_BUCKET_SIZE];
+    pos_t hb_values[MAX_BUCKET_SIZE];
 } ExtHashBucket;
 
 
@@ -27,16 +35,43 @@ typedef struct ExtHashTable {
 typedef struct HashResults {
     size_t num_found;
     size_t hr_capacity;
-    size_t* hb_results;
+    pos_t* hb_results;
 } HashResults;
 
+/**
+ * @brief A cursor over the values of one key. It points into the table so
+ *  it is only valid until the next put.
+ */
+typedef struct ExtHashCursor {
+    const ExtHashBucket* bucket;
+    size_t slot;
+    int key;
+} ExtHashCursor;
+
+// called by the batched probe for every match, with the index of the key
+// in the batch and the value that matched it
+typedef void (*ExtHashMatchFunc)(void* arg, size_t key_idx, pos_t value);
+
 
 // creation functions
 ExtHashTable* create_ext_hash_table();
 void free_ext_hash_table(ExtHashTable* ext_ht);
 
 // setters
-void ext_hash_table_put(ExtHashTable* ext_ht, int key, size_t value);
+void ext_hash_table_put(ExtHashTable* ext_ht, int key, pos_t value);
+
+// probe functions (these don't allocate and can run in several threads
+// at once as long as nothing is put)
+void ext_hash_table_find(const ExtHashTable* ext_ht, int key, ExtHashCursor* cursor);
+bool ext_hash_cursor_next(ExtHashCursor* cursor, pos_t* value);
+size_t ext_hash_table_count(const ExtHashTable* ext_ht, int key);
+size_t ext_hash_table_probe_batch(
+    const ExtHashTable* ext_ht,
+    const int* keys,
+    size_t num_keys,
+    ExtHashMatchFunc on_match,
+    void* arg
+);
 
 // result function
 HashResults* ext_hash_func_get(ExtHashTable* ext_ht, int key);
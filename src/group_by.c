@@ -0,0 +1,575 @@
+#include <limits.h>
+#include <string.h>
+#include "group_by.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+// marks a free slot
+#define GROUP_EMPTY UINT32_MAX
+// the groups a table is sized for up front
+#define GROUP_DEFAULT_GROUPS 1024
+// fibonacci hashing: the top bits of key * 2^64 / phi are well mixed
+#define GROUP_HASH_MULT 0x9E3779B97F4A7C15ULL
+
+/// ***************************************************************************
+/// Aggregation Table
+/// ***************************************************************************
+
+typedef struct GroupSlot {
+    int key;
+    uint32_t group;
+} GroupSlot;
+
+/**
+ * @brief An open addressing (linear probing) aggregation table. A slot is
+ *  just a key and the index of its group so that eight of them share a
+ *  cache line, the keys and accumulators of the groups are kept densely in
+ *  order of first appearance. The top GROUP_PARTITION_BITS of the hash pick
+ *  the partition of a key, a table uses the bits below them.
+ */
+typedef struct GroupTable {
+    GroupAggregate aggregate;
+    GroupSlot* slots;
+    size_t num_slots;           // a power of two
+    unsigned shift;             // 64 - log2(num_slots)
+    GroupResult groups;
+    size_t allocated_groups;
+} GroupTable;
+
+/**
+ * @brief This function hashes a key
+ *
+ * @param key
+ *
+ * @return the hash
+ */
+static inline uint64_t group_hash(int key) {
+    return (uint64_t) (uint32_t) key * GROUP_HASH_MULT;
+}
+
+/**
+ * @brief This function allocates the slots of a table and marks them free
+ *
+ * @param table
+ * @param num_slots - a power of two
+ */
+static void alloc_group_slots(GroupTable* table, size_t num_slots) {
+    table->num_slots = num_slots;
+    table->shift = 64 - __builtin_ctzll(num_slots);
+    table->slots = malloc(sizeof(GroupSlot) * num_slots);
+    for (size_t i = 0; i < num_slots; i++) {
+        table->slots[i].group = GROUP_EMPTY;
+    }
+}
+
+/**
+ * @brief This function creates an aggregation table
+ *
+ * @param aggregate - what is computed per group
+ * @param expected_groups - the number of groups to size it for
+ *
+ * @return the table
+ */
+static GroupTable* create_group_table(GroupAggregate aggregate, size_t expected_groups) {
+    GroupTable* table = malloc(sizeof(GroupTable));
+    table->aggregate = aggregate;
+    size_t num_slots = 16;
+    while (num_slots < expected_groups * 2) {
+        num_slots *= 2;
+    }
+    alloc_group_slots(table, num_slots);
+    table->allocated_groups = MAX(expected_groups, 16);
+    table->groups.num_groups = 0;
+    table->groups.keys = malloc(sizeof(int) * table->allocated_groups);
+    table->groups.accs = malloc(sizeof(long) * table->allocated_groups);
+    table->groups.counts = malloc(sizeof(long) * table->allocated_groups);
+    return table;
+}
+
+/**
+ * @brief This function frees a table (and its groups unless they were
+ *  handed out)
+ *
+ * @param table
+ */
+static void free_group_table(GroupTable* table) {
+    free(table->slots);
+    free_group_result(&table->groups);
+    free(table);
+}
+
+/**
+ * @brief This function returns the slot a key's probe starts at
+ *
+ * @param table
+ * @param key
+ *
+ * @return the slot
+ */
+static inline size_t group_home_slot(const GroupTable* table, int key) {
+    return (size_t) ((group_hash(key) << GROUP_PARTITION_BITS) >> table->shift);
+}
+
+/**
+ * @brief This function doubles the slots of a table once it is half full
+ *  (the groups are dense so they are just inserted again)
+ *
+ * @param table
+ */
+static void grow_group_slots(GroupTable* table) {
+    free(table->slots);
+    alloc_group_slots(table, table->num_slots * 2);
+    size_t mask = table->num_slots - 1;
+    for (size_t group = 0; group < table->groups.num_groups; group++) {
+        int key = table->groups.keys[group];
+        size_t slot = group_home_slot(table, key);
+        while (table->slots[slot].group != GROUP_EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+        table->slots[slot].key = key;
+        table->slots[slot].group = group;
+    }
+}
+
+/**
+ * @brief This function adds a group for a key. Its accumulator starts at
+ *  the identity of the aggregate.
+ *
+ * @param table
+ * @param key
+ *
+ * @return the index of the group
+ */
+static size_t add_group(GroupTable* table, int key) {
+    GroupResult* groups = &table->groups;
+    if (groups->num_groups == table->allocated_groups) {
+        table->allocated_groups *= 2;
+        groups->keys = realloc(groups->keys, sizeof(int) * table->allocated_groups);
+        groups->accs = realloc(groups->accs, sizeof(long) * table->allocated_groups);
+        groups->counts = realloc(groups->counts, sizeof(long) * table->allocated_groups);
+    }
+    size_t group = groups->num_groups++;
+    groups->keys[group] = key;
+    groups->counts[group] = 0;
+    groups->accs[group] = table->aggregate == GROUP_MIN ? LONG_MAX :
+        table->aggregate == GROUP_MAX ? LONG_MIN : 0;
+    return group;
+}
+
+/**
+ * @brief This function finds the group of a key, adding it if it is new
+ *
+ * @param table
+ * @param key
+ *
+ * @return the index of the group
+ */
+static inline size_t group_of(GroupTable* table, int key) {
+    size_t mask = table->num_slots - 1;
+    size_t slot = group_home_slot(table, key);
+    while (table->slots[slot].group != GROUP_EMPTY) {
+        if (table->slots[slot].key == key) {
+            return table->slots[slot].group;
+        }
+        slot = (slot + 1) & mask;
+    }
+    size_t group = add_group(table, key);
+    if (table->groups.num_groups * 2 > table->num_slots) {
+        // the new group is placed by the rehash
+        grow_group_slots(table);
+        return group;
+    }
+    table->slots[slot].key = key;
+    table->slots[slot].group = group;
+    return group;
+}
+
+/**
+ * @brief This function folds the groups of one table into another
+ *
+ * @param table - the table to add to
+ * @param other
+ */
+static void merge_group_tables(GroupTable* table, const GroupTable* other) {
+    const GroupResult* from = &other->groups;
+    GroupResult* into = &table->groups;
+    for (size_t i = 0; i < from->num_groups; i++) {
+        size_t group = group_of(table, from->keys[i]);
+        into->counts[group] += from->counts[i];
+        switch (table->aggregate) {
+            case GROUP_MIN:
+                into->accs[group] = MIN(into->accs[group], from->accs[i]);
+                break;
+            case GROUP_MAX:
+                into->accs[group] = MAX(into->accs[group], from->accs[i]);
+                break;
+            default:
+                into->accs[group] += from->accs[i];
+                break;
+        }
+    }
+}
+
+/// ***************************************************************************
+/// Aggregation Loops
+/// ***************************************************************************
+
+/**
+ * @brief Makes the loop that adds the rows of a value type to a table. The
+ *  aggregate is switched on once so every loop has a single update.
+ */
+#define DEFINE_GROUP_ROWS(NAME, TYPE)                                           \
+    static void NAME##_group_rows(GroupTable* table, const int* keys,           \
+                                  const TYPE* values, size_t num_rows) {        \
+        GroupResult* groups = &table->groups;                                   \
+        switch (table->aggregate) {                                             \
+            case GROUP_COUNT:                                                   \
+                for (size_t i = 0; i < num_rows; i++) {                         \
+                    size_t group = group_of(table, keys[i]);                    \
+                    groups->counts[group]++;                                    \
+                }                                                               \
+                break;                                                          \
+            case GROUP_MIN:                                                     \
+                for (size_t i = 0; i < num_rows; i++) {                         \
+                    size_t group = group_of(table, keys[i]);                    \
+                    groups->counts[group]++;                                    \
+                    groups->accs[group] = MIN(groups->accs[group], (long) values[i]); \
+                }                                                               \
+                break;                                                          \
+            case GROUP_MAX:                                                     \
+                for (size_t i = 0; i < num_rows; i++) {                         \
+                    size_t group = group_of(table, keys[i]);                    \
+                    groups->counts[group]++;                                    \
+                    groups->accs[group] = MAX(groups->accs[group], (long) values[i]); \
+                }                                                               \
+                break;                                                          \
+            default:                                                            \
+                for (size_t i = 0; i < num_rows; i++) {                         \
+                    size_t group = group_of(table, keys[i]);                    \
+                    groups->counts[group]++;                                    \
+                    groups->accs[group] += (long) values[i];                    \
+                }                                                               \
+                break;                                                          \
+        }                                                                       \
+    }
+
+DEFINE_GROUP_ROWS(int, int)
+DEFINE_GROUP_ROWS(long, long)
+DEFINE_GROUP_ROWS(index, pos_t)
+
+/**
+ * @brief This function adds the rows [first_row, first_row + num_rows) of
+ *  an input to a table
+ *
+ * @param table
+ * @param keys
+ * @param value_type - INT, LONG or INDEX
+ * @param values - NULL for a count
+ * @param first_row
+ * @param num_rows
+ */
+static void group_rows(GroupTable* table, const int* keys, DataType value_type,
+                       const void* values, size_t first_row, size_t num_rows) {
+    keys += first_row;
+    if (values == NULL) {
+        int_group_rows(table, keys, NULL, num_rows);
+        return;
+    }
+    switch (value_type) {
+        case LONG:
+            long_group_rows(table, keys, (const long*) values + first_row, num_rows);
+            break;
+        case INDEX:
+            index_group_rows(table, keys, (const pos_t*) values + first_row, num_rows);
+            break;
+        default:
+            int_group_rows(table, keys, (const int*) values + first_row, num_rows);
+            break;
+    }
+}
+
+/**
+ * @brief This function reads one value of an input as a long
+ *
+ * @param value_type - INT, LONG or INDEX
+ * @param values
+ * @param idx
+ *
+ * @return the value
+ */
+static inline long value_at(DataType value_type, const void* values, size_t idx) {
+    switch (value_type) {
+        case LONG:
+            return ((const long*) values)[idx];
+        case INDEX:
+            return ((const pos_t*) values)[idx];
+        default:
+            return ((const int*) values)[idx];
+    }
+}
+
+/// ***************************************************************************
+/// Parallel Aggregation
+/// ***************************************************************************
+
+// one task of a parallel group by: a slice of the input (or a partition)
+typedef struct GroupTask {
+    GroupAggregate aggregate;
+    const int* keys;
+    DataType value_type;
+    const void* values;
+    size_t first_row;
+    size_t num_rows;
+    size_t part_offsets[GROUP_NUM_PARTITIONS];  // rows per partition, then
+                                                // where the slice writes them
+    int* part_keys;
+    long* part_values;
+    GroupTable* table;
+} GroupTask;
+
+/**
+ * @brief This function returns how many tasks a large input is split into
+ *
+ * @param num_rows
+ *
+ * @return the number of tasks (at least 1)
+ */
+static size_t group_parallelism(size_t num_rows) {
+    size_t num_tasks = MIN(thread_pool_parallelism(), num_rows / GROUP_CHUNK_SZ);
+    return MAX(MIN(num_tasks, MAX_POOL_THREADS), 1);
+}
+
+/**
+ * @brief This function runs a task per slice on the pool and waits for them
+ *
+ * @param func
+ * @param tasks
+ * @param num_tasks
+ */
+static void run_group_tasks(TaskFunc func, GroupTask* tasks, size_t num_tasks) {
+    TaskGroup group;
+    task_group_init(&group);
+    for (size_t t = 0; t < num_tasks; t++) {
+        thread_pool_submit(&group, func, &tasks[t]);
+    }
+    task_group_wait(&group);
+}
+
+/**
+ * @brief This worker aggregates a slice into a table of its own
+ *
+ * @param task_arg - a GroupTask
+ *
+ * @return NULL
+ */
+static void* group_slice_worker(void* task_arg) {
+    GroupTask* task = (GroupTask*) task_arg;
+    task->table = create_group_table(task->aggregate, GROUP_LOCAL_MAX_GROUPS);
+    group_rows(task->table, task->keys, task->value_type, task->values,
+               task->first_row, task->num_rows);
+    return NULL;
+}
+
+/**
+ * @brief This worker counts the rows of a slice that go to each partition
+ *
+ * @param task_arg - a GroupTask
+ *
+ * @return NULL
+ */
+static void* partition_count_worker(void* task_arg) {
+    GroupTask* task = (GroupTask*) task_arg;
+    memset(task->part_offsets, 0, sizeof(task->part_offsets));
+    const int* keys = task->keys + task->first_row;
+    for (size_t i = 0; i < task->num_rows; i++) {
+        task->part_offsets[group_hash(keys[i]) >> (64 - GROUP_PARTITION_BITS)]++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief This worker copies the rows of a slice to their partitions (the
+ *  values are widened to longs on the way)
+ *
+ * @param task_arg - a GroupTask
+ *
+ * @return NULL
+ */
+static void* partition_scatter_worker(void* task_arg) {
+    GroupTask* task = (GroupTask*) task_arg;
+    for (size_t i = task->first_row; i < task->first_row + task->num_rows; i++) {
+        size_t dest = task->part_offsets[group_hash(task->keys[i]) >> (64 - GROUP_PARTITION_BITS)]++;
+        task->part_keys[dest] = task->keys[i];
+        if (task->values != NULL) {
+            task->part_values[dest] = value_at(task->value_type, task->values, i);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief This function aggregates an input with a table per slice and
+ *  merges the tables in slice order (so groups keep the order they first
+ *  appear in)
+ *
+ * @param tasks - num_tasks tasks with their slices set
+ * @param num_tasks
+ * @param result
+ */
+static void group_slices(GroupTask* tasks, size_t num_tasks, GroupResult* result) {
+    run_group_tasks(group_slice_worker, tasks, num_tasks);
+    GroupTable* table = tasks[0].table;
+    for (size_t t = 1; t < num_tasks; t++) {
+        merge_group_tables(table, tasks[t].table);
+        free_group_table(tasks[t].table);
+    }
+    *result = table->groups;
+    table->groups = (GroupResult) {0, NULL, NULL, NULL};
+    free_group_table(table);
+}
+
+/**
+ * @brief This function partitions an input by the hash of its keys and
+ *  aggregates every partition into a table of its own. A partition has a
+ *  disjoint set of keys so the groups are just concatenated.
+ *
+ * @param tasks - num_tasks tasks with their slices set
+ * @param num_tasks
+ * @param result
+ */
+static void group_partitions(GroupTask* tasks, size_t num_tasks, GroupResult* result) {
+    GroupTask* first = &tasks[0];
+    size_t num_rows = 0;
+    for (size_t t = 0; t < num_tasks; t++) {
+        num_rows += tasks[t].num_rows;
+    }
+    int* part_keys = malloc(sizeof(int) * num_rows);
+    long* part_values = first->values ? malloc(sizeof(long) * num_rows) : NULL;
+
+    // every slice writes its rows of a partition after the rows of the
+    // slices before it
+    run_group_tasks(partition_count_worker, tasks, num_tasks);
+    size_t part_starts[GROUP_NUM_PARTITIONS + 1];
+    size_t offset = 0;
+    for (size_t p = 0; p < GROUP_NUM_PARTITIONS; p++) {
+        part_starts[p] = offset;
+        for (size_t t = 0; t < num_tasks; t++) {
+            size_t count = tasks[t].part_offsets[p];
+            tasks[t].part_offsets[p] = offset;
+            offset += count;
+        }
+    }
+    part_starts[GROUP_NUM_PARTITIONS] = offset;
+    for (size_t t = 0; t < num_tasks; t++) {
+        tasks[t].part_keys = part_keys;
+        tasks[t].part_values = part_values;
+    }
+    run_group_tasks(partition_scatter_worker, tasks, num_tasks);
+
+    // then every partition is a task
+    GroupTask* part_tasks = malloc(sizeof(GroupTask) * GROUP_NUM_PARTITIONS);
+    for (size_t p = 0; p < GROUP_NUM_PARTITIONS; p++) {
+        part_tasks[p].aggregate = first->aggregate;
+        part_tasks[p].keys = part_keys;
+        part_tasks[p].value_type = LONG;
+        part_tasks[p].values = part_values;
+        part_tasks[p].first_row = part_starts[p];
+        part_tasks[p].num_rows = part_starts[p + 1] - part_starts[p];
+    }
+    run_group_tasks(group_slice_worker, part_tasks, GROUP_NUM_PARTITIONS);
+
+    size_t num_groups = 0;
+    for (size_t p = 0; p < GROUP_NUM_PARTITIONS; p++) {
+        num_groups += part_tasks[p].table->groups.num_groups;
+    }
+    result->num_groups = 0;
+    result->keys = malloc(sizeof(int) * MAX(num_groups, 1));
+    result->accs = malloc(sizeof(long) * MAX(num_groups, 1));
+    result->counts = malloc(sizeof(long) * MAX(num_groups, 1));
+    for (size_t p = 0; p < GROUP_NUM_PARTITIONS; p++) {
+        GroupResult* groups = &part_tasks[p].table->groups;
+        memcpy(&result->keys[result->num_groups], groups->keys,
+               sizeof(int) * groups->num_groups);
+        memcpy(&result->accs[result->num_groups], groups->accs,
+               sizeof(long) * groups->num_groups);
+        memcpy(&result->counts[result->num_groups], groups->counts,
+               sizeof(long) * groups->num_groups);
+        result->num_groups += groups->num_groups;
+        free_group_table(part_tasks[p].table);
+    }
+    free(part_tasks);
+    free(part_keys);
+    free(part_values);
+}
+
+/// ***************************************************************************
+/// Group By
+/// ***************************************************************************
+
+/**
+ * @brief This function groups the rows of an input by key and aggregates
+ *  the values of each group. Large inputs are split over the thread pool:
+ *  when a sample of the input has few groups every worker aggregates into
+ *  its own (cache resident) table, otherwise the rows are partitioned by
+ *  key so that each partition's table is small and no merge is needed.
+ *  Partitioning keeps the tables in cache even on one thread, so large
+ *  inputs take this path whatever the size of the pool.
+ *
+ * @param aggregate - what is computed per group
+ * @param keys
+ * @param value_type - INT, LONG or INDEX
+ * @param values - NULL for a count
+ * @param num_rows
+ * @param result - filled with the groups
+ */
+void group_aggregate(
+    GroupAggregate aggregate,
+    const int* keys,
+    DataType value_type,
+    const void* values,
+    size_t num_rows,
+    GroupResult* result
+) {
+    if (num_rows < PARALLEL_GROUP_MIN_ROWS) {
+        GroupTable* table = create_group_table(aggregate, GROUP_DEFAULT_GROUPS);
+        group_rows(table, keys, value_type, values, 0, num_rows);
+        *result = table->groups;
+        table->groups = (GroupResult) {0, NULL, NULL, NULL};
+        free_group_table(table);
+        return;
+    }
+    GroupTable* sample = create_group_table(GROUP_COUNT, GROUP_LOCAL_MAX_GROUPS);
+    group_rows(sample, keys, value_type, NULL, 0, MIN(num_rows, GROUP_SAMPLE_SZ));
+    bool few_groups = sample->groups.num_groups <= GROUP_LOCAL_MAX_GROUPS;
+    free_group_table(sample);
+
+    size_t num_tasks = group_parallelism(num_rows);
+    GroupTask tasks[MAX_POOL_THREADS];
+    size_t slice = (num_rows + num_tasks - 1) / num_tasks;
+    for (size_t t = 0; t < num_tasks; t++) {
+        tasks[t].aggregate = aggregate;
+        tasks[t].keys = keys;
+        tasks[t].value_type = value_type;
+        tasks[t].values = values;
+        tasks[t].first_row = t * slice;
+        tasks[t].num_rows = MIN(slice, num_rows - t * slice);
+    }
+    cs165_log(stdout, "-- group by of %zu rows with %zu tasks (%s)\n", num_rows,
+              num_tasks, few_groups ? "local tables" : "partitioned");
+    if (few_groups) {
+        group_slices(tasks, num_tasks, result);
+    } else {
+        group_partitions(tasks, num_tasks, result);
+    }
+}
+
+/**
+ * @brief This function frees the arrays of a group result
+ *
+ * @param result
+ */
+void free_group_result(GroupResult* result) {
+    free(result->keys);
+    free(result->accs);
+    free(result->counts);
+}
@@ -0,0 +1,203 @@
+#include <string.h>
+#include "histogram.h"
+#include "compression.h"
+#include "utils.h"
+
+/// ***************************************************************************
+/// Helper Functions
+/// ***************************************************************************
+
+/**
+ * @brief Comparison function for sorting ints (qsort)
+ */
+static int compare_ints(const void* a, const void* b) {
+    int val_a = *(const int*) a;
+    int val_b = *(const int*) b;
+    return (val_a > val_b) - (val_a < val_b);
+}
+
+/**
+ * @brief This function returns the bucket a value falls into (the outer
+ *  buckets take the values past the bounds)
+ *
+ * @param histogram - a histogram with at least one bucket
+ * @param value
+ *
+ * @return the bucket index
+ */
+static size_t histogram_bucket(const Histogram* histogram, int value) {
+    // find the last bucket whose low bound is <= value
+    size_t low = 0;
+    size_t high = histogram->num_buckets;
+    while (high - low > 1) {
+        size_t mid = (low + high) / 2;
+        if (histogram->bounds[mid] <= value) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/// ***************************************************************************
+/// Histogram Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function builds an equi-depth histogram from a sample of a
+ *  column. The bucket bounds are quantiles of the sample and runs of an
+ *  equal value stay in one bucket.
+ *
+ * @param values - the sample (not modified)
+ * @param num_values - the size of the sample
+ * @param num_rows - the number of rows the sample stands for
+ *
+ * @return the histogram
+ */
+Histogram* create_histogram(const int* values, size_t num_values, size_t num_rows) {
+    Histogram* histogram = calloc(1, sizeof(Histogram));
+    histogram->num_rows = (double) num_rows;
+    if (num_values == 0) {
+        return histogram;
+    }
+    int* sorted = malloc(sizeof(int) * num_values);
+    memcpy(sorted, values, sizeof(int) * num_values);
+    qsort(sorted, num_values, sizeof(int), &compare_ints);
+
+    double scale = (double) num_rows / num_values;
+    size_t depth = MAX(num_values / HISTOGRAM_BUCKETS, 1);
+    size_t start = 0;
+    while (start < num_values) {
+        // the bucket ends at the next quantile, moved past equal values
+        size_t end = MIN(start + depth, num_values);
+        while (end < num_values && sorted[end] == sorted[end - 1]) {
+            end++;
+        }
+        size_t bucket = histogram->num_buckets++;
+        histogram->bounds[bucket] = sorted[start];
+        histogram->counts[bucket] = (end - start) * scale;
+        start = end;
+        // the last bucket takes whatever is left
+        if (histogram->num_buckets == HISTOGRAM_BUCKETS && start < num_values) {
+            histogram->counts[bucket] += (num_values - start) * scale;
+            start = num_values;
+        }
+    }
+    histogram->bounds[histogram->num_buckets] = (long) sorted[num_values - 1] + 1;
+    free(sorted);
+    return histogram;
+}
+
+/**
+ * @brief This function frees a histogram
+ *
+ * @param histogram
+ */
+void free_histogram(Histogram* histogram) {
+    free(histogram);
+}
+
+/**
+ * @brief This function counts an inserted value
+ *
+ * @param histogram - the histogram (nothing happens if NULL)
+ * @param value
+ */
+void histogram_insert(Histogram* histogram, int value) {
+    if (histogram == NULL) {
+        return;
+    }
+    histogram->num_rows++;
+    histogram->num_updates++;
+    if (histogram->num_buckets == 0) {
+        histogram->num_buckets = 1;
+        histogram->bounds[0] = value;
+        histogram->bounds[1] = (long) value + 1;
+        histogram->counts[0] = 1;
+        return;
+    }
+    // widen the outer buckets for values past the bounds
+    histogram->bounds[0] = MIN(histogram->bounds[0], value);
+    histogram->bounds[histogram->num_buckets] = MAX(
+        histogram->bounds[histogram->num_buckets],
+        (long) value + 1
+    );
+    histogram->counts[histogram_bucket(histogram, value)]++;
+}
+
+/**
+ * @brief This function uncounts a deleted value
+ *
+ * @param histogram - the histogram (nothing happens if NULL)
+ * @param value
+ */
+void histogram_remove(Histogram* histogram, int value) {
+    if (histogram == NULL || histogram->num_buckets == 0) {
+        return;
+    }
+    histogram->num_rows = MAX(histogram->num_rows - 1, 0);
+    histogram->num_updates++;
+    size_t bucket = histogram_bucket(histogram, value);
+    histogram->counts[bucket] = MAX(histogram->counts[bucket] - 1, 0);
+}
+
+/**
+ * @brief This function estimates the fraction of rows in [low, high).
+ *  Values are assumed to be spread evenly inside a bucket.
+ *
+ * @param histogram
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ *
+ * @return the estimated selectivity
+ */
+double histogram_selectivity(const Histogram* histogram, int low, int high) {
+    if (histogram->num_rows <= 0 || low >= high) {
+        return 0;
+    }
+    double num_found = 0;
+    for (size_t i = 0; i < histogram->num_buckets; i++) {
+        long bucket_low = histogram->bounds[i];
+        long bucket_high = histogram->bounds[i + 1];
+        long overlap = MIN(bucket_high, (long) high) - MAX(bucket_low, (long) low);
+        if (overlap > 0) {
+            num_found += histogram->counts[i] * overlap / (bucket_high - bucket_low);
+        }
+    }
+    return MIN(num_found / histogram->num_rows, 1.0);
+}
+
+/**
+ * @brief This function returns the histogram of a column, building it
+ *  first if it doesn't exist or too many rows changed since it was built
+ *
+ * @param col
+ *
+ * @return the histogram
+ */
+Histogram* column_histogram(Column* col) {
+    Histogram* histogram = col->histogram;
+    if (histogram &&
+            histogram->num_updates <= histogram->num_rows * HISTOGRAM_STALE_FRACTION) {
+        return histogram;
+    }
+    size_t num_rows = *col->size_ptr;
+    size_t num_values = MIN(num_rows, HISTOGRAM_SAMPLE_SIZE);
+    int* sample = malloc(sizeof(int) * MAX(num_values, 1));
+    for (size_t i = 0; i < num_values; i++) {
+        // a strided sample (every row if the column is small)
+        size_t row_idx = i * num_rows / num_values;
+        if (col->compressed) {
+            decompress_range(col->compressed, row_idx, 1, &sample[i]);
+        } else {
+            sample[i] = col->data[row_idx];
+        }
+    }
+    free_histogram(histogram);
+    col->histogram = create_histogram(sample, num_values, num_rows);
+    free(sample);
+    cs165_log(stdout, "-- built a histogram of %s with %zu buckets\n",
+              col->name, col->histogram->num_buckets);
+    return col->histogram;
+}
@@ -0,0 +1,31 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stdlib.h>
+#include "cs165_api.h"
+
+// inputs with at least this many values are reduced by the thread pool
+#define PARALLEL_AGGREGATE_MIN_ROWS (1 << 20)
+// the smallest piece of an input a worker reduces
+#define AGGREGATE_CHUNK_SZ (1 << 18)
+
+/// ***************************************************************************
+/// Aggregate kernels
+/// ***************************************************************************
+
+// sums the values of an INT, LONG, DOUBLE or INDEX array (doubles are
+// summed as doubles and truncated at the end)
+long aggregate_sum(DataType data_type, const void* data, size_t num_items);
+
+// finds the min and the max of an INT, LONG, DOUBLE or INDEX array in one
+// pass and writes them (as the data type) to min_out and max_out. There
+// must be at least one value.
+void aggregate_min_max(
+    DataType data_type,
+    const void* data,
+    size_t num_items,
+    void* min_out,
+    void* max_out
+);
+
+#endif
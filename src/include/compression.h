@@ -0,0 +1,77 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cs165_api.h"
+
+// columns smaller than this are left alone
+#define COMPRESSION_MIN_ROWS DEFAULT_COLUMN_SIZE
+// an encoding has to be at most this fraction of the raw column
+#define COMPRESSION_MAX_RATIO 0.75
+// dictionaries larger than this are not considered
+#define MAX_DICT_SIZE (1 << 16)
+// codes are unpacked this many at a time (fits in L1)
+#define UNPACK_BLOCK_SZ 256
+
+/// ***************************************************************************
+/// Compression Types
+/// ***************************************************************************
+
+typedef enum ColumnEncoding {
+    ENCODING_FOR,       // value - base, bit packed (frame of reference)
+    ENCODING_DICT,      // index into a sorted dictionary, bit packed
+    ENCODING_RLE        // runs of equal values
+} ColumnEncoding;
+
+/**
+ * @brief A compressed column replaces the raw data of a column that is read
+ *  mostly (unindexed and scanned since it was last loaded). The FOR and
+ *  dictionary codes are order preserving, so range predicates are turned
+ *  into a code range and checked without decoding the values. Appends that
+ *  fit the encoding are encoded in place, any other write decompresses the
+ *  column again (see column_data).
+ */
+typedef struct CompressedColumn {
+    ColumnEncoding encoding;
+    size_t num_rows;
+    int min_value;              // bounds of the column
+    int max_value;
+    size_t capacity;            // rows (RLE: runs) there is room for
+
+    // FOR and dictionary
+    unsigned bit_width;         // bits per code
+    uint64_t* packed;           // the codes (with one word of padding)
+    int base;                   // FOR: the frame of reference
+    int* dictionary;            // DICT: the distinct values (sorted)
+    size_t dict_size;
+
+    // RLE
+    int* run_values;
+    size_t* run_ends;           // row after the last row of every run
+    size_t num_runs;
+} CompressedColumn;
+
+bool compress_column(Column* col);
+void compress_loaded_column(Column* col);
+bool compressed_append(CompressedColumn* compressed, int value);
+int* column_data(Column* col);
+void free_compressed_column(CompressedColumn* compressed);
+
+size_t compressed_size(const CompressedColumn* compressed);
+void decompress_range(const CompressedColumn* compressed, size_t start,
+                      size_t count, int* values);
+
+size_t compressed_select(const CompressedColumn* compressed,
+                         const struct ZoneMap* zone_map,
+                         int low, int high, pos_t* positions);
+void compressed_fetch(const CompressedColumn* compressed,
+                      const pos_t* positions, size_t num_positions,
+                      int* values);
+void compressed_fetch_bitmap(const CompressedColumn* compressed,
+                             const uint32_t* bitmap, size_t num_bits,
+                             int* values);
+long compressed_sum(const CompressedColumn* compressed);
+
+#endif
@@ -25,6 +25,7 @@ SOFTWARE.
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 // TODO - needed
 /* #include <stdio.h> */
 #include "message.h"
@@ -41,9 +42,21 @@ SOFTWARE.
 // MACROS
 // We are using an array
 #define BIT_SZ 32
-#define SetBit(A,k)     ( A[(k/BIT_SZ)] |= (1 << (k%BIT_SZ)) )
-#define ClearBit(A,k)   ( A[(k/BIT_SZ)] &= ~(1 << (k%BIT_SZ)) )
-#define TestBit(A,k)    ( A[(k/BIT_SZ)] & (1 << (k%BIT_SZ)) )
+#define SetBit(A,k)     ( A[((k)/BIT_SZ)] |= (1U << ((k)%BIT_SZ)) )
+#define ClearBit(A,k)   ( A[((k)/BIT_SZ)] &= ~(1U << ((k)%BIT_SZ)) )
+#define TestBit(A,k)    ( A[((k)/BIT_SZ)] & (1U << ((k)%BIT_SZ)) )
+
+// Row positions (INDEX results, index entries, join partitions). With
+// COMPACT_POSITIONS they are 32 bits, which halves every position list,
+// and tables are capped at MAX_TABLE_ROWS rows so that positions fit.
+#define COMPACT_POSITIONS 1
+#if COMPACT_POSITIONS
+typedef uint32_t pos_t;
+#define MAX_TABLE_ROWS ((size_t) UINT32_MAX)
+#else
+typedef size_t pos_t;
+#define MAX_TABLE_ROWS ((size_t) SIZE_MAX)
+#endif
 
 /**
  * EXTRA
@@ -58,24 +71,38 @@ typedef enum DataType {
     INT,
     LONG,
     DOUBLE,
-    INDEX
+    INDEX,
+    // a uint32_t bitmap over row positions (capacity holds the number of
+    // bits and num_tuples the number of set bits)
+    BITMAP
 } DataType;
 
 typedef enum IndexType {
     NONE,
     BTREE,
-    SORTED
+    SORTED,
+    CRACKED     // adaptive index, reorganized by every select (db_crack.h)
 } IndexType;
 
 typedef union DataPtr {
     int* int_array;
     long* long_array;
     double* double_array;
-    size_t* index_array;
+    pos_t* index_array;
     void* void_array;
     char* char_array;
 } DataPtr;
 
+/**
+ * @brief A single value of any of the data types
+ */
+typedef union Value {
+    int int_value;
+    long long_value;
+    double double_value;
+    pos_t index_value;
+} Value;
+
 /* typedef union DataValue { */
 /*     int int_val; */
 /*     long long_val; */
@@ -85,6 +112,8 @@ typedef union DataPtr {
 /* } DataType; */
 
 struct Comparator;
+struct ZoneMap;
+struct CompressedColumn;
 typedef struct Column {
     char name[MAX_SIZE_NAME];
     size_t* size_ptr;           // The size pointer
@@ -93,6 +122,11 @@ typedef struct Column {
     void* index;                // Pointer to the index
     IndexType index_type;       // The type of index
     bool clustered;             // Bool to indicate if the column is clustered
+    struct ZoneMap* zone_map;   // Per block min/max for skipping (zone_map.h)
+    struct CompressedColumn* compressed; // Encoded data (data is NULL if set)
+    bool compress_pending;      // Loaded but not scanned yet (see compression.h)
+    struct Histogram* histogram; // Value distribution (histogram.h)
+    struct PrefixSums* prefix_sums; // Block sums of clustered tables (prefix_sum.h)
 } Column;
 
 
@@ -120,6 +154,7 @@ typedef struct Table {
     size_t table_length;
     size_t primary_col_pos;
     Column* primary_index;
+    size_t version;             // bumped by every write (see recycler.h)
 } Table;
 
 /**
@@ -179,7 +214,16 @@ typedef struct Result {
     void *payload;
     DataType data_type;
     bool free_after_use;
-    bool is_contiguous;
+    bool is_contiguous;     // rows [first_row, first_row + num_tuples) - an
+                            // INDEX range has no payload, values point
+                            // into the column (a view)
+    bool is_sorted;         // INDEX: the positions are ascending
+    size_t recycle_id;      // the recycler entry it came from (0 if none)
+    size_t first_row;
+    Column* view_column;    // the column a view points into (NULL if none)
+    bool has_bounds;        // min_value and max_value have been computed
+    Value min_value;
+    Value max_value;
 } Result;
 
 /*
@@ -238,6 +282,17 @@ typedef struct Comparator {
     ComparatorType type2;
 } Comparator;
 
+/*
+ * the aggregate a group by computes for each group
+ */
+typedef enum GroupAggregate {
+    GROUP_SUM,
+    GROUP_COUNT,
+    GROUP_MIN,
+    GROUP_MAX,
+    GROUP_AVG
+} GroupAggregate;
+
 /*
  * tells the database what type of operator this is
  */
@@ -245,9 +300,11 @@ typedef enum OperatorType {
     CREATE,
     INSERT,
     SELECT,
+    MULTI_SELECT,
     SHARED_SCAN,
     HASH_JOIN,
     NESTED_LOOP_JOIN,
+    SORT_MERGE_JOIN,
     DELETE,
     UPDATE,
     SUM,
@@ -257,6 +314,8 @@ typedef enum OperatorType {
     ADD,
     SUBTRACT,
     FETCH,
+    MULTI_FETCH,
+    GROUP_BY,
     PRINT,
     OPEN,
     SHUTDOWN
@@ -288,12 +347,36 @@ typedef struct SelectOperator {
     Comparator comparator;
 } SelectOperator;
 
+// a conjunction of range predicates over columns of the same table
+typedef struct MultiSelectOperator {
+    char handle[HANDLE_MAX_SIZE];
+    Comparator* comparators;
+    size_t num_predicates;
+} MultiSelectOperator;
+
 typedef struct FetchOperator {
     Result* idx_col;
     Column* from_col;
     char handle[HANDLE_MAX_SIZE];
 } FetchOperator;
 
+// several columns of the same table fetched at one position list
+typedef struct MultiFetchOperator {
+    Result* idx_col;
+    Column** from_cols;
+    char (*handles)[HANDLE_MAX_SIZE];   // one per column
+    size_t num_cols;
+} MultiFetchOperator;
+
+// the values of one column aggregated per distinct key of another
+typedef struct GroupOperator {
+    char handle1[HANDLE_MAX_SIZE];  // the distinct keys
+    char handle2[HANDLE_MAX_SIZE];  // the aggregate of each key
+    GeneralizedColumn keys;
+    GeneralizedColumn values;       // unused by a count
+    GroupAggregate aggregate;
+} GroupOperator;
+
 // TODO: use this
 typedef struct CreateOperator {
     char* db_name[MAX_SIZE_NAME];
@@ -338,7 +421,10 @@ typedef union OperatorFields {
     InsertOperator insert_operator;
     OpenOperator open_operator;
     SelectOperator select_operator;
+    MultiSelectOperator multi_select_operator;
     FetchOperator fetch_operator;
+    MultiFetchOperator multi_fetch_operator;
+    GroupOperator group_operator;
     PrintOperator print_operator;
     MathOperator math_operator;
     SharedScanOperator shared_operator;
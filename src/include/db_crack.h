@@ -0,0 +1,56 @@
+#ifndef DB_CRACK_H
+#define DB_CRACK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "cs165_api.h"
+
+// when set, a select on a column without an index makes it a cracked column
+// (so exploratory workloads don't need a create(idx,...) up front)
+#define CRACK_UNINDEXED_COLUMNS 0
+
+// pieces smaller than this are not cracked further, the select just
+// filters them instead
+#define CRACK_MIN_PIECE 64
+
+/// ***************************************************************************
+/// Cracker Index Types
+/// ***************************************************************************
+
+/**
+ * @brief A cracker index is a copy of a column (values + base positions)
+ *  that gets partitioned a little more by every select. The pieces are kept
+ *  in a sorted array of pivots: every value before pivot_offsets[i] is less
+ *  than pivots[i] and every value from it on is greater or equal. Inserts
+ *  are kept pending and only rippled into the pieces once a select asks for
+ *  their range.
+ */
+typedef struct CrackerIndex {
+    int* values;                // the cracker column
+    pos_t* positions;           // the base position of every value
+    size_t num_items;
+    size_t allocated_space;
+
+    int* pivots;                // the crack values (sorted)
+    size_t* pivot_offsets;      // where the values >= pivots[i] start
+    size_t num_pivots;
+    size_t pivot_space;
+
+    int* pending_values;        // inserts that are not cracked in yet
+    pos_t* pending_positions;
+    size_t num_pending;
+    size_t pending_space;
+} CrackerIndex;
+
+CrackerIndex* create_cracker_index(int* data, size_t num_rows);
+void free_cracker_index(CrackerIndex* index);
+
+void crack_select(CrackerIndex* index, int low, int high, Result* result);
+void cracker_insert(CrackerIndex* index, int value, size_t row_idx);
+void cracker_shift_positions(CrackerIndex* index, size_t row_idx);
+
+void dump_cracker_index(CrackerIndex* index, FILE* index_file);
+CrackerIndex* load_cracker_index(FILE* index_file);
+
+#endif
@@ -27,6 +27,10 @@
 #define MIN_KEYS (MAX_KEYS / 2)
 #define MIN_DEGREE (MIN_KEYS + 1)
 
+// a leaf has no child pointers so it fits a key and a position per 8 bytes
+// of its page (after the header and the sibling pointers)
+#define MAX_LEAF_KEYS ((PAGE_SZ - 32) / (sizeof(int) + sizeof(pos_t)))
+
 
 /// ***************************************************************************
 /// Database Indexing Types
@@ -36,58 +40,50 @@
 #define SORTED_NODE_SIZE 1024
 typedef struct SortedIndex {
     int* keys;              // this is a pointer to an array of keys
-    size_t* col_positions;     // this is a pointer to an array of positions
+    pos_t* col_positions;      // this is a pointer to an array of positions
     size_t num_items;       // the number of items
     size_t allocated_space; // this is the amount of allocated space for a col
     bool has_positions;     // this bool tells us if we have positions
 } SortedIndex;
 
-// Define the "BPTNode"
-struct BPTNode;
+/**
+ * @brief This is the header every node of the bpt starts with. Leaves and
+ *  inner nodes each have their own page sized layout (BPTLeaf and
+ *  BPTInner) and are told apart by is_leaf.
+ */
+typedef struct BPTNode {
+    size_t num_elements;         // this is the currently used size of the array
+    bool is_leaf;                // this tells us the type
+} BPTNode;
 
 /**
  * @brief This is the struct for the leaves of the bpt
- *      - Array of column positions
+ *      - Array of keys and their column positions
  *      - Pointer to the next leaf
  *      - Pointer to the previous leaf
  */
 typedef struct BPTLeaf {
-    size_t col_pos[MAX_KEYS];  // these are the positions
-    struct BPTNode* next_leaf; // this is the next pointer (next leaf)
-    struct BPTNode* prev_leaf; // this is the previous pointer (previous leaf)
+    BPTNode node;                     // the header (has to come first)
+    int node_vals[MAX_LEAF_KEYS];     // these are the datapoints
+    pos_t col_pos[MAX_LEAF_KEYS];     // these are the positions
+    struct BPTLeaf* next_leaf;        // this is the next pointer (next leaf)
+    struct BPTLeaf* prev_leaf;        // this is the previous pointer (previous leaf)
 } BPTLeaf;
 
 /**
- * @brief This is a struct for the pointers to other leaves. We can
- * have n+1 of them
+ * @brief This is a struct for the nodes that point to other nodes. We can
+ * have n+1 children
  */
-typedef struct BPTPointers {
+typedef struct BPTInner {
+    BPTNode node;                          // the header (has to come first)
+    int node_vals[MAX_KEYS];               // these are the fences
     struct BPTNode* children[MAX_DEGREE];  // Array of pointers to childern
     bool is_root;                          // Bool to indicate if is root
     unsigned int level;                    // Level of the tree
-} BPTPointers;
+} BPTInner;
 
-/**
- * @brief This union is either a pointer to an array of nodes (if
- * we have a node), or is a pointer to an array of column positions
- * (if we have struct)
- */
-typedef union BPTMeta {
-    BPTLeaf bpt_leaf;
-    BPTPointers bpt_ptrs;
-} BPTMeta;
-
-
-/**
- * @brief This is the structure for the nodes. A node
- */
-typedef struct BPTNode {
-    BPTMeta bpt_meta;            // This contains the node details
-    size_t num_elements;         // this is the currently used size of the array
-    int node_vals[MAX_KEYS];     // these are the datapoints
-    bool is_leaf;                // this tells us the type
-    char padding[3];
-} BPTNode;
+#define BPT_LEAF(bt_node) ((BPTLeaf*) (bt_node))
+#define BPT_INNER(bt_node) ((BPTInner*) (bt_node))
 
 // A structure to represent a stack
 typedef struct BPTNodeStack {
@@ -4,6 +4,10 @@
 #include "cs165_api.h"
 
 // define the various db operations
+size_t type_to_size(DataType data_type);
+void materialize_views(Table* table);
+void release_view(Result* result);
+void free_result(Result* result);
 char* process_open(OpenOperator open_op, Status* status);
 
 void insert_into_table(Table* table, int* values, Status* status);
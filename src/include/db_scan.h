@@ -0,0 +1,198 @@
+#ifndef DB_SCAN_H
+#define DB_SCAN_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cs165_api.h"
+
+// number of values we look at when estimating the selectivity of a scan
+#define SELECTIVITY_SAMPLE_SIZE 1024
+// above this estimated selectivity a scan emits a bitmap instead of a
+// position list (a bitmap costs 1 bit per row, a position 32 bits per match)
+#define BITMAP_MIN_SELECTIVITY 0.0625
+// don't bother with bitmaps for small columns
+#define BITMAP_MIN_ROWS PAGE_SZ
+// below this selectivity (or above 1 - it) the branch of a branching scan
+// is predictable enough to beat a predicated scan
+#define BRANCHING_MAX_SELECTIVITY 0.02
+// how many positions ahead a gather prefetches the values it will load
+#define GATHER_PREFETCH_DISTANCE 16
+
+/// ***************************************************************************
+/// Scan kernels
+/// ***************************************************************************
+
+/**
+ * @brief A select kernel evaluates low <= data[i] < high over num_items
+ *  values and writes (base + i) for every match into positions. It returns
+ *  the number of matches. positions must have room for num_items values.
+ */
+typedef size_t (*SelectKernelFunc)(
+    const int* data,
+    size_t num_items,
+    size_t base,
+    int low,
+    int high,
+    pos_t* positions
+);
+
+/**
+ * @brief A bitmap kernel evaluates low <= data[i] < high over num_items
+ *  values and sets bit i of the bitmap for every match (the bitmap is fully
+ *  overwritten). It returns the number of matches.
+ */
+typedef size_t (*SelectBitmapFunc)(
+    const int* data,
+    size_t num_items,
+    int low,
+    int high,
+    uint32_t* bitmap
+);
+
+/**
+ * @brief A gather kernel writes data[positions[i]] into values[i] for the
+ *  num_positions positions.
+ */
+typedef void (*GatherFunc)(
+    const int* data,
+    const pos_t* positions,
+    size_t num_positions,
+    int* values
+);
+
+// The ways we can evaluate a single range predicate
+typedef enum SelectMethod {
+    SELECT_BRANCHING,
+    SELECT_PREDICATED,
+    SELECT_SIMD
+} SelectMethod;
+
+// The instruction sets we can run the select kernels with
+typedef enum KernelIsa {
+    ISA_SCALAR,
+    ISA_SSE4,
+    ISA_AVX2,
+    ISA_AVX512
+} KernelIsa;
+
+typedef struct SelectKernel {
+    KernelIsa isa;
+    const char* name;
+    SelectKernelFunc func;
+    SelectBitmapFunc bitmap_func;
+    GatherFunc gather_func;     // for unsorted positions
+} SelectKernel;
+
+// returns the fastest kernel supported by this cpu (picked once by CPUID)
+const SelectKernel* get_select_kernel();
+
+// picks branching, predicated or simd for an estimated selectivity
+SelectMethod choose_select_method(double selectivity);
+SelectKernelFunc select_method_kernel(SelectMethod method);
+const char* select_method_name(SelectMethod method);
+
+// samples the data and returns the kernel to scan it with (logged)
+SelectKernelFunc choose_select_kernel(
+    const int* data,
+    size_t num_items,
+    int low,
+    int high,
+    double* selectivity
+);
+
+// fetches values at positions - sorted positions are read in order (or
+// copied if they are a run), others with the gather kernel of the cpu
+void gather_values(
+    const int* data,
+    const pos_t* positions,
+    size_t num_positions,
+    bool sorted,
+    int* values
+);
+
+// the portable gather kernel (with software prefetching)
+void gather_scalar(
+    const int* data,
+    const pos_t* positions,
+    size_t num_positions,
+    int* values
+);
+
+// only writes on a match
+size_t select_range_branching(
+    const int* data,
+    size_t num_items,
+    size_t base,
+    int low,
+    int high,
+    pos_t* positions
+);
+
+// the portable kernel that every other kernel must agree with
+size_t select_range_scalar(
+    const int* data,
+    size_t num_items,
+    size_t base,
+    int low,
+    int high,
+    pos_t* positions
+);
+
+size_t select_bitmap_scalar(
+    const int* data,
+    size_t num_items,
+    int low,
+    int high,
+    uint32_t* bitmap
+);
+
+// estimates the fraction of values in [low, high) from a strided sample
+double estimate_selectivity(const int* data, size_t num_items, int low, int high);
+
+/// ***************************************************************************
+/// Bitmap helpers
+/// ***************************************************************************
+
+#define BITMAP_WORDS(num_bits) (((num_bits) + BIT_SZ - 1) / BIT_SZ)
+
+// returns the first set bit at or after from (num_bits if there is none)
+size_t bitmap_next_set(const uint32_t* bitmap, size_t num_bits, size_t from);
+
+// writes the set bits of the bitmap as positions and returns the count
+size_t bitmap_to_positions(const uint32_t* bitmap, size_t num_bits, pos_t* positions);
+
+// clamp a comparator's bounds into the range of the column values
+void comparator_int_bounds(Comparator* comp, int* low, int* high);
+
+/// ***************************************************************************
+/// Interval index
+/// ***************************************************************************
+
+// batches with at least this many queries look values up in an interval
+// index instead of testing every predicate
+#define INTERVAL_MIN_QUERIES 32
+// give up on the index if the segment lists would get larger than this
+#define INTERVAL_MAX_ENTRIES (1 << 22)
+
+/**
+ * @brief An interval index over the ranges [lows[q], highs[q]) of a batch.
+ *  The sorted distinct endpoints cut the values into segments, and every
+ *  segment lists the queries that contain it. Segment s is
+ *  [bounds[s], bounds[s + 1]) and its queries are
+ *  queries[offsets[s]] .. queries[offsets[s + 1] - 1] (in query order).
+ */
+typedef struct IntervalIndex {
+    size_t num_bounds;
+    int* bounds;
+    size_t* offsets;
+    size_t* queries;
+} IntervalIndex;
+
+IntervalIndex* create_interval_index(const int* lows, const int* highs, size_t num_queries);
+void free_interval_index(IntervalIndex* index);
+
+// returns the number of queries containing value (and where their list is)
+size_t interval_index_lookup(const IntervalIndex* index, int value, const size_t** queries);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef GROUP_BY_H
+#define GROUP_BY_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "cs165_api.h"
+
+// inputs with at least this many rows are sampled and aggregated by the
+// thread pool (as slices or partitions, see group_aggregate)
+#define PARALLEL_GROUP_MIN_ROWS (1 << 20)
+// the smallest piece of an input a worker aggregates
+#define GROUP_CHUNK_SZ (1 << 18)
+// rows at the start of an input used to guess the number of groups
+#define GROUP_SAMPLE_SZ (1 << 14)
+// inputs with at most this many groups (in the sample) are aggregated into
+// a table per worker that stays in cache, the tables are merged at the end.
+// Inputs with more are partitioned by key first so that every partition is
+// aggregated into a table of its own.
+#define GROUP_LOCAL_MAX_GROUPS 4096
+#define GROUP_PARTITION_BITS 6
+#define GROUP_NUM_PARTITIONS (1 << GROUP_PARTITION_BITS)
+
+/**
+ * @brief The groups of an input: the distinct keys with the count of rows
+ *  and the sum, min or max of the values of each of them. Groups come out
+ *  in order of first appearance (per partition for partitioned inputs).
+ */
+typedef struct GroupResult {
+    size_t num_groups;
+    int* keys;
+    long* accs;         // sum, min or max of the values of each group
+    long* counts;       // number of rows of each group
+} GroupResult;
+
+// groups num_rows keys and aggregates the values (an INT, LONG or INDEX
+// array, NULL for a count) of each group
+void group_aggregate(
+    GroupAggregate aggregate,
+    const int* keys,
+    DataType value_type,
+    const void* values,
+    size_t num_rows,
+    GroupResult* result
+);
+void free_group_result(GroupResult* result);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdlib.h>
+#include "cs165_api.h"
+
+// the most buckets a histogram has (equal values never span buckets so it
+// can have fewer)
+#define HISTOGRAM_BUCKETS 64
+// columns larger than this are sampled when the histogram is built
+#define HISTOGRAM_SAMPLE_SIZE 16384
+// a histogram is rebuilt once this fraction of the rows has changed
+#define HISTOGRAM_STALE_FRACTION 0.2
+
+/// ***************************************************************************
+/// Histogram Types
+/// ***************************************************************************
+
+/**
+ * @brief An equi-depth histogram of a column. Bucket i holds the values in
+ *  [bounds[i], bounds[i + 1]) and roughly the same number of rows as the
+ *  others when it is built. Inserts and deletes only adjust the counts (and
+ *  the outer bounds), so it drifts until enough rows changed to rebuild it.
+ */
+typedef struct Histogram {
+    long bounds[HISTOGRAM_BUCKETS + 1];
+    double counts[HISTOGRAM_BUCKETS];
+    size_t num_buckets;
+    double num_rows;
+    size_t num_updates;         // inserts and deletes since it was built
+} Histogram;
+
+Histogram* create_histogram(const int* values, size_t num_values, size_t num_rows);
+void free_histogram(Histogram* histogram);
+
+void histogram_insert(Histogram* histogram, int value);
+void histogram_remove(Histogram* histogram, int value);
+double histogram_selectivity(const Histogram* histogram, int low, int high);
+
+Histogram* column_histogram(Column* col);
+
+#endif
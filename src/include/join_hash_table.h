@@ -0,0 +1,44 @@
+#ifndef JOIN_HASH_TABLE_H
+#define JOIN_HASH_TABLE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "cs165_api.h"
+
+// ends a chain of build rows (and marks a free slot)
+#define JOIN_TABLE_END UINT32_MAX
+
+typedef struct JoinSlot {
+    int key;
+    uint32_t head;          // the first build row with the key
+} JoinSlot;
+
+/**
+ * @brief A flat hash table over the build side of a join. It is sized for
+ *  the build side up front (at most half full) and probed linearly. A slot
+ *  holds a distinct key and its first build row, the other rows with the
+ *  key are chained through a side array so duplicates never lengthen the
+ *  probe sequences. The build side's positions are not copied.
+ */
+typedef struct JoinHashTable {
+    JoinSlot* slots;
+    size_t mask;            // number of slots - 1
+    uint32_t* next;         // build row -> next build row with the same key
+    const pos_t* positions; // the positions of the build rows
+} JoinHashTable;
+
+void join_table_build(JoinHashTable* table, const int* keys,
+                      const pos_t* positions, size_t num_rows);
+void free_join_table(JoinHashTable* table);
+
+size_t join_table_count(const JoinHashTable* table, const int* keys, size_t num_keys);
+size_t join_table_probe(
+    const JoinHashTable* table,
+    const int* keys,
+    const pos_t* positions,
+    size_t num_keys,
+    pos_t* probe_out,
+    pos_t* build_out
+);
+
+#endif
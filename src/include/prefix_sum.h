@@ -0,0 +1,42 @@
+#ifndef PREFIX_SUM_H
+#define PREFIX_SUM_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "cs165_api.h"
+
+// columns of clustered tables get prefix sums the first time a range of
+// them is summed (0 turns them off)
+#define CLUSTERED_PREFIX_SUMS 1
+// rows covered by one prefix sum entry
+#define PREFIX_BLOCK_SZ 4096
+
+#define PREFIX_BLOCK_IDX(row_idx) ((row_idx) / PREFIX_BLOCK_SZ)
+
+/**
+ * @brief Block level prefix sums of a column. sums[k] is the sum of the
+ *  rows [0, k * PREFIX_BLOCK_SZ) for k <= num_clean (sums[0] is 0). The sum
+ *  of any range is two entries plus at most half a block on each end.
+ *  Shifting inserts update the entries after the insert in place, deletes
+ *  move the watermark back and the entries past it are recomputed when the
+ *  sums are next used.
+ */
+typedef struct PrefixSums {
+    long* sums;
+    size_t capacity;        // number of entries we have space for
+    size_t num_clean;       // entries [0, num_clean] are valid
+} PrefixSums;
+
+PrefixSums* create_prefix_sums(size_t num_rows);
+void free_prefix_sums(PrefixSums* prefix_sums);
+
+bool prefix_sums_reserve(PrefixSums* prefix_sums, size_t num_rows);
+void prefix_sums_insert(PrefixSums* prefix_sums, const int* data, size_t row_idx,
+                        int value, size_t num_rows);
+void prefix_sums_invalidate(PrefixSums* prefix_sums, size_t row_idx);
+void prefix_sums_refresh(PrefixSums* prefix_sums, const int* data, size_t num_rows);
+
+long prefix_sums_range(PrefixSums* prefix_sums, const int* data, size_t num_rows,
+                       size_t first_row, size_t num_items);
+
+#endif
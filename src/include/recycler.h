@@ -0,0 +1,61 @@
+#ifndef RECYCLER_H
+#define RECYCLER_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "cs165_api.h"
+
+// bytes of result payloads the recycler may hold (0 turns it off)
+#define RECYCLER_BUDGET (64 << 20)
+// results larger than this fraction of the budget are not kept
+#define RECYCLER_MAX_FRACTION 0.25
+
+/// ***************************************************************************
+/// Recycler Types
+/// ***************************************************************************
+
+typedef enum RecycleKind {
+    RECYCLE_SELECT,     // positions of low <= col < high
+    RECYCLE_FETCH       // values of col at the positions of another entry
+} RecycleKind;
+
+/**
+ * @brief A recycled intermediate result. Entries belong to a version of
+ *  their table - a write bumps the version and drops the entries of the
+ *  table. Every entry gets an id that is never reused, results computed
+ *  from an entry carry that id so that a fetch over them can be recycled
+ *  too.
+ */
+typedef struct RecycleEntry {
+    RecycleKind kind;
+    size_t id;
+    Column* col;
+    size_t version;             // the table version it was computed at
+    int low;                    // SELECT: the predicate
+    int high;
+    size_t source_id;           // FETCH: the entry of the positions
+
+    DataType data_type;         // a private copy of the result
+    size_t num_tuples;
+    size_t capacity;
+    bool is_sorted;
+    bool is_contiguous;         // a range is kept as its first row
+    size_t first_row;
+    void* payload;
+    size_t bytes;
+
+    double cost;                // rows touched to compute it
+    size_t hits;
+    size_t last_used;           // recycler clock of the last use
+} RecycleEntry;
+
+RecycleEntry* recycler_find_select(Column* col, int low, int high, bool* exact);
+RecycleEntry* recycler_find_fetch(Column* col, size_t source_id);
+size_t recycler_add_select(Column* col, int low, int high, Result* result, double cost);
+size_t recycler_add_fetch(Column* col, size_t source_id, Result* result, double cost);
+void recycler_copy_result(RecycleEntry* entry, Result* result);
+
+void recycler_invalidate_table(Table* table);
+void recycler_clear();
+
+#endif
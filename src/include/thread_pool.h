@@ -0,0 +1,38 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// environment variable that overrides the number of pool threads
+#define THREAD_POOL_ENV "CS165_THREADS"
+#define MAX_POOL_THREADS 64
+
+// tasks have the same shape as pthread start routines
+typedef void* (*TaskFunc)(void* arg);
+
+/**
+ * @brief A task group tracks a set of submitted tasks so that the submitter
+ *  can wait for just those. It lives on the submitter's stack.
+ */
+typedef struct TaskGroup {
+    size_t num_pending;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} TaskGroup;
+
+// starts the server wide pool (0 threads = from the core count / env var)
+bool thread_pool_start(size_t num_threads);
+void thread_pool_shutdown();
+
+// the number of threads that can work on a task group at once (the pool
+// threads plus the thread that waits on the group)
+size_t thread_pool_parallelism();
+
+void task_group_init(TaskGroup* group);
+void thread_pool_submit(TaskGroup* group, TaskFunc func, void* arg);
+// waits for every task of the group, running queued tasks in the meantime
+void task_group_wait(TaskGroup* group);
+
+#endif
@@ -10,6 +10,10 @@
 #include <stdarg.h>
 #include <stdio.h>
 
+// Min and Max helper functions
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
 /**
  * trims newline characters from a string (in place)
  **/
@@ -0,0 +1,46 @@
+#ifndef ZONE_MAP_H
+#define ZONE_MAP_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "cs165_api.h"
+
+// rows covered by one zone (a multiple of BIT_SZ so that zones line up
+// with bitmap words)
+#define ZONE_SZ 4096
+
+#define ZONE_IDX(row_idx) ((row_idx) / ZONE_SZ)
+#define NUM_ZONES(num_rows) (((num_rows) + ZONE_SZ - 1) / ZONE_SZ)
+
+/**
+ * @brief A zone map keeps the min and max of every block of ZONE_SZ rows.
+ *  The bounds of the zones before num_clean hold every value in the zone
+ *  (they can be loose after appends), the zones after it are stale and get
+ *  recomputed the next time the column is scanned. Shifting inserts and
+ *  deletes just move the watermark back.
+ */
+typedef struct ZoneMap {
+    int* mins;
+    int* maxs;
+    size_t capacity;        // number of zones we have space for
+    size_t num_clean;       // zones [0, num_clean) have valid bounds
+} ZoneMap;
+
+// what a zone can tell us about a range predicate
+typedef enum ZoneCheck {
+    ZONE_NONE,              // no value in the zone qualifies
+    ZONE_SOME,              // the zone has to be scanned
+    ZONE_ALL                // every value in the zone qualifies
+} ZoneCheck;
+
+ZoneMap* create_zone_map(size_t num_rows);
+void free_zone_map(ZoneMap* zone_map);
+
+bool zone_map_reserve(ZoneMap* zone_map, size_t num_rows);
+void zone_map_insert(ZoneMap* zone_map, size_t row_idx, int value, size_t num_rows);
+void zone_map_invalidate(ZoneMap* zone_map, size_t row_idx);
+void zone_map_refresh(ZoneMap* zone_map, const int* data, size_t num_rows);
+
+ZoneCheck zone_map_check(const ZoneMap* zone_map, size_t zone_idx, int low, int high);
+
+#endif
@@ -0,0 +1,145 @@
+#include "join_hash_table.h"
+
+/// ***************************************************************************
+/// Helper Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function hashes a key. The radix join partitions on the top
+ *  bits of a multiplicative hash, so the table mixes every bit of the key
+ *  into the low bits it uses instead.
+ *
+ * @param key
+ *
+ * @return the hash
+ */
+static uint32_t join_table_hash(int key) {
+    uint32_t h = (uint32_t) key;
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * @brief This function finds the slot of a key: the one holding it or the
+ *  free slot where it would go
+ *
+ * @param table
+ * @param key
+ *
+ * @return the slot
+ */
+static JoinSlot* join_table_slot(const JoinHashTable* table, int key) {
+    size_t slot = join_table_hash(key) & table->mask;
+    while (table->slots[slot].head != JOIN_TABLE_END &&
+            table->slots[slot].key != key) {
+        slot = (slot + 1) & table->mask;
+    }
+    return &table->slots[slot];
+}
+
+/// ***************************************************************************
+/// Build Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function builds a table over the build side of a join. The
+ *  rows are added back to front so that every chain lists its rows in
+ *  order.
+ *
+ * @param table
+ * @param keys
+ * @param positions - kept by the table (it has to outlive it)
+ * @param num_rows
+ */
+void join_table_build(JoinHashTable* table, const int* keys,
+                      const pos_t* positions, size_t num_rows) {
+    size_t num_slots = 16;
+    while (num_slots < num_rows * 2) {
+        num_slots *= 2;
+    }
+    table->mask = num_slots - 1;
+    table->slots = malloc(sizeof(JoinSlot) * num_slots);
+    for (size_t i = 0; i < num_slots; i++) {
+        table->slots[i].head = JOIN_TABLE_END;
+    }
+    table->next = malloc(sizeof(uint32_t) * (num_rows > 0 ? num_rows : 1));
+    table->positions = positions;
+    for (size_t row = num_rows; row-- > 0;) {
+        JoinSlot* slot = join_table_slot(table, keys[row]);
+        slot->key = keys[row];
+        table->next[row] = slot->head;
+        slot->head = row;
+    }
+}
+
+/**
+ * @brief This function frees a table (not the build side)
+ *
+ * @param table
+ */
+void free_join_table(JoinHashTable* table) {
+    free(table->slots);
+    free(table->next);
+    table->slots = NULL;
+    table->next = NULL;
+}
+
+/// ***************************************************************************
+/// Probe Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function counts the matches of a set of keys
+ *
+ * @param table
+ * @param keys
+ * @param num_keys
+ *
+ * @return the number of (probe, build) pairs with equal keys
+ */
+size_t join_table_count(const JoinHashTable* table, const int* keys, size_t num_keys) {
+    size_t num_matches = 0;
+    for (size_t i = 0; i < num_keys; i++) {
+        uint32_t row = join_table_slot(table, keys[i])->head;
+        for (; row != JOIN_TABLE_END; row = table->next[row]) {
+            num_matches++;
+        }
+    }
+    return num_matches;
+}
+
+/**
+ * @brief This function writes the matches of a set of keys: the position
+ *  of the probe row and of the build row for every pair with equal keys
+ *
+ * @param table
+ * @param keys
+ * @param positions - the positions of the probe rows
+ * @param num_keys
+ * @param probe_out - room for every match (see join_table_count)
+ * @param build_out
+ *
+ * @return the number of matches written
+ */
+size_t join_table_probe(
+    const JoinHashTable* table,
+    const int* keys,
+    const pos_t* positions,
+    size_t num_keys,
+    pos_t* probe_out,
+    pos_t* build_out
+) {
+    size_t num_matches = 0;
+    for (size_t i = 0; i < num_keys; i++) {
+        uint32_t row = join_table_slot(table, keys[i])->head;
+        for (; row != JOIN_TABLE_END; row = table->next[row]) {
+            probe_out[num_matches] = positions[i];
+            build_out[num_matches++] = table->positions[row];
+        }
+    }
+    return num_matches;
+}
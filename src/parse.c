@@ -20,6 +20,10 @@
 #include "utils.h"
 #include "client_context.h"
 #include "db_index.h"
+#include "compression.h"
+#include "recycler.h"
+#include "histogram.h"
+#include "prefix_sum.h"
 #include "db_operations.h"
 #define DEFAULT_COL_ALLOC 8
 #define DEFAULT_SHARED_ALLOC 16
@@ -183,7 +187,7 @@ void* lookup_struct(NameLookup* lookup, LookupType struct_type) {
  * Below are a list of the parse functions for creating columns
  */
 
-// create(idx,<col_name>,[btree, sorted], [clustered, unclustered])
+// create(idx,<col_name>,[btree, sorted, cracked], [clustered, unclustered])
 void parse_create_index(char* create_arguments, Status* status) {
     char** create_arguments_index = &create_arguments;
     char* column_name = next_token(create_arguments_index, &status->msg_type);
@@ -203,6 +207,23 @@ void parse_create_index(char* create_arguments, Status* status) {
         return;
     }
 
+    // indexes are built on (and point into) the raw data
+    column_data(column);
+    // a new index can change the order of the rows and of select results
+    recycler_invalidate_table(column->table);
+    materialize_views(column->table);
+    for (size_t i = 0; i < column->table->col_count; i++) {
+        prefix_sums_invalidate(column->table->columns[i].prefix_sums, 0);
+    }
+
+    // a cracker index reorganizes its own copy, never the base data
+    bool cracked = strncmp(index_string, "cracked", 7) == 0;
+    if (cracked && strncmp(cluster_param, "clustered", 9) == 0) {
+        status->code = ERROR;
+        status->msg = "Cracked indexes can't be clustered";
+        return;
+    }
+
     // otherwise set the clustering
     if (strncmp(cluster_param, "clustered", 9) == 0) {
         column->clustered = true;
@@ -218,6 +239,9 @@ void parse_create_index(char* create_arguments, Status* status) {
 
     if (strncmp(index_string, "btree", 5) == 0) {
         column->index_type = BTREE;
+    } else if (cracked) {
+        // the cracker column is built by the first select
+        column->index_type = CRACKED;
     } else if (column->clustered) {
         column->index_type = SORTED;
         column->index = create_clustered_sorted_index(column->data);
@@ -231,7 +255,7 @@ void parse_create_index(char* create_arguments, Status* status) {
  * @brief this function takes in the argument string for the creation
  * of columns and will create that new column. it will return a status
  * create(col,"project",awesomebase.grades)
-// create(col,"<colname>", full_table_name, [btree, sorted], [clustered, unclustered])
+// create(col,"<colname>", full_table_name, [btree, sorted, cracked], [clustered, unclustered])
  *
  * TODO: Make it so that this parses sorted status
  *
@@ -252,7 +276,13 @@ void parse_create_col(char* create_arguments, Status* status) {
     // this means there is more to come
     if (create_arguments != NULL) {
         char* index_string = next_token(create_arguments_index, &status->msg_type);
-        index_type = strncmp(index_string, "btree", 5) == 0 ? BTREE : SORTED;
+        if (strncmp(index_string, "btree", 5) == 0) {
+            index_type = BTREE;
+        } else if (strncmp(index_string, "cracked", 7) == 0) {
+            index_type = CRACKED;
+        } else {
+            index_type = SORTED;
+        }
         assert(create_arguments_index != NULL);
         char* cluster_param = next_token(create_arguments_index, &status->msg_type);
         clustered = strncmp(cluster_param, "clustered", 9) == 0;
@@ -264,6 +294,11 @@ void parse_create_col(char* create_arguments, Status* status) {
         status->msg = "Wrong # of args for create col";
         return;
     }
+    if (index_type == CRACKED && clustered) {
+        status->code = ERROR;
+        status->msg = "Cracked indexes can't be clustered";
+        return;
+    }
 
     // trim quotes and check for finishing parenthesis.
     column_name = trim_quotes(column_name);
@@ -506,7 +541,7 @@ DbOperator* parse_insert(char* query_command, Status* status) {
  *
  *  <vec_pos1_out>,<vec_pos2_out>=join(<vec_val1>,<vec_pos1>,
  *                                     <vec_val2>,<vec_pos2>,
- *                                     [hash,nested-loop,...])
+ *                                     [hash,sortmerge,nested-loop])
  *
  * @param query_command - the command to process
  * @param context - the context for the operation
@@ -550,7 +585,13 @@ DbOperator* parse_join(char* query_command, ClientContext* context, Status* stat
         }
 
         // set the join type
-        dbo->type = strncmp(*command_index, "hash", 4) == 0 ? HASH_JOIN : NESTED_LOOP_JOIN;
+        if (strncmp(*command_index, "hash", 4) == 0) {
+            dbo->type = HASH_JOIN;
+        } else if (strncmp(*command_index, "sortmerge", 9) == 0) {
+            dbo->type = SORT_MERGE_JOIN;
+        } else {
+            dbo->type = NESTED_LOOP_JOIN;
+        }
         return dbo;
     } else {
         status->msg_type = UNKNOWN_COMMAND;
@@ -618,6 +659,13 @@ void parse_load(char* query_command, Status* status) {
 
     if (status->code == OK) {
         status->msg_type = OK_DONE;
+        // a bulk load is a good time to gather statistics, the encodings
+        // are picked on the first scan (loads often come in runs)
+        materialize_views(table);
+        for (size_t i = 0; i < table->col_count; i++) {
+            column_histogram(&table->columns[i]);
+            table->columns[i].compress_pending = true;
+        }
     }
     fclose(load_file);
     return;
@@ -742,6 +790,81 @@ void set_bounds(char* range_str, Comparator* comp, Status* status) {
     }
 }
 
+/**
+ * @brief This function parses a conjunctive select, i.e.
+ *  select(db.tbl.col1,low1,high1,db.tbl.col2,low2,high2,...). Every column
+ *  has to be in the same table.
+ *
+ * @param col_name - the first column
+ * @param query_command - the rest of the arguments (after the first column)
+ * @param status
+ *
+ * @return the MULTI_SELECT operator (NULL on error)
+ */
+DbOperator* parse_multi_select(char* col_name, char* query_command, Status* status) {
+    size_t num_alloced = DEFAULT_COL_ALLOC;
+    size_t num_predicates = 0;
+    Comparator* comparators = malloc(sizeof(Comparator) * num_alloced);
+
+    while (col_name != NULL && status->code == OK) {
+        if (num_predicates == num_alloced) {
+            num_alloced *= 2;
+            comparators = realloc(comparators, sizeof(Comparator) * num_alloced);
+        }
+        Comparator* comp = &comparators[num_predicates];
+        comp->gen_col = malloc(sizeof(GeneralizedColumn));
+        comp->gen_col->column_type = COLUMN;
+        comp->gen_col->column_pointer.column = get_col_from_string(col_name, status);
+        num_predicates++;
+        if (comp->gen_col->column_pointer.column == NULL) {
+            status->code = ERROR;
+            break;
+        }
+        if (comp->gen_col->column_pointer.column->table !=
+                comparators[0].gen_col->column_pointer.column->table) {
+            status->code = ERROR;
+            status->msg_type = QUERY_UNSUPPORTED;
+            status->msg = "Selects must be on columns of the same table";
+            break;
+        }
+
+        // cut out "low,high" for set_bounds and move to the next column
+        char* range_str = query_command;
+        char* separator = strchr(range_str, ',');
+        if (separator == NULL) {
+            status->code = ERROR;
+            status->msg_type = INCORRECT_FORMAT;
+            break;
+        }
+        col_name = NULL;
+        if ((separator = strchr(separator + 1, ',')) != NULL) {
+            *separator = '\0';
+            col_name = separator + 1;
+            if ((separator = strchr(col_name, ',')) == NULL) {
+                status->code = ERROR;
+                status->msg_type = INCORRECT_FORMAT;
+                break;
+            }
+            *separator = '\0';
+            query_command = separator + 1;
+        }
+        set_bounds(range_str, comp, status);
+    }
+
+    if (status->code != OK) {
+        for (size_t i = 0; i < num_predicates; i++) {
+            free(comparators[i].gen_col);
+        }
+        free(comparators);
+        return NULL;
+    }
+    DbOperator* db_query = malloc(sizeof(DbOperator));
+    db_query->type = MULTI_SELECT;
+    db_query->operator_fields.multi_select_operator.comparators = comparators;
+    db_query->operator_fields.multi_select_operator.num_predicates = num_predicates;
+    return db_query;
+}
+
 /**
  * @brief This function takes the string for a selection and parses it
  *
@@ -765,6 +888,11 @@ DbOperator* parse_select(char* query_command, ClientContext* context, Status* st
         status->code = ERROR;
         return NULL;
     }
+    // more than one column/range pair is a conjunctive select
+    if (strchr(token, '.') && strchr(query_command, ',') &&
+            strchr(strchr(query_command, ',') + 1, ',')) {
+        return parse_multi_select(token, query_command, status);
+    }
     // create space for the operator
     DbOperator* db_query = malloc(sizeof(DbOperator));
     db_query->type = SELECT;
@@ -815,6 +943,102 @@ DbOperator* parse_select(char* query_command, ClientContext* context, Status* st
     return db_query;
 }
 
+/**
+ * @brief This function parses a fetch of several columns, i.e.
+ *  fetch(db.tbl.col1,db.tbl.col2,...,<vec_pos>). Every column has to be in
+ *  the same table. The handles are filled in by parse_command.
+ *
+ * @param col_name - the first column
+ * @param query_command - the rest of the arguments (after the first column)
+ * @param context
+ * @param status
+ *
+ * @return the MULTI_FETCH operator (NULL on error)
+ */
+DbOperator* parse_multi_fetch(
+    char* col_name,
+    char* query_command,
+    ClientContext* context,
+    Status* status
+) {
+    size_t num_alloced = DEFAULT_COL_ALLOC;
+    size_t num_cols = 0;
+    Column** from_cols = malloc(sizeof(Column*) * num_alloced);
+
+    // every argument but the last one is a column
+    while (status->code == OK) {
+        if (num_cols == num_alloced) {
+            num_alloced *= 2;
+            from_cols = realloc(from_cols, sizeof(Column*) * num_alloced);
+        }
+        Column* col = get_col_from_string(col_name, status);
+        if (col == NULL) {
+            status->code = ERROR;
+            break;
+        }
+        if (num_cols > 0 && col->table != from_cols[0]->table) {
+            status->code = ERROR;
+            status->msg_type = QUERY_UNSUPPORTED;
+            status->msg = "Fetches must be on columns of the same table";
+            break;
+        }
+        from_cols[num_cols++] = col;
+        if (strchr(query_command, ',') == NULL) {
+            break;
+        }
+        col_name = next_token(&query_command, &status->msg_type);
+    }
+    Result* idx_col = status->code == OK
+        ? get_result(context, query_command, status) : NULL;
+    if (status->code != OK || idx_col == NULL) {
+        status->code = ERROR;
+        free(from_cols);
+        return NULL;
+    }
+    DbOperator* db_query = malloc(sizeof(DbOperator));
+    db_query->type = MULTI_FETCH;
+    db_query->operator_fields.multi_fetch_operator.idx_col = idx_col;
+    db_query->operator_fields.multi_fetch_operator.from_cols = from_cols;
+    db_query->operator_fields.multi_fetch_operator.num_cols = num_cols;
+    db_query->operator_fields.multi_fetch_operator.handles = malloc(
+        HANDLE_MAX_SIZE * num_cols
+    );
+    return db_query;
+}
+
+/**
+ * @brief This function fills in the handles of a multi-column fetch from
+ *  the comma separated handles before the '='
+ *
+ * @param mf_op
+ * @param handle - the first handle
+ * @param other_handles - the rest of them (comma separated)
+ * @param status
+ */
+void set_multi_fetch_handles(
+    MultiFetchOperator* mf_op,
+    char* handle,
+    char* other_handles,
+    Status* status
+) {
+    size_t num_handles = 0;
+    while (handle != NULL && num_handles < mf_op->num_cols) {
+        strcpy(mf_op->handles[num_handles++], trim_whitespace(handle));
+        handle = NULL;
+        if (other_handles != NULL) {
+            handle = other_handles;
+            if ((other_handles = strchr(other_handles, ',')) != NULL) {
+                *other_handles++ = '\0';
+            }
+        }
+    }
+    if (num_handles != mf_op->num_cols || handle != NULL) {
+        status->code = ERROR;
+        status->msg_type = INCORRECT_FORMAT;
+        status->msg = "A fetch needs one handle per column";
+    }
+}
+
 /**
  * @brief Function that processes the fetch command
  *
@@ -838,6 +1062,10 @@ DbOperator* parse_fetch(char* query_command, ClientContext* context, Status* sta
         status->code = ERROR;
         return NULL;
     }
+    // more than one column fetches them together
+    if (strchr(query_command, ',')) {
+        return parse_multi_fetch(token, query_command, context, status);
+    }
     // create space for the operator
     DbOperator* db_query = malloc(sizeof(DbOperator));
     db_query->type = FETCH;
@@ -894,6 +1122,79 @@ DbOperator* parse_math(char* query_command, ClientContext* context, Status* stat
     return db_query;
 }
 
+/**
+ * @brief This function parses a group by, i.e.
+ *  <keys>,<aggs>=group(<key_col>,<val_col>,[sum|count|min|max|avg]) where
+ *  either column can be a base column or a result. A count can leave out
+ *  the values: <keys>,<counts>=group(<key_col>,count)
+ *
+ * @param query_command
+ * @param context
+ * @param status
+ *
+ * @return the GROUP_BY operator (NULL on error)
+ */
+DbOperator* parse_group(char* query_command, ClientContext* context, Status* status) {
+    if (strncmp(query_command, "(", 1) != 0) {
+        status->code = ERROR;
+        status->msg_type = INCORRECT_FORMAT;
+        return NULL;
+    }
+    // cut off the parens
+    query_command = trim_parenthesis(query_command);
+    char* key_name = next_token(&query_command, &status->msg_type);
+    char* value_name = NULL;
+    if (status->msg_type != INCORRECT_FORMAT && strchr(query_command, ',')) {
+        value_name = next_token(&query_command, &status->msg_type);
+    }
+    if (status->msg_type == INCORRECT_FORMAT || query_command == NULL) {
+        status->code = ERROR;
+        status->msg = "Wrong # of args for group";
+        return NULL;
+    }
+
+    DbOperator* db_query = calloc(1, sizeof(DbOperator));
+    db_query->type = GROUP_BY;
+    GroupOperator* group_op = &db_query->operator_fields.group_operator;
+    if (strncmp(query_command, "sum", 3) == 0) {
+        group_op->aggregate = GROUP_SUM;
+    } else if (strncmp(query_command, "count", 5) == 0) {
+        group_op->aggregate = GROUP_COUNT;
+    } else if (strncmp(query_command, "min", 3) == 0) {
+        group_op->aggregate = GROUP_MIN;
+    } else if (strncmp(query_command, "max", 3) == 0) {
+        group_op->aggregate = GROUP_MAX;
+    } else if (strncmp(query_command, "avg", 3) == 0) {
+        group_op->aggregate = GROUP_AVG;
+    } else {
+        status->code = ERROR;
+        status->msg_type = INCORRECT_FORMAT;
+        status->msg = "Unknown aggregate for group";
+        free(db_query);
+        return NULL;
+    }
+    if (value_name == NULL && group_op->aggregate != GROUP_COUNT) {
+        status->code = ERROR;
+        status->msg_type = INCORRECT_FORMAT;
+        status->msg = "Only a count can group without values";
+        free(db_query);
+        return NULL;
+    }
+    // the lookups reset the status so each one is checked
+    set_generalized_col(&group_op->keys, key_name, context, status);
+    if (status->code == OK && value_name != NULL) {
+        set_generalized_col(&group_op->values, value_name, context, status);
+    }
+    if (status->code != OK ||
+            group_op->keys.column_pointer.result == NULL ||
+            (value_name != NULL && group_op->values.column_pointer.result == NULL)) {
+        status->code = ERROR;
+        free(db_query);
+        return NULL;
+    }
+    return db_query;
+}
+
 DbOperator* parse_update(
     char* query_command,
     ClientContext* context,
@@ -1009,14 +1310,25 @@ DbOperator* parse_command(
     } else if (strncmp(query_command, "select", 6) == 0) {
         query_command += 6;
         dbo = parse_select(query_command, context, internal_status);
-        if (dbo) {
+        if (dbo && dbo->type == MULTI_SELECT) {
+            strcpy(dbo->operator_fields.multi_select_operator.handle, handle);
+        } else if (dbo) {
             strcpy(dbo->operator_fields.select_operator.comparator.handle, handle);
         }
     // Below is some vile copied and pasted code
     } else if (strncmp(query_command, "fetch", 5) == 0) {
         query_command += 5;
         dbo = parse_fetch(query_command, context, internal_status);
-        if (dbo) {
+        if (dbo && dbo->type == MULTI_FETCH) {
+            MultiFetchOperator* mf_op = &dbo->operator_fields.multi_fetch_operator;
+            set_multi_fetch_handles(mf_op, handle, handle_2, internal_status);
+            if (internal_status->code != OK) {
+                free(mf_op->from_cols);
+                free(mf_op->handles);
+                free(dbo);
+                dbo = NULL;
+            }
+        } else if (dbo) {
             strcpy(dbo->operator_fields.fetch_operator.handle, handle);
         }
     } else if (strncmp(query_command, "join", 4) == 0) {
@@ -1026,6 +1338,19 @@ DbOperator* parse_command(
             strcpy(dbo->operator_fields.math_operator.handle1, handle);
             strcpy(dbo->operator_fields.join_operator.handle2, handle_2);
         }
+    } else if (strncmp(query_command, "group", 5) == 0) {
+        query_command += 5;
+        if (handle_2 == NULL) {
+            internal_status->code = ERROR;
+            internal_status->msg_type = INCORRECT_FORMAT;
+            internal_status->msg = "A group needs a handle for the keys and the aggregates";
+        } else {
+            dbo = parse_group(query_command, context, internal_status);
+        }
+        if (dbo) {
+            strcpy(dbo->operator_fields.group_operator.handle1, handle);
+            strcpy(dbo->operator_fields.group_operator.handle2, handle_2);
+        }
     } else if (strncmp(query_command, "sum", 3) == 0) {
         query_command += 3;
         dbo = parse_math(query_command, context, internal_status);
@@ -0,0 +1,172 @@
+#include "prefix_sum.h"
+#include "aggregate.h"
+#include "utils.h"
+
+/// ***************************************************************************
+/// Creation Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function creates prefix sums with room for num_rows rows
+ *  (nothing is summed until the first refresh)
+ *
+ * @param num_rows - the number of rows the column has space for
+ *
+ * @return the prefix sums (NULL if the allocation failed)
+ */
+PrefixSums* create_prefix_sums(size_t num_rows) {
+    PrefixSums* prefix_sums = calloc(1, sizeof(PrefixSums));
+    if (prefix_sums == NULL) {
+        return NULL;
+    }
+    if (prefix_sums_reserve(prefix_sums, num_rows) == false) {
+        free_prefix_sums(prefix_sums);
+        return NULL;
+    }
+    prefix_sums->sums[0] = 0;
+    return prefix_sums;
+}
+
+/**
+ * @brief This function frees prefix sums
+ *
+ * @param prefix_sums
+ */
+void free_prefix_sums(PrefixSums* prefix_sums) {
+    if (prefix_sums == NULL) {
+        return;
+    }
+    free(prefix_sums->sums);
+    free(prefix_sums);
+}
+
+/**
+ * @brief This function makes sure the prefix sums can cover num_rows rows
+ *  (it is called whenever the table grows)
+ *
+ * @param prefix_sums
+ * @param num_rows - the new capacity of the column
+ *
+ * @return false if the allocation failed
+ */
+bool prefix_sums_reserve(PrefixSums* prefix_sums, size_t num_rows) {
+    if (prefix_sums == NULL) {
+        return true;
+    }
+    size_t num_entries = PREFIX_BLOCK_IDX(num_rows) + 1;
+    if (num_entries <= prefix_sums->capacity) {
+        return true;
+    }
+    long* sums = realloc(prefix_sums->sums, num_entries * sizeof(long));
+    if (sums == NULL) {
+        return false;
+    }
+    prefix_sums->sums = sums;
+    prefix_sums->capacity = num_entries;
+    return true;
+}
+
+/// ***************************************************************************
+/// Maintenance Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function records a value written to row_idx after the rows
+ *  from row_idx on were shifted down one (or appended). Each entry past the
+ *  insert gains the new value and loses the row that moved across it.
+ *
+ * @param prefix_sums
+ * @param data - the column data (after the insert)
+ * @param row_idx - the row the value was written to
+ * @param value - the value
+ * @param num_rows - the number of rows in the column (after the insert)
+ */
+void prefix_sums_insert(PrefixSums* prefix_sums, const int* data, size_t row_idx,
+                        int value, size_t num_rows) {
+    if (prefix_sums == NULL) {
+        return;
+    }
+    // a clean entry never covers the last row, so data[k * PREFIX_BLOCK_SZ]
+    // is always a row (an append changes no entry)
+    (void) num_rows;
+    for (size_t k = PREFIX_BLOCK_IDX(row_idx) + 1; k <= prefix_sums->num_clean; k++) {
+        prefix_sums->sums[k] += value - data[k * PREFIX_BLOCK_SZ];
+    }
+}
+
+/**
+ * @brief This function marks every entry past row_idx as stale (for when
+ *  the rows after row_idx move in a way we don't track)
+ *
+ * @param prefix_sums
+ * @param row_idx - the first row that changed
+ */
+void prefix_sums_invalidate(PrefixSums* prefix_sums, size_t row_idx) {
+    if (prefix_sums == NULL) {
+        return;
+    }
+    prefix_sums->num_clean = MIN(prefix_sums->num_clean, PREFIX_BLOCK_IDX(row_idx));
+}
+
+/**
+ * @brief This function sums the blocks past the watermark. It has to be
+ *  called before the sums are used.
+ *
+ * @param prefix_sums
+ * @param data - the column data
+ * @param num_rows - the number of rows in the column
+ */
+void prefix_sums_refresh(PrefixSums* prefix_sums, const int* data, size_t num_rows) {
+    if (prefix_sums == NULL) {
+        return;
+    }
+    size_t num_full = PREFIX_BLOCK_IDX(num_rows);
+    for (size_t k = prefix_sums->num_clean; k < num_full; k++) {
+        prefix_sums->sums[k + 1] = prefix_sums->sums[k] +
+            aggregate_sum(INT, &data[k * PREFIX_BLOCK_SZ], PREFIX_BLOCK_SZ);
+    }
+    prefix_sums->num_clean = MAX(prefix_sums->num_clean, num_full);
+}
+
+/// ***************************************************************************
+/// Lookup Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function returns the sum of the rows [0, row_idx) from the
+ *  entry closest to it
+ *
+ * @param prefix_sums - refreshed prefix sums
+ * @param data
+ * @param row_idx - at most the number of rows
+ *
+ * @return the sum
+ */
+static long prefix_at(const PrefixSums* prefix_sums, const int* data, size_t row_idx) {
+    size_t block = PREFIX_BLOCK_IDX(row_idx);
+    size_t offset = row_idx % PREFIX_BLOCK_SZ;
+    if (offset > PREFIX_BLOCK_SZ / 2 && block + 1 <= prefix_sums->num_clean) {
+        return prefix_sums->sums[block + 1] -
+            aggregate_sum(INT, &data[row_idx], PREFIX_BLOCK_SZ - offset);
+    }
+    return prefix_sums->sums[block] +
+        aggregate_sum(INT, &data[block * PREFIX_BLOCK_SZ], offset);
+}
+
+/**
+ * @brief This function sums the rows [first_row, first_row + num_items)
+ *
+ * @param prefix_sums
+ * @param data - the column data
+ * @param num_rows - the number of rows in the column
+ * @param first_row
+ * @param num_items
+ *
+ * @return the sum
+ */
+long prefix_sums_range(PrefixSums* prefix_sums, const int* data, size_t num_rows,
+                       size_t first_row, size_t num_items) {
+    prefix_sums_refresh(prefix_sums, data, num_rows);
+    return prefix_at(prefix_sums, data, first_row + num_items) -
+        prefix_at(prefix_sums, data, first_row);
+}
@@ -0,0 +1,322 @@
+#include <string.h>
+#include "recycler.h"
+#include "db_operations.h"
+#include "db_scan.h"
+#include "utils.h"
+
+/// ***************************************************************************
+/// Recycler State
+/// ***************************************************************************
+
+// The recycler is shared by every client. Queries are executed one at a
+// time by the server thread, so it needs no lock.
+typedef struct Recycler {
+    RecycleEntry** entries;
+    size_t num_entries;
+    size_t allocated_entries;
+    size_t bytes_used;
+    size_t next_id;
+    size_t clock;
+} Recycler;
+
+static Recycler recycler = {
+    .entries = NULL,
+    .num_entries = 0,
+    .allocated_entries = 0,
+    .bytes_used = 0,
+    .next_id = 1,
+    .clock = 0
+};
+
+/// ***************************************************************************
+/// Helper Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function returns the size of a result's payload (a range has
+ *  none)
+ *
+ * @param result
+ *
+ * @return the number of bytes
+ */
+static size_t payload_bytes(const Result* result) {
+    if (result->is_contiguous) {
+        return 0;
+    }
+    DataType data_type = result->data_type;
+    size_t num_tuples = result->num_tuples;
+    size_t capacity = result->capacity;
+    if (data_type == BITMAP) {
+        return sizeof(uint32_t) * BITMAP_WORDS(capacity);
+    }
+    return type_to_size(data_type) * num_tuples;
+}
+
+/**
+ * @brief This function scores an entry for eviction: the work it saves per
+ *  byte, weighted by how often it was used and decayed by how long ago
+ *
+ * @param entry
+ *
+ * @return the score (the lowest score is evicted first)
+ */
+static double entry_benefit(const RecycleEntry* entry) {
+    double age = (double) (recycler.clock - entry->last_used);
+    return entry->cost * (entry->hits + 1) / ((double) entry->bytes + 1) / (age + 1);
+}
+
+/**
+ * @brief This function removes the entry at an index and frees it
+ *
+ * @param idx
+ */
+static void remove_entry(size_t idx) {
+    RecycleEntry* entry = recycler.entries[idx];
+    recycler.bytes_used -= entry->bytes;
+    free(entry->payload);
+    free(entry);
+    recycler.entries[idx] = recycler.entries[--recycler.num_entries];
+}
+
+/**
+ * @brief This function evicts the least beneficial entries until there is
+ *  room for bytes more
+ *
+ * @param bytes
+ */
+static void make_room(size_t bytes) {
+    while (recycler.num_entries > 0 && recycler.bytes_used + bytes > RECYCLER_BUDGET) {
+        size_t victim = 0;
+        double victim_benefit = entry_benefit(recycler.entries[0]);
+        for (size_t i = 1; i < recycler.num_entries; i++) {
+            double benefit = entry_benefit(recycler.entries[i]);
+            if (benefit < victim_benefit) {
+                victim = i;
+                victim_benefit = benefit;
+            }
+        }
+        cs165_log(stdout, "-- recycler evicts entry %zu (%zu bytes)\n",
+                  recycler.entries[victim]->id, recycler.entries[victim]->bytes);
+        remove_entry(victim);
+    }
+}
+
+/**
+ * @brief This function copies a result into a new entry and adds it (if it
+ *  fits in the budget)
+ *
+ * @param kind
+ * @param col - the column of the entry
+ * @param result - the result to copy
+ * @param cost - rows touched to compute the result
+ *
+ * @return the entry (NULL if it was not kept)
+ */
+static RecycleEntry* add_entry(RecycleKind kind, Column* col, Result* result, double cost) {
+    size_t bytes = payload_bytes(result);
+    if (RECYCLER_BUDGET == 0 || bytes > RECYCLER_BUDGET * RECYCLER_MAX_FRACTION) {
+        return NULL;
+    }
+    make_room(bytes);
+    if (recycler.num_entries == recycler.allocated_entries) {
+        recycler.allocated_entries = recycler.allocated_entries
+            ? recycler.allocated_entries * 2 : 16;
+        recycler.entries = realloc(
+            recycler.entries,
+            sizeof(RecycleEntry*) * recycler.allocated_entries
+        );
+    }
+    RecycleEntry* entry = malloc(sizeof(RecycleEntry));
+    entry->kind = kind;
+    entry->id = recycler.next_id++;
+    entry->col = col;
+    entry->version = col->table->version;
+    entry->data_type = result->data_type;
+    entry->num_tuples = result->num_tuples;
+    entry->capacity = result->capacity;
+    entry->is_sorted = result->is_sorted;
+    entry->is_contiguous = result->is_contiguous;
+    entry->first_row = result->first_row;
+    entry->bytes = bytes;
+    entry->payload = NULL;
+    if (bytes > 0) {
+        entry->payload = malloc(bytes);
+        memcpy(entry->payload, result->payload, bytes);
+    }
+    entry->cost = cost;
+    entry->hits = 0;
+    entry->last_used = ++recycler.clock;
+    recycler.entries[recycler.num_entries++] = entry;
+    recycler.bytes_used += bytes;
+    return entry;
+}
+
+/**
+ * @brief This function marks an entry as used
+ *
+ * @param entry
+ */
+static void touch_entry(RecycleEntry* entry) {
+    entry->hits++;
+    entry->last_used = ++recycler.clock;
+}
+
+/// ***************************************************************************
+/// Lookup Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function looks for a select that answers low <= col < high.
+ *  An exact match is preferred, otherwise the smallest cached selection of
+ *  a wider range is returned (its positions still have to be filtered).
+ *
+ * @param col - the column
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param exact - set to whether the entry is an exact match
+ *
+ * @return the entry (NULL if there is none)
+ */
+RecycleEntry* recycler_find_select(Column* col, int low, int high, bool* exact) {
+    RecycleEntry* best = NULL;
+    for (size_t i = 0; i < recycler.num_entries; i++) {
+        RecycleEntry* entry = recycler.entries[i];
+        if (entry->kind != RECYCLE_SELECT || entry->col != col ||
+                entry->version != col->table->version ||
+                entry->low > low || entry->high < high) {
+            continue;
+        }
+        if (entry->low == low && entry->high == high) {
+            best = entry;
+            break;
+        }
+        if (best == NULL || entry->num_tuples < best->num_tuples) {
+            best = entry;
+        }
+    }
+    if (best) {
+        *exact = best->low == low && best->high == high;
+        touch_entry(best);
+    }
+    return best;
+}
+
+/**
+ * @brief This function looks for the values of a column fetched at the
+ *  positions of an entry
+ *
+ * @param col - the fetched column
+ * @param source_id - the id of the positions
+ *
+ * @return the entry (NULL if there is none)
+ */
+RecycleEntry* recycler_find_fetch(Column* col, size_t source_id) {
+    for (size_t i = 0; i < recycler.num_entries; i++) {
+        RecycleEntry* entry = recycler.entries[i];
+        if (entry->kind == RECYCLE_FETCH && entry->col == col &&
+                entry->source_id == source_id &&
+                entry->version == col->table->version) {
+            touch_entry(entry);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief This function keeps a copy of a select result
+ *
+ * @param col - the column
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ * @param result - the positions
+ * @param cost - rows touched to compute them
+ *
+ * @return the id of the entry (0 if it was not kept)
+ */
+size_t recycler_add_select(Column* col, int low, int high, Result* result, double cost) {
+    RecycleEntry* entry = add_entry(RECYCLE_SELECT, col, result, cost);
+    if (entry == NULL) {
+        return 0;
+    }
+    entry->low = low;
+    entry->high = high;
+    entry->source_id = 0;
+    return entry->id;
+}
+
+/**
+ * @brief This function keeps a copy of a fetch result
+ *
+ * @param col - the fetched column
+ * @param source_id - the id of the positions
+ * @param result - the values
+ * @param cost - rows touched to compute them
+ *
+ * @return the id of the entry (0 if it was not kept)
+ */
+size_t recycler_add_fetch(Column* col, size_t source_id, Result* result, double cost) {
+    RecycleEntry* entry = add_entry(RECYCLE_FETCH, col, result, cost);
+    if (entry == NULL) {
+        return 0;
+    }
+    entry->low = entry->high = 0;
+    entry->source_id = source_id;
+    return entry->id;
+}
+
+/**
+ * @brief This function fills a result with a copy of an entry
+ *
+ * @param entry
+ * @param result
+ */
+void recycler_copy_result(RecycleEntry* entry, Result* result) {
+    result->data_type = entry->data_type;
+    result->num_tuples = entry->num_tuples;
+    result->capacity = entry->capacity;
+    result->is_sorted = entry->is_sorted;
+    result->is_contiguous = entry->is_contiguous;
+    result->first_row = entry->first_row;
+    result->payload = NULL;
+    if (entry->bytes > 0) {
+        result->payload = malloc(entry->bytes);
+        memcpy(result->payload, entry->payload, entry->bytes);
+    }
+    result->recycle_id = entry->id;
+}
+
+/// ***************************************************************************
+/// Invalidation Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function is called on every write to a table. It bumps the
+ *  version of the table and drops the entries of its columns.
+ *
+ * @param table
+ */
+void recycler_invalidate_table(Table* table) {
+    table->version++;
+    for (size_t i = 0; i < recycler.num_entries;) {
+        Column* col = recycler.entries[i]->col;
+        if (col >= table->columns && col < table->columns + table->col_count) {
+            remove_entry(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+/**
+ * @brief This function drops every entry (when the columns go away)
+ */
+void recycler_clear() {
+    while (recycler.num_entries > 0) {
+        remove_entry(recycler.num_entries - 1);
+    }
+    free(recycler.entries);
+    recycler.entries = NULL;
+    recycler.allocated_entries = 0;
+}
@@ -32,6 +32,9 @@
 #include "assert.h"
 // TODO: cleanup
 #include "db_operations.h"
+#include "db_scan.h"
+#include "compression.h"
+#include "thread_pool.h"
 
 #define DEFAULT_QUERY_BUFFER_SIZE 1024
 #define MAX_CLIENTS 16
@@ -116,7 +119,7 @@ int val_to_str(
                 &response[char_idx],
                 DEFAULT_QUERY_BUFFER_SIZE - char_idx,
                 "%zu",
-                ((size_t*) data_ptr)[row_idx]
+                (size_t) ((pos_t*) data_ptr)[row_idx]
             );
         default:
             return -1;
@@ -174,6 +177,10 @@ void print_to_client(
     char response[DEFAULT_QUERY_BUFFER_SIZE];
     size_t row_idx = 0;
     int char_idx = 0;
+    // bitmap columns are printed as positions, so for each column we keep
+    // the bit after the last position we printed
+    size_t* bit_cursors = calloc(print_op->num_columns, sizeof(size_t));
+    pos_t bit_pos = 0;
 
     // different printing functions as printing is different if we
     // are printing one or mulitple columns
@@ -181,18 +188,32 @@ void print_to_client(
         void* data_ptr = (
                 type == RESULT
                 ? print_op->print_objects[0].column_pointer.result->payload
-                : (void*) print_op->print_objects[0].column_pointer.column->data
+                : (void*) column_data(print_op->print_objects[0].column_pointer.column)
         );
         // make a string to save in
         // make the data
         while (row_idx < print_sz) {
-            int result = val_to_str(
-                response,
-                char_idx,
-                data_type,
-                data_ptr,
-                row_idx
-            );
+            int result;
+            if (data_type == BITMAP) {
+                bit_pos = bitmap_next_set(
+                    data_ptr,
+                    print_op->print_objects[0].column_pointer.result->capacity,
+                    bit_cursors[0]
+                );
+                result = val_to_str(response, char_idx, INDEX, &bit_pos, 0);
+            } else if (data_type == INDEX && data_ptr == NULL) {
+                // a range is printed from its first row
+                bit_pos = print_op->print_objects[0].column_pointer.result->first_row + row_idx;
+                result = val_to_str(response, char_idx, INDEX, &bit_pos, 0);
+            } else {
+                result = val_to_str(
+                    response,
+                    char_idx,
+                    data_type,
+                    data_ptr,
+                    row_idx
+                );
+            }
             assert(result > 0);
             // make it adjust appropriately
             if ((char_idx + result) >= DEFAULT_QUERY_BUFFER_SIZE - 2) {
@@ -205,6 +226,7 @@ void print_to_client(
             } else {
                 char_idx += result;
                 response[char_idx++] = '\n';
+                bit_cursors[0] = bit_pos + 1;
                 row_idx++;
             }
         }
@@ -219,15 +241,29 @@ void print_to_client(
                 data_ptr = print_op->print_objects[col_idx].column_pointer.result->payload;
                 data_type = print_op->print_objects[col_idx].column_pointer.result->data_type;
             } else {
-                data_ptr = print_op->print_objects[col_idx].column_pointer.column->data;
+                data_ptr = column_data(print_op->print_objects[col_idx].column_pointer.column);
+            }
+            int result;
+            if (data_type == BITMAP) {
+                bit_pos = bitmap_next_set(
+                    data_ptr,
+                    print_op->print_objects[col_idx].column_pointer.result->capacity,
+                    bit_cursors[col_idx]
+                );
+                result = val_to_str(response, char_idx, INDEX, &bit_pos, 0);
+            } else if (data_type == INDEX && data_ptr == NULL) {
+                // a range is printed from its first row
+                bit_pos = print_op->print_objects[col_idx].column_pointer.result->first_row + row_idx;
+                result = val_to_str(response, char_idx, INDEX, &bit_pos, 0);
+            } else {
+                result = val_to_str(
+                    response,
+                    char_idx,
+                    data_type,
+                    data_ptr,
+                    row_idx
+                );
             }
-            int result = val_to_str(
-                response,
-                char_idx,
-                data_type,
-                data_ptr,
-                row_idx
-            );
             assert(result > 0);
             // make it adjust appropriately
             if ((char_idx + result) >= DEFAULT_QUERY_BUFFER_SIZE - 2) {
@@ -240,11 +276,13 @@ void print_to_client(
             } else if ((col_idx + 1) == print_op->num_columns) {
                 // if we are at the end of the column add
                 // a new line character
+                bit_cursors[col_idx] = bit_pos + 1;
                 char_idx += result;
                 response[char_idx++] = '\n';
                 col_idx = 0;
                 row_idx++;
             } else {
+                bit_cursors[col_idx] = bit_pos + 1;
                 char_idx += result;
                 response[char_idx++] = ',';
                 col_idx++;
@@ -263,6 +301,7 @@ void print_to_client(
         msg->status = status->msg_type;
         send_to_client(client_socket, msg, response);
     }
+    free(bit_cursors);
     free(print_op->print_objects);
 }
 
@@ -387,8 +426,7 @@ void handle_client(int client_socket, int* exit_server) {
     for (int i = 0; i < client_context->chandles_in_use; i++) {
         GeneralizedColumnHandle* gcolh = &client_context->chandle_table[i];
         if(gcolh->generalized_column.column_pointer.result != NULL) {
-            free(gcolh->generalized_column.column_pointer.result->payload);
-            free(gcolh->generalized_column.column_pointer.result);
+            free_result(gcolh->generalized_column.column_pointer.result);
         }
     }
     // free the table of generalized columns
@@ -454,6 +492,11 @@ int main(void) {
         exit(1);
     }
 
+    // the workers that scans, joins etc. hand their tasks to
+    if (thread_pool_start(0) == false) {
+        exit(1);
+    }
+
     log_info("-- Waiting for a connection %d ...\n", server_socket);
 
     struct sockaddr_un remote;
@@ -463,7 +506,13 @@ int main(void) {
     // check if there is a database to load
     if (db_exists()) {
         log_info("-- Database found... loading\n", client_socket);
-        db_startup();
+        Status startup_status = db_startup();
+        // don't run on (and later overwrite) files we can't read
+        if (startup_status.code == ERROR &&
+                startup_status.msg_type == INCORRECT_FILE_FORMAT) {
+            log_err("L%d: %s\n", __LINE__, startup_status.msg);
+            exit(1);
+        }
     }
 
     int exit_server = 0;
@@ -476,5 +525,6 @@ int main(void) {
     }
     // TODO: determine correct location for shutdown
     shutdown_server();
+    thread_pool_shutdown();
     return 0;
 }
@@ -0,0 +1,230 @@
+#define _POSIX_C_SOURCE 200809L
+#include <unistd.h>
+#include "thread_pool.h"
+#include "utils.h"
+
+/// ***************************************************************************
+/// Pool Types
+/// ***************************************************************************
+
+typedef struct Task {
+    TaskFunc func;
+    void* arg;
+    TaskGroup* group;
+    struct Task* next;
+} Task;
+
+// the queue is a singly linked list (tasks are taken from the head)
+typedef struct ThreadPool {
+    pthread_t threads[MAX_POOL_THREADS];
+    size_t num_threads;
+    Task* head;
+    Task* tail;
+    bool shutting_down;
+    pthread_mutex_t lock;
+    pthread_cond_t has_tasks;
+} ThreadPool;
+
+static ThreadPool pool = {
+    .num_threads = 0,
+    .head = NULL,
+    .tail = NULL,
+    .shutting_down = false,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .has_tasks = PTHREAD_COND_INITIALIZER
+};
+
+/// ***************************************************************************
+/// Helper Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function takes the first task off the queue. The pool lock
+ *  must be held.
+ *
+ * @return the task (NULL if the queue is empty)
+ */
+static Task* pop_task() {
+    Task* task = pool.head;
+    if (task) {
+        pool.head = task->next;
+        if (pool.head == NULL) {
+            pool.tail = NULL;
+        }
+    }
+    return task;
+}
+
+/**
+ * @brief This function runs a task and lets its group know it finished
+ *
+ * @param task - the task (freed here)
+ */
+static void run_task(Task* task) {
+    task->func(task->arg);
+    TaskGroup* group = task->group;
+    free(task);
+    pthread_mutex_lock(&group->lock);
+    if (--group->num_pending == 0) {
+        pthread_cond_broadcast(&group->done);
+    }
+    pthread_mutex_unlock(&group->lock);
+}
+
+/**
+ * @brief The loop of a pool thread - it runs tasks until the pool shuts down
+ *
+ * @param arg - unused
+ */
+static void* pool_worker(void* arg) {
+    (void) arg;
+    pthread_mutex_lock(&pool.lock);
+    while (true) {
+        Task* task = pop_task();
+        if (task) {
+            pthread_mutex_unlock(&pool.lock);
+            run_task(task);
+            pthread_mutex_lock(&pool.lock);
+        } else if (pool.shutting_down) {
+            break;
+        } else {
+            pthread_cond_wait(&pool.has_tasks, &pool.lock);
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+/// ***************************************************************************
+/// Pool Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function starts the server wide thread pool. If num_threads
+ *  is 0 the size comes from the CS165_THREADS environment variable or else
+ *  the number of online cores. The thread that waits on a task group also
+ *  runs tasks, so we start one thread less than that.
+ *
+ * @param num_threads - the number of threads that should work on tasks
+ *
+ * @return false if the threads could not be started
+ */
+bool thread_pool_start(size_t num_threads) {
+    if (num_threads == 0) {
+        char* env_threads = getenv(THREAD_POOL_ENV);
+        long configured = env_threads ? atol(env_threads) : 0;
+        if (configured <= 0) {
+            configured = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        num_threads = (size_t) MAX(configured, 1);
+    }
+    num_threads = MIN(num_threads - 1, MAX_POOL_THREADS);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.shutting_down = false;
+    while (pool.num_threads < num_threads) {
+        if (pthread_create(&pool.threads[pool.num_threads], NULL,
+                           &pool_worker, NULL) != 0) {
+            pthread_mutex_unlock(&pool.lock);
+            log_err("-- Could not start pool thread %zu\n", pool.num_threads);
+            return false;
+        }
+        pool.num_threads++;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    log_info("-- Thread pool started with %zu threads\n", pool.num_threads);
+    return true;
+}
+
+/**
+ * @brief This function stops the pool threads (after the queue is drained)
+ */
+void thread_pool_shutdown() {
+    pthread_mutex_lock(&pool.lock);
+    pool.shutting_down = true;
+    pthread_cond_broadcast(&pool.has_tasks);
+    pthread_mutex_unlock(&pool.lock);
+    for (size_t i = 0; i < pool.num_threads; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    pool.num_threads = 0;
+}
+
+/**
+ * @brief This function returns how many threads can work on a task group
+ *
+ * @return the pool threads plus the waiting thread
+ */
+size_t thread_pool_parallelism() {
+    return pool.num_threads + 1;
+}
+
+/// ***************************************************************************
+/// Task Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function initializes an (empty) task group
+ *
+ * @param group
+ */
+void task_group_init(TaskGroup* group) {
+    group->num_pending = 0;
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->done, NULL);
+}
+
+/**
+ * @brief This function queues a task for the pool
+ *
+ * @param group - the group the task belongs to
+ * @param func - the function to run
+ * @param arg - the argument of the function
+ */
+void thread_pool_submit(TaskGroup* group, TaskFunc func, void* arg) {
+    Task* task = malloc(sizeof(Task));
+    task->func = func;
+    task->arg = arg;
+    task->group = group;
+    task->next = NULL;
+
+    pthread_mutex_lock(&group->lock);
+    group->num_pending++;
+    pthread_mutex_unlock(&group->lock);
+
+    pthread_mutex_lock(&pool.lock);
+    if (pool.tail) {
+        pool.tail->next = task;
+    } else {
+        pool.head = task;
+    }
+    pool.tail = task;
+    pthread_cond_signal(&pool.has_tasks);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * @brief This function waits until every task of a group is done. While
+ *  there are queued tasks the waiting thread runs them itself, so a group
+ *  also completes when the pool has no threads.
+ *
+ * @param group - the group (destroyed once it is done)
+ */
+void task_group_wait(TaskGroup* group) {
+    while (true) {
+        pthread_mutex_lock(&pool.lock);
+        Task* task = pop_task();
+        pthread_mutex_unlock(&pool.lock);
+        if (task == NULL) {
+            break;
+        }
+        run_task(task);
+    }
+    pthread_mutex_lock(&group->lock);
+    while (group->num_pending > 0) {
+        pthread_cond_wait(&group->done, &group->lock);
+    }
+    pthread_mutex_unlock(&group->lock);
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->done);
+}
@@ -0,0 +1,172 @@
+#include <limits.h>
+#include <string.h>
+#include "zone_map.h"
+#include "utils.h"
+
+/// ***************************************************************************
+/// Creation Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function creates a zone map with room for num_rows rows
+ *
+ * @param num_rows - the number of rows the column has space for
+ *
+ * @return the zone map (NULL if the allocation failed)
+ */
+ZoneMap* create_zone_map(size_t num_rows) {
+    ZoneMap* zone_map = calloc(1, sizeof(ZoneMap));
+    if (zone_map == NULL) {
+        return NULL;
+    }
+    if (zone_map_reserve(zone_map, num_rows) == false) {
+        free_zone_map(zone_map);
+        return NULL;
+    }
+    return zone_map;
+}
+
+/**
+ * @brief This function frees a zone map
+ *
+ * @param zone_map
+ */
+void free_zone_map(ZoneMap* zone_map) {
+    if (zone_map == NULL) {
+        return;
+    }
+    free(zone_map->mins);
+    free(zone_map->maxs);
+    free(zone_map);
+}
+
+/**
+ * @brief This function makes sure the zone map can hold num_rows rows (it
+ *  is called whenever the table grows)
+ *
+ * @param zone_map
+ * @param num_rows - the new capacity of the column
+ *
+ * @return false if the allocation failed
+ */
+bool zone_map_reserve(ZoneMap* zone_map, size_t num_rows) {
+    if (zone_map == NULL) {
+        return true;
+    }
+    size_t num_zones = NUM_ZONES(num_rows);
+    if (num_zones <= zone_map->capacity) {
+        return true;
+    }
+    int* mins = realloc(zone_map->mins, num_zones * sizeof(int));
+    if (mins == NULL) {
+        return false;
+    }
+    zone_map->mins = mins;
+    int* maxs = realloc(zone_map->maxs, num_zones * sizeof(int));
+    if (maxs == NULL) {
+        return false;
+    }
+    zone_map->maxs = maxs;
+    zone_map->capacity = num_zones;
+    return true;
+}
+
+/// ***************************************************************************
+/// Maintenance Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function records a value that was written to row_idx. Clean
+ *  zones are widened, and a zone started by an append is clean right away
+ *  so that a column that is only appended to never needs a refresh.
+ *
+ * @param zone_map
+ * @param row_idx - the row the value was written to
+ * @param value - the value
+ * @param num_rows - the number of rows in the column (after the write)
+ */
+void zone_map_insert(ZoneMap* zone_map, size_t row_idx, int value, size_t num_rows) {
+    if (zone_map == NULL) {
+        return;
+    }
+    size_t zone_idx = ZONE_IDX(row_idx);
+    if (zone_idx < zone_map->num_clean) {
+        zone_map->mins[zone_idx] = MIN(zone_map->mins[zone_idx], value);
+        zone_map->maxs[zone_idx] = MAX(zone_map->maxs[zone_idx], value);
+    } else if (zone_idx == zone_map->num_clean &&
+               row_idx % ZONE_SZ == 0 &&
+               row_idx + 1 == num_rows
+    ) {
+        zone_map->mins[zone_idx] = value;
+        zone_map->maxs[zone_idx] = value;
+        zone_map->num_clean++;
+    }
+}
+
+/**
+ * @brief This function marks every zone from row_idx on as stale (for
+ *  when the values after row_idx get shifted)
+ *
+ * @param zone_map
+ * @param row_idx - the first row that moved
+ */
+void zone_map_invalidate(ZoneMap* zone_map, size_t row_idx) {
+    if (zone_map == NULL) {
+        return;
+    }
+    zone_map->num_clean = MIN(zone_map->num_clean, ZONE_IDX(row_idx));
+}
+
+/**
+ * @brief This function recomputes the stale zones. It has to be called
+ *  before the zone map is used for a scan.
+ *
+ * @param zone_map
+ * @param data - the column data
+ * @param num_rows - the number of rows in the column
+ */
+void zone_map_refresh(ZoneMap* zone_map, const int* data, size_t num_rows) {
+    if (zone_map == NULL) {
+        return;
+    }
+    size_t num_zones = NUM_ZONES(num_rows);
+    for (size_t zone_idx = zone_map->num_clean; zone_idx < num_zones; zone_idx++) {
+        size_t end = MIN((zone_idx + 1) * ZONE_SZ, num_rows);
+        int min_val = INT_MAX;
+        int max_val = INT_MIN;
+        for (size_t idx = zone_idx * ZONE_SZ; idx < end; idx++) {
+            min_val = MIN(min_val, data[idx]);
+            max_val = MAX(max_val, data[idx]);
+        }
+        zone_map->mins[zone_idx] = min_val;
+        zone_map->maxs[zone_idx] = max_val;
+    }
+    zone_map->num_clean = MAX(zone_map->num_clean, num_zones);
+}
+
+/// ***************************************************************************
+/// Lookup Functions
+/// ***************************************************************************
+
+/**
+ * @brief This function checks a zone against the predicate low <= x < high
+ *
+ * @param zone_map
+ * @param zone_idx
+ * @param low - inclusive low bound
+ * @param high - exclusive high bound
+ *
+ * @return whether none, some or all of the zone qualifies
+ */
+ZoneCheck zone_map_check(const ZoneMap* zone_map, size_t zone_idx, int low, int high) {
+    if (zone_map == NULL || zone_idx >= zone_map->num_clean) {
+        return ZONE_SOME;
+    }
+    if (zone_map->maxs[zone_idx] < low || zone_map->mins[zone_idx] >= high) {
+        return ZONE_NONE;
+    }
+    if (zone_map->mins[zone_idx] >= low && zone_map->maxs[zone_idx] < high) {
+        return ZONE_ALL;
+    }
+    return ZONE_SOME;
+}